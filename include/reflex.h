@@ -75,6 +75,7 @@
  *    -# Update the position q, velocity dq, and Jacobian J in the rfx_ctrl_t
  *    -# Update the reference q_r, x_r, etc in the rfx_ctrl_t
  *    -# Compute desired velocities with \ref rfx_ctrl_ws_lin_vfwd
+ *       (or \ref rfx_ctrl_ws_lin_vfwd_work to avoid allocation)
  *    -# Send the velocities to your arm
  * -# Finalization
  *    -# Call \ref rfx_ctrl_ws_destroy
@@ -158,6 +159,19 @@ typedef enum {
 
 AA_API const char* rfx_status_string(rfx_status_t i);
 
+/** Bit for status code r in a limit mask */
+#define RFX_LIMIT_BIT(r) (1u << (r))
+
+/** Mask of all limit status codes */
+#define RFX_LIMIT_ALL ( RFX_LIMIT_BIT(RFX_LIMIT_POSITION) |            \
+                        RFX_LIMIT_BIT(RFX_LIMIT_POSITION_ERROR) |      \
+                        RFX_LIMIT_BIT(RFX_LIMIT_FORCE) |               \
+                        RFX_LIMIT_BIT(RFX_LIMIT_MOMENT) |              \
+                        RFX_LIMIT_BIT(RFX_LIMIT_FORCE_ERROR) |         \
+                        RFX_LIMIT_BIT(RFX_LIMIT_MOMENT_ERROR) |        \
+                        RFX_LIMIT_BIT(RFX_LIMIT_CONFIGURATION) |       \
+                        RFX_LIMIT_BIT(RFX_LIMIT_CONFIGURATION_ERROR) )
+
 #define RFX_PERROR(s, r) {                                              \
         rfx_status_t _rfx_$_perror_r = r;                               \
         const char *_rfx_$_perror_s = s;                                \
@@ -187,6 +201,58 @@ struct rfx_ctrlx_state {
     double *F;  ///< workspace forces
 };
 
+/** Flag in rfx_ctrl_ref_chan::middle marking an unread buffer */
+#define RFX_CTRL_REF_FRESH 4u
+
+/** Wait-free channel for passing reference states between threads.
+ *
+ * A triple buffer with a single writer, such as a trajectory thread,
+ * and a single reader, such as the real-time control thread.  Neither
+ * side blocks or retries, and the reader always gets the complete
+ * state from one call to rfx_ctrl_ref_publish(), never a mix of two.
+ */
+typedef struct rfx_ctrl_ref_chan {
+    size_t n_q;                    ///< size of config space
+    struct rfx_ctrlx_state buf[3]; ///< the three buffers
+    uint64_t seq[3];               ///< publication number of each buffer
+    uint64_t n_pub;                ///< number of publications (writer)
+    unsigned back;                 ///< buffer owned by the writer
+    unsigned front;                ///< buffer owned by the reader
+    unsigned middle;               ///< shared buffer, exchanged atomically
+} rfx_ctrl_ref_chan_t;
+
+/** Scratch space for the workspace controller.
+ *
+ * Sized once for a given n_q, then reused on every call to
+ * rfx_ctrl_ws_lin_vfwd_work() so the control step does no heap,
+ * region, or stack (VLA) allocation.
+ */
+typedef struct rfx_ctrl_ws_work {
+    size_t n_q;      ///< size of config space
+    double *dq_r;    ///< jointspace reference velocity, size n_q
+    double *J_star;  ///< damped pseudo-inverse, size n_q*6
+    double *A;       ///< copy of the jacobian, overwritten by SVD, size 6*n_q
+    double *U;       ///< left singular vectors, size 6*6
+    double *s;       ///< singular values, size 6
+    double *Vt;      ///< right singular vectors, size 6*n_q
+    double *lapack;  ///< LAPACK work array, size n_lapack
+    int n_lapack;    ///< size of LAPACK work array
+    unsigned limits; ///< mask of limits violated on the last call
+} rfx_ctrl_ws_work_t;
+
+/** Initialize controller scratch space.
+ *  Malloc's arrays for each field
+ */
+AA_API void rfx_ctrl_ws_work_init( rfx_ctrl_ws_work_t *w, size_t n_q );
+
+/** Initialize controller scratch space.
+ *  Allocates arrays for each field from reg
+ */
+AA_API void rfx_ctrl_ws_work_init_region( rfx_ctrl_ws_work_t *w, aa_mem_region_t *reg, size_t n_q );
+
+/** Free the arrays of controller scratch space allocated by rfx_ctrl_ws_work_init(). */
+AA_API void rfx_ctrl_ws_work_destroy( rfx_ctrl_ws_work_t *w );
+
 /** Workspace control state and reference values.
  *
  */
@@ -195,6 +261,7 @@ typedef struct {
     struct rfx_ctrlx_state act; ///< actual state
     struct rfx_ctrlx_state ref; ///< reference state
     double *J;       ///< jacobian
+    rfx_ctrl_ws_work_t *work; ///< preallocated controller scratch space
     // limits
     double F_max;    ///< maximum linear force magnitude (<=0 to ignore)
     double M_max;    ///< maximum moment magnitude (<=0 to ignore)
@@ -206,10 +273,30 @@ typedef struct {
     double *q_max;   ///< maximum joint values (always checked)
     double x_min[3]; ///< minimum workspace position (always checked)
     double x_max[3]; ///< maximum workspace position (always checked)
+    rfx_ctrl_ref_chan_t *ref_chan; ///< if non-null, source of ref, see rfx_ctrl_ref_sync()
+    struct rfx_trace *trace; ///< if non-null and built with RFX_TRACE, latency trace
 } rfx_ctrl_t;
 
 typedef rfx_ctrl_t rfx_ctrl_ws_t;
 
+/** Check all limits.
+ *
+ * Joint and workspace position bounds are always checked.  Force,
+ * moment, and error limits are checked when their maximum is > 0.
+ *
+ * \param g the control struct
+ * \param dx the commanded workspace velocity, for direction checks
+ * \returns mask of violated limits, RFX_LIMIT_BIT() of each status code
+ */
+AA_API unsigned rfx_ctrl_limit_check( const rfx_ctrl_t *g, const double dx[6] );
+
+/** Return the highest priority status code in a limit mask.
+ *
+ * Priority follows the order limits were historically checked:
+ * force, moment, configuration, position, then the error limits.
+ */
+AA_API rfx_status_t rfx_ctrl_limit_status( unsigned limits );
+
 /**
  * Update the actual state in the controller.
  *
@@ -243,11 +330,74 @@ rfx_ctrl_update_act( rfx_ctrl_t *G,
  */
 AA_API void rfx_ctrlx_state_init( struct rfx_ctrlx_state *x, size_t n );
 
+/** Free the arrays of a workspace control state structure. */
+AA_API void rfx_ctrlx_state_destroy( struct rfx_ctrlx_state *x );
+
 /// initialize workspace controller
 AA_API void rfx_ctrl_ws_init( rfx_ctrl_ws_t *g, size_t n );
 /// destroy workspace controller
 AA_API void rfx_ctrl_ws_destroy( rfx_ctrl_ws_t *g );
 
+/** Initialize a reference channel.
+ *  Malloc's arrays for each buffer
+ */
+AA_API void rfx_ctrl_ref_chan_init( rfx_ctrl_ref_chan_t *c, size_t n_q );
+
+/** Free the arrays of a reference channel. */
+AA_API void rfx_ctrl_ref_chan_destroy( rfx_ctrl_ref_chan_t *c );
+
+/** Publish a new reference state.
+ *
+ * Writer side, wait-free.  Copies ref into the channel.
+ *
+ * \returns the publication number
+ */
+AA_API uint64_t rfx_ctrl_ref_publish( rfx_ctrl_ref_chan_t *c, const struct rfx_ctrlx_state *ref );
+
+/** Read the latest reference state.
+ *
+ * Reader side, wait-free.  When a state was published since the
+ * last read, copies it into ref.  Otherwise, ref is left unchanged,
+ * so the reader may update it locally between publications.
+ *
+ * \param c the channel
+ * \param ref destination
+ * \param seq if non-null, the publication number of the state, 0 if
+ *        nothing has been published
+ * \returns 1 if the state is newer than the last read, 0 otherwise
+ */
+AA_API int rfx_ctrl_ref_read( rfx_ctrl_ref_chan_t *c, struct rfx_ctrlx_state *ref, uint64_t *seq );
+
+/** Update g->ref from g->ref_chan, if attached.
+ *
+ * g->ref changes only when a new reference was published, so local
+ * integration with rfx_ctrl_ws_sdx() continues between publications.
+ *
+ * Called by rfx_ctrlx_lin_vfwd().
+ * Call this before other controllers from the control thread.
+ *
+ * \returns 1 if a new reference was received, 0 otherwise
+ */
+AA_API int rfx_ctrl_ref_sync( rfx_ctrl_t *g );
+
+/** Methods to compute the damped jacobian inverse.
+ */
+typedef enum {
+    /** SVD of J, each singular value is damped separately.
+     */
+    RFX_CTRL_PINV_SVD = 0,
+    /** Cholesky solve of the 6x6 system \f$ (J J^T + \lambda I) y = \dot{x} \f$.
+     *
+     * With s2min > 0, the system is solved undamped while a lower
+     * bound on the smallest eigenvalue of \f$J J^T\f$ is at least
+     * s2min.  Below that, each eigenvalue under s2min is raised to
+     * s2min along its own eigenvector, which gives the same deadzone
+     * damping as RFX_CTRL_PINV_SVD.  Otherwise, \f$\lambda\f$ = dls
+     * in all directions.
+     */
+    RFX_CTRL_PINV_CHOL6 = 1
+} rfx_ctrl_pinv_t;
+
 /** Gains for linear workspace control.
  */
 typedef struct {
@@ -258,6 +408,7 @@ typedef struct {
     double f[6];   ///< force error gains
     double dls;    ///< damped least squares k
     double s2min;  ///< deadzone damped least squares minimum square singular value
+    rfx_ctrl_pinv_t pinv; ///< method for the damped jacobian inverse
 } rfx_ctrl_ws_lin_k_t;
 
 
@@ -291,6 +442,80 @@ AA_API void rfx_ctrl_ws_lin_k_destroy( rfx_ctrl_ws_lin_k_t *k );
  */
 AA_API rfx_status_t rfx_ctrl_ws_lin_vfwd( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k,  double *u );
 
+/** Desired workspace velocity of the linear workspace control law.
+ *
+ * \f[ \dot{x}_u = \dot{x}_r - k_p(x - x_r) -  k_f(F - F_r) \f]
+ *
+ * \param ws The state and reference values
+ * \param k The gains
+ * \param dx_u The workspace velocity to track
+ * \param limits If non-null, the mask of violated limits
+ * \returns highest priority violated limit, or RFX_OK
+ */
+AA_API rfx_status_t rfx_ctrl_ws_lin_dx( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k,
+                                        double dx_u[6], unsigned *limits );
+
+/** Linear Workspace Control using preallocated scratch space.
+ *
+ * Computes the same control law as rfx_ctrl_ws_lin_vfwd(), but all
+ * temporaries for the pseudo-inverse and null-space projection are
+ * taken from work.  Performs no heap, region, or stack (VLA)
+ * allocation.
+ *
+ * \param ws The state and reference values
+ * \param k The gains
+ * \param work Scratch space, initialized for ws->n_q
+ * \param u The configuration velocity to command, \f$ u \in \Re^{n_q} \f$
+ */
+AA_API rfx_status_t rfx_ctrl_ws_lin_vfwd_work( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k,
+                                               rfx_ctrl_ws_work_t *work, double *u );
+
+
+/** Scratch space for batched control of several arms.
+ *
+ * Arrays are structure-of-arrays: element i of arm a is stored at
+ * index i*n + a, so the inner loops over arms vectorize.  Arms with
+ * fewer than n_q joints are padded with zero jacobian columns.
+ */
+typedef struct rfx_ctrl_ws_batch {
+    size_t n;        ///< number of arms
+    size_t n_q;      ///< maximum config space size over all arms
+    double *J;       ///< jacobians, 6*n_q*n
+    double *dq_r;    ///< jointspace reference velocities, n_q*n
+    double *y;       ///< workspace velocities, then DLS solution, 6*n
+    double *A;       ///< damped J*J^T, then its Cholesky factor, 36*n
+    double *L;       ///< undamped Cholesky factor, 36*n
+    double *w;       ///< scratch vectors, 12*n
+    double *e;       ///< lower bounds on the smallest eigenvalue of J*J^T, n
+    double *lambda;  ///< damping, n
+    double *s2min;   ///< deadzone minimum square singular value, n
+    double *valid;   ///< 1 for arms to solve, 0 otherwise, n
+} rfx_ctrl_ws_batch_t;
+
+/// initialize batch scratch space for n arms of at most n_q joints
+AA_API void rfx_ctrl_ws_batch_init( rfx_ctrl_ws_batch_t *b, size_t n, size_t n_q );
+/// destroy batch scratch space
+AA_API void rfx_ctrl_ws_batch_destroy( rfx_ctrl_ws_batch_t *b );
+
+/** Linear Workspace Control for several arms at once.
+ *
+ * Computes the same result as calling rfx_ctrl_ws_lin_vfwd() for
+ * each arm with RFX_CTRL_PINV_CHOL6, but the damped least-squares
+ * solves for all arms are done together over structure-of-arrays
+ * data.
+ *
+ * \param b Batch scratch space, initialized for at least n arms
+ * \param n Number of arms
+ * \param ws Array of state and reference values, one per arm
+ * \param k Array of gains, one per arm
+ * \param u Array of configuration velocity outputs, one per arm
+ * \param r Array of status outputs, one per arm
+ * \returns RFX_OK if all arms returned RFX_OK, otherwise the first non-OK status
+ */
+AA_API rfx_status_t rfx_ctrl_ws_lin_vfwd_batch( rfx_ctrl_ws_batch_t *b, size_t n,
+                                                const rfx_ctrl_ws_t *const *ws,
+                                                const rfx_ctrl_ws_lin_k_t *const *k,
+                                                double *const *u, rfx_status_t *r );
 
 /** Linear jointspace control
  */
@@ -300,21 +525,86 @@ AA_API rfx_status_t rfx_ctrlq_lin_vfwd( const rfx_ctrl_t *g, const rfx_ctrlq_lin
 /** Integrate the reference velocity in ws to produce an updated
  * reference position.
  *
- * Uses RK1/Euler integration.
+ * Uses RK1/Euler integration.  See rfx_ctrl_ws_sdx_integ() for
+ * higher-order methods.
  */
 rfx_status_t rfx_ctrl_ws_sdx( rfx_ctrl_ws_t *ws, double dt );
 
 
 
+/** Cache of the pose and jacobian for rfx_ctrlx_lin_t.
+ *
+ * While every joint is within q_tol of the cached configuration, the
+ * jacobian is reused and the pose is updated to first order from the
+ * configuration change, \f$ \Delta x = J \Delta q \f$.  Otherwise, or
+ * after max_age consecutive reuses, kin_fun is called.
+ */
+typedef struct rfx_ctrlx_kin_cache {
+    size_t n_q;      ///< size of config space
+    double q_tol;    ///< maximum joint change to reuse the cache
+    size_t max_age;  ///< maximum consecutive reuses before recomputing
+    size_t age;      ///< reuses since the last full computation
+    int valid;       ///< whether the cache holds a pose and jacobian
+    double *q;       ///< configuration of the cached values, size n_q
+    double S[8];     ///< pose dual quaternion at q
+    double *J;       ///< jacobian at q, size 6*n_q
+    size_t n_hit;    ///< number of reuses
+    size_t n_miss;   ///< number of calls to kin_fun
+    /** Triple buffer of injected values, see rfx_ctrlx_lin_set_kin() */
+    struct rfx_ctrlx_kin_slot {
+        double *q;   ///< configuration, size n_q
+        double S[8]; ///< pose dual quaternion at q
+        double *J;   ///< jacobian at q, size 6*n_q
+    } slot[3];
+    unsigned back;   ///< slot owned by rfx_ctrlx_lin_set_kin()
+    unsigned front;  ///< slot owned by the control thread
+    unsigned middle; ///< shared slot, exchanged atomically, see RFX_CTRL_REF_FRESH
+} rfx_ctrlx_kin_cache_t;
+
 typedef struct rfx_ctrlx_lin {
     rfx_ctrl_t *ctrl;
     rfx_ctrl_ws_lin_k_t *k;
     rfx_kin_fun kin_fun;
     void  *kin_fun_cx;
+    rfx_ctrlx_kin_cache_t *cache; ///< if non-null, pose and jacobian cache
 } rfx_ctrlx_lin_t;
 
 rfx_ctrlx_lin_t *rfx_ctrlx_lin_alloc( aa_mem_region_t *reg, size_t n_q, rfx_kin_fun kin_fun, void *kin_fun_cx );
 
+/** Allocate and attach a pose and jacobian cache.
+ *
+ * \param reg region to allocate from
+ * \param ctrl the controller
+ * \param q_tol maximum joint change to reuse the cache
+ * \param max_age maximum consecutive reuses before recomputing
+ */
+AA_API rfx_ctrlx_kin_cache_t *rfx_ctrlx_lin_cache_alloc( aa_mem_region_t *reg, rfx_ctrlx_lin_t *ctrl,
+                                                         double q_tol, size_t max_age );
+
+/** Inject an externally computed pose and jacobian.
+ *
+ * The next control step at a configuration within q_tol of q uses
+ * these values instead of calling kin_fun.
+ *
+ * Wait-free and safe to call from one other thread, such as an
+ * estimator, concurrently with the control step.  The values pass
+ * through a triple buffer, like rfx_ctrl_ref_publish(), and the
+ * control step takes the latest complete set.
+ *
+ * \param ctrl the controller, with a cache attached
+ * \param q configuration where E and J were computed
+ * \param E pose as quaternion-translation
+ * \param J jacobian, 6*n_q
+ */
+AA_API void rfx_ctrlx_lin_set_kin( const rfx_ctrlx_lin_t *ctrl, const double *q,
+                                   const double E[7], const double *J );
+
+/** Mark the cached pose and jacobian as stale.
+ *
+ * Call from the control thread.
+ */
+AA_API void rfx_ctrlx_lin_cache_clear( const rfx_ctrlx_lin_t *ctrl );
+
 AA_API rfx_status_t rfx_ctrlx_lin_vfwd( const rfx_ctrlx_lin_t *ctrl, const double *q,
                                         double *u );
 
@@ -342,12 +632,19 @@ int rfx_ctrlx_fun_lin_vfwd ( void *cx,
 /*  *\/ */
 /* void ctrl_pd( const ctrl_pd_t *A, size_t n_u, double *u ); */
 
+#include "reflex/tpool.h"
 #include "reflex/lqg.h"
+#include "reflex/lqg_bank.h"
 #include "reflex/kinematics.h"
 #include "reflex/trajq.h"
 #include "reflex/trajx.h"
 #include "reflex/body.h"
 #include "reflex/tf.h"
+#include "reflex/sot.h"
+#include "reflex/qp.h"
+#include "reflex/osc.h"
+#include "reflex/integ.h"
+#include "reflex/trace.h"
 
 #ifdef __cplusplus
 }
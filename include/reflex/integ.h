@@ -0,0 +1,108 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef REFLEX_INTEG_H
+#define REFLEX_INTEG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file integ.h
+ *
+ * Integration of reference poses on the dual quaternion manifold.
+ *
+ * Velocities are \f$ \dot{x} = [v, \omega] \f$, the linear velocity of
+ * the frame origin and the rotational velocity, both in the parent
+ * frame, as used by aa_tf_duqu_svel().  Accelerations
+ * \f$ \ddot{x} \f$ are the time derivative of \f$ \dot{x} \f$.
+ */
+
+/** Methods to integrate a reference pose.
+ */
+typedef enum rfx_ctrl_integ {
+    /** One step of aa_tf_duqu_svel() at the initial velocity, as
+     *  rfx_ctrl_ws_sdx().  Ignores acceleration.
+     */
+    RFX_CTRL_INTEG_EULER = 0,
+    /** Classical fourth-order Runge-Kutta on the dual quaternion
+     *  derivative, then normalization.  No transcendental calls.
+     */
+    RFX_CTRL_INTEG_RK4 = 1,
+    /** Exponential map.  Translation is exact for constant
+     *  acceleration.  Rotation takes one quaternion exponential at the
+     *  midpoint rotational velocity, exact for constant rotational
+     *  velocity and second order with rotational acceleration.
+     */
+    RFX_CTRL_INTEG_EXP = 2
+} rfx_ctrl_integ_t;
+
+/** Integrate a pose over one time step.
+ *
+ * \param method the integration method
+ * \param S0 initial pose dual quaternion
+ * \param dx initial velocity
+ * \param ddx acceleration, or NULL for zero
+ * \param dt time step
+ * \param S1 final pose dual quaternion
+ */
+AA_API void rfx_ctrl_integ_duqu( rfx_ctrl_integ_t method, const double S0[8],
+                                 const double dx[6], const double ddx[6],
+                                 double dt, double S1[8] );
+
+/** Integrate the reference pose and velocity of ws.
+ *
+ * Updates ws->ref.S and, given an acceleration, ws->ref.dx.
+ *
+ * \param ws the controller
+ * \param method the integration method
+ * \param ddx reference acceleration, or NULL for zero
+ * \param dt time step
+ */
+AA_API rfx_status_t rfx_ctrl_ws_sdx_integ( rfx_ctrl_ws_t *ws, rfx_ctrl_integ_t method,
+                                           const double ddx[6], double dt );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //REFLEX_INTEG_H
@@ -72,6 +72,8 @@ void rfx_lqg_kf_predict_cov
  * @param P Coviariance, n_x*n_x
  * @param W Measurement noise model, n_z*n_z
  * @param K Kalman Gain, n_x*n_z
+ * @return 0 on success, nonzero if the innovation covariance is not
+ *   positive definite, in which case K is unchanged
  */
 int rfx_lqg_kf_correct_gain
 ( size_t n_x, size_t n_z, const double *C, const double *P, const double *W, double *K );
@@ -222,6 +224,206 @@ int rfx_lqg_ekf_correct
 ( void *cx, size_t n_x, size_t n_z, double *x, const double *z, double *P, const double *W,
   rfx_lqg_ekf_measure_fun measure, rfx_lqg_ekf_innovate_fun innovate, rfx_lqg_ekf_update_fun update );
 
+/** Preallocated scratch for the EKF drivers.
+ *
+ * The _work drivers take all temporaries from this struct, so they
+ * neither touch the allocator nor place variable-length arrays on the
+ * stack.
+ */
+typedef struct rfx_lqg_ekf_ws {
+    size_t n_x;     ///< state size
+    size_t n_z;     ///< measurement size
+    double *F;      ///< linearized process model, n_x*n_x
+    double *y;      ///< innovation, n_z
+    double *H;      ///< linearized measurement model, n_z*n_x
+    double *K;      ///< kalman gain, n_x*n_z
+    double *Ky;     ///< state update, n_x
+    double *work;   ///< scratch, max(n_z*n_x + n_z*n_z, 2*n_x*n_x)
+} rfx_lqg_ekf_ws_t;
+
+/** Allocate EKF scratch, each array aligned to 64 bytes.
+ *
+ * @return 0 on success, nonzero on allocation failure
+ */
+AA_API int rfx_lqg_ekf_ws_init( rfx_lqg_ekf_ws_t *ws, size_t n_x, size_t n_z );
+
+/** Free EKF scratch. */
+AA_API void rfx_lqg_ekf_ws_destroy( rfx_lqg_ekf_ws_t *ws );
+
+/** EKF prediction step using preallocated scratch.
+ *
+ * As rfx_lqg_ekf_predict(), with the state size taken from ws.
+ */
+AA_API int rfx_lqg_ekf_predict_work
+( rfx_lqg_ekf_ws_t *ws, void *cx, double *x, const double *u, double *P, const double *V,
+  rfx_lqg_ekf_process_fun process );
+
+/** EKF correction step using preallocated scratch.
+ *
+ * As rfx_lqg_ekf_correct(), with the state and measurement sizes
+ * taken from ws.  On return, ws.K holds the gain.
+ */
+AA_API int rfx_lqg_ekf_correct_work
+( rfx_lqg_ekf_ws_t *ws, void *cx, double *x, const double *z, double *P, const double *W,
+  rfx_lqg_ekf_measure_fun measure, rfx_lqg_ekf_innovate_fun innovate, rfx_lqg_ekf_update_fun update );
+
+
+/***************************************/
+/* Square-Root Kalman Filter Functions */
+/***************************************/
+
+/* The square-root filter propagates a factor S of the covariance,
+ * P = S**T * S, instead of P itself.  Each step re-triangularizes a
+ * stacked pre-array with a QR factorization, so P stays symmetric
+ * and positive semidefinite by construction and the factor has half
+ * the dynamic range of P.
+ */
+
+/** Compute a square-root factor U of a symmetric positive
+ * semidefinite matrix, U**T * U = A.
+ *
+ * Uses the Cholesky factorization when A is positive definite, and
+ * otherwise an eigendecomposition with negative eigenvalues clamped
+ * to zero, in which case U is not triangular.
+ *
+ * @param n size of A
+ * @param A matrix to factor, only the upper triangle is referenced
+ * @param U factor, n*n
+ * @return 0 if A was positive definite, 1 if it was semidefinite,
+ *   negative if the eigendecomposition failed
+ */
+AA_API int rfx_lqg_sqrt_factor( size_t n, const double *A, double *U );
+
+/** Square-root Kalman filter covariance prediction.
+ *
+ * \f[ S^T S \leftarrow A S^T S A^T + S_v^T S_v \f]
+ *
+ * @param n state size
+ * @param A process model, n*n
+ * @param Sv factor of the process noise, n*n
+ * @param S covariance factor, n*n, upper triangular on output
+ * @return 0 on success, nonzero if the QR factorization failed, in
+ *   which case S is unchanged
+ */
+AA_API int rfx_lqg_sqkf_predict_cov
+( size_t n, const double *A, const double *Sv, double *S );
+
+/** Square-root Kalman filter gain and covariance correction.
+ *
+ * QR factors the pre-array
+ * \f[ \left[\begin{array}{cc} S_w & 0 \\ S C^T & S \end{array}\right] \f]
+ * yielding the innovation covariance factor, the gain, and the
+ * corrected covariance factor.
+ *
+ * @param n_x state size
+ * @param n_z measurement size
+ * @param C measurement model, n_z*n_x
+ * @param Sw factor of the measurement noise, n_z*n_z
+ * @param S covariance factor, n_x*n_x, upper triangular on output
+ * @param K Kalman gain, n_x*n_z
+ * @return 0 on success, nonzero if the innovation covariance is
+ *   singular, in which case S and K are unchanged
+ */
+AA_API int rfx_lqg_sqkf_correct_cov
+( size_t n_x, size_t n_z, const double *C, const double *Sw, double *S, double *K );
+
+/** Square-root driver for Extended Kalman Filter prediction step.
+ *
+ * As rfx_lqg_ekf_predict(), propagating covariance factor S with
+ * process noise factor Sv.
+ */
+AA_API int rfx_lqg_sqekf_predict
+( void *cx, size_t n_x, double *x, const double *u, double *S, const double *Sv,
+  rfx_lqg_ekf_process_fun process );
+
+/** Square-root driver for Extended Kalman Filter correction step.
+ *
+ * As rfx_lqg_ekf_correct(), propagating covariance factor S with
+ * measurement noise factor Sw.
+ */
+AA_API int rfx_lqg_sqekf_correct
+( void *cx, size_t n_x, size_t n_z, double *x, const double *z, double *S, const double *Sw,
+  rfx_lqg_ekf_measure_fun measure, rfx_lqg_ekf_innovate_fun innovate, rfx_lqg_ekf_update_fun update );
+
+
+/********************************/
+/* Sequential Scalar Correction */
+/********************************/
+
+/* With uncorrelated measurement noise, the correction may be applied
+ * one measurement at a time as rank-1 updates, avoiding the n_z*n_z
+ * innovation covariance and its factorization.  Correlated noise is
+ * first decorrelated with a cached factor of W.  The result is the
+ * same as a single batch correction.
+ */
+
+/** Sequential correction state and scratch. */
+typedef struct rfx_lqg_seq {
+    size_t n_x;         ///< state size
+    size_t n_z;         ///< measurement size
+    int diag;           ///< nonzero when W is diagonal
+    double *W;          ///< measurement noise, n_z*n_z
+    double *U;          ///< cached factor of W over valid measurements, n_z*n_z
+    size_t *idx;        ///< indices of valid measurements in the cached factor
+    size_t n_valid;     ///< number of valid measurements in the cached factor
+    uint8_t *mask;      ///< mask of the cached factor, n_z
+    int cached;         ///< nonzero when U is valid
+    double *Cw;         ///< scratch, whitened measurement model, n_z*n_x
+    double *zw;         ///< scratch, whitened measurement, n_z
+    double *Pc;         ///< scratch, n_x
+} rfx_lqg_seq_t;
+
+/** Initialize sequential correction for measurement noise W.
+ *
+ * @param W measurement noise, n_z*n_z, only the upper triangle is referenced
+ */
+AA_API void rfx_lqg_seq_init( rfx_lqg_seq_t *seq, size_t n_x, size_t n_z, const double *W );
+
+/** Free sequential correction state. */
+AA_API void rfx_lqg_seq_destroy( rfx_lqg_seq_t *seq );
+
+/** Change the measurement noise, invalidating the cached factor. */
+AA_API void rfx_lqg_seq_set_noise( rfx_lqg_seq_t *seq, const double *W );
+
+/** Correct with a single scalar measurement.
+ *
+ * \f[ k = P c^T / (c P c^T + w) \f]
+ * \f[ x \leftarrow x + k (z - c x) \f]
+ * \f[ P \leftarrow P - k c P \f]
+ *
+ * @param n_x state size
+ * @param c measurement row, n_x elements with stride inc_c
+ * @param inc_c stride of c
+ * @param w measurement noise variance
+ * @param z measurement
+ * @param x state
+ * @param P covariance, n_x*n_x, only the upper triangle is referenced and updated
+ * @param Pc scratch, n_x
+ * @return 0 on success, nonzero if the innovation variance is not positive
+ */
+AA_API int rfx_lqg_kf_correct_scalar
+( size_t n_x, const double *c, size_t inc_c, double w, double z,
+  double *x, double *P, double *Pc );
+
+/** Sequential Kalman filter correction with a validity mask.
+ *
+ * Equivalent to rfx_lqg_kf_correct() over the valid measurements.
+ * With correlated W, a change of mask refactors the valid block of
+ * W; the factor is cached across calls with the same mask.
+ *
+ * @param C measurement model, n_z*n_x
+ * @param z measurement, n_z
+ * @param mask per-measurement validity flags, n_z, or NULL for all
+ * @param x state
+ * @param P covariance, only the upper triangle is referenced and updated
+ * @return 0 on success, negative if the valid block of W is not
+ *   positive definite, otherwise the number of skipped measurements
+ *   with nonpositive innovation variance
+ */
+AA_API int rfx_lqg_seq_correct
+( rfx_lqg_seq_t *seq, const double *C, const double *z, const uint8_t *mask,
+  double *x, double *P );
+
 
 
 
@@ -246,6 +448,9 @@ typedef struct {
     double *P;   ///< covariance,             matrix size n_x * n_x, column-major
     double *V;   ///< process noise,          matrix size n_x * n_x, column-major
     double *W;   ///< measurement noise,      matrix size n_z * n_z, column-major
+    double *S;   ///< covariance factor,      matrix size n_x * n_x, column-major, P = S**T * S
+    double *Sv;  ///< process noise factor,   matrix size n_x * n_x, column-major, V = Sv**T * Sv
+    double *Sw;  ///< measurement factor,     matrix size n_z * n_z, column-major, W = Sw**T * Sw
 
     double *Q;   ///< state cost,             matrix size n_x * n_x, column-major
     double *R;   ///< input cost,             matrix size n_u * n_u, column-major
@@ -392,14 +597,146 @@ AA_API void rfx_lqg_kf_predict( rfx_lqg_t *lqg );
  *   - lqg.x overwritten with the corrected state vector
  *   - lqg.K overwritten with the Kalman gain matrix
  *   - lqg.P overwritten with the updated covariance matrix
+ *
+ * @return 0 on success, nonzero if the innovation covariance is not
+ *   positive definite, in which case lqg.x, lqg.K, and lqg.P are
+ *   unchanged
+ */
+AA_API int rfx_lqg_kf_correct( rfx_lqg_t *lqg );
+
+/** Initialize the factors of a square-root Kalman filter.
+ *
+ * \f[ S^T S \leftarrow P, \quad S_v^T S_v \leftarrow V, \quad S_w^T S_w \leftarrow W \f]
+ *
+ * The noise factors are cached for rfx_lqg_sqkf_predict() and
+ * rfx_lqg_sqkf_correct(); call again after changing V or W.
+ *
+ * @return 0 if P was positive definite, 1 if it was semidefinite,
+ *   negative if any factorization failed
+ */
+AA_API int rfx_lqg_sqkf_init( rfx_lqg_t *lqg );
+
+/** Square-root Kalman filter predict step.
+ *
+ * Same estimate as rfx_lqg_kf_predict(), but propagates lqg.S
+ * rather than lqg.P, using the cached factor lqg.Sv.  lqg.P is not
+ * updated; see rfx_lqg_sqkf_cov().
+ *
+ * @return 0 on success, nonzero if the QR factorization failed, in
+ *   which case lqg.S is unchanged
+ */
+AA_API int rfx_lqg_sqkf_predict( rfx_lqg_t *lqg );
+
+/** Square-root Kalman filter correct step.
+ *
+ * Same estimate as rfx_lqg_kf_correct(), but propagates lqg.S
+ * rather than lqg.P, using the cached factor lqg.Sw.  lqg.P is not
+ * updated; see rfx_lqg_sqkf_cov().
+ *
+ * @return 0 on success, nonzero if the innovation covariance is
+ *   singular or the QR factorization failed, in which case the state
+ *   is unchanged
+ */
+AA_API int rfx_lqg_sqkf_correct( rfx_lqg_t *lqg );
+
+/** Compute covariance from its factor.
+ *
+ * \f[ P \leftarrow S^T S \f]
  */
-AA_API void rfx_lqg_kf_correct( rfx_lqg_t *lqg );
+AA_API void rfx_lqg_sqkf_cov( rfx_lqg_t *lqg );
 
 
 AA_API void rfx_lqg_lqr_gain( rfx_lqg_t *lqg );
 
 AA_API void rfx_lqg_lqr_ctrl( rfx_lqg_t *lqg );
 
+
+/*********************************/
+/* Steady-State Gains (Discrete) */
+/*********************************/
+
+/** Solve the discrete algebraic Riccati equation.
+ *
+ * \f[ X = A^T X A - A^T X B (R + B^T X B)^{-1} B^T X A + Q \f]
+ *
+ * Uses the structured doubling algorithm, which converges
+ * quadratically for stabilizable and detectable systems.
+ *
+ * @param n_x state size
+ * @param n_u input size
+ * @param A state matrix, n_x*n_x
+ * @param B input matrix, n_x*n_u
+ * @param Q state cost, n_x*n_x, symmetric
+ * @param R input cost, n_u*n_u, symmetric positive definite
+ * @param X solution, n_x*n_x
+ * @return 0 on convergence, 1 if the iteration limit was reached,
+ *   negative if a factorization failed
+ */
+AA_API int rfx_lqg_dare( size_t n_x, size_t n_u,
+                         const double *A, const double *B,
+                         const double *Q, const double *R,
+                         double *X );
+
+/** Steady-state discrete Kalman gain.
+ *
+ * Solves the filter Riccati equation for the predicted covariance
+ * \f$P^-\f$, then
+ * \f[ K \leftarrow P^- C^T (C P^- C^T + W)^{-1} \f]
+ * \f[ P \leftarrow (I - KC) P^- \f]
+ *
+ * @return as rfx_lqg_dare(), negative also when
+ *   \f$C P^- C^T + W\f$ is not positive definite, in which case K
+ *   is unchanged and P is left at \f$P^-\f$
+ */
+AA_API int rfx_lqg_kf_dare_gain( rfx_lqg_t *lqg );
+
+/** Steady-state discrete LQR gain.
+ *
+ * Solves the control Riccati equation for X, then
+ * \f[ L \leftarrow (R + B^T X B)^{-1} B^T X A \f]
+ *
+ * @return as rfx_lqg_dare()
+ */
+AA_API int rfx_lqg_dlqr_gain( rfx_lqg_t *lqg );
+
+/** Steady-state switching for a time-invariant Kalman filter. */
+typedef struct rfx_lqg_ss {
+    int steady;         ///< nonzero while running on the steady-state gain
+    int status;         ///< result of the last Riccati solution
+    double tol;         ///< relative gain tolerance for switching (default 1e-6)
+    size_t n_conv;      ///< consecutive converged ticks before switching (default 10)
+    size_t count;       ///< current run of converged ticks
+
+    double *K;          ///< steady-state gain, n_x*n_z
+    double *P;          ///< steady-state corrected covariance, n_x*n_x
+    double *A;          ///< process model snapshot
+    double *C;          ///< measurement model snapshot
+    double *V;          ///< process noise snapshot
+    double *W;          ///< measurement noise snapshot
+} rfx_lqg_ss_t;
+
+/** Initialize steady-state switching and solve for the gain of lqg's model. */
+AA_API void rfx_lqg_ss_init( rfx_lqg_ss_t *ss, const rfx_lqg_t *lqg );
+
+/** Free steady-state switching data. */
+AA_API void rfx_lqg_ss_destroy( rfx_lqg_ss_t *ss );
+
+/** Kalman filter predict and correct, switching to the steady-state gain.
+ *
+ * Runs rfx_lqg_kf_predict() and rfx_lqg_kf_correct() until the
+ * computed gain stays within tol of the steady-state gain for n_conv
+ * ticks, then only
+ * \f[ x \leftarrow Ax + Bu \f]
+ * \f[ x \leftarrow x + K (z - Cx) \f]
+ *
+ * A change to lqg.A, lqg.C, lqg.V, or lqg.W re-solves the steady
+ * state and falls back to the full update, starting from the current
+ * covariance.
+ *
+ * @return nonzero when the steady-state gain was used
+ */
+AA_API int rfx_lqg_kf_step_ss( rfx_lqg_t *lqg, rfx_lqg_ss_t *ss );
+
 AA_API void rfx_lqg_sys( const void *lqg,
                          double t, const double *AA_RESTRICT x,
                          double *AA_RESTRICT dx );
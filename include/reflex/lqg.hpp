@@ -0,0 +1,270 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef REFLEX_LQG_HPP
+#define REFLEX_LQG_HPP
+
+/** \file lqg.hpp
+ *
+ * Fixed-size Linear Quadratic Gaussian filter.
+ *
+ * Dimensions are template parameters, so all matrices are stored
+ * inline and every loop has a compile-time trip count.  For the small
+ * systems typical of per-joint or per-axis filtering this avoids the
+ * BLAS/LAPACK call overhead and region allocations of the generic
+ * rfx_lqg_t routines, which dominate the runtime at such sizes.
+ *
+ * Storage is column-major, matching rfx_lqg_t, and view() exposes
+ * the inline matrices through an rfx_lqg_t so the generic routines
+ * (e.g., rfx_lqg_lqr_gain()) remain usable on the same object.
+ */
+
+#include <string.h>
+#include <math.h>
+#include "reflex.h"
+
+namespace reflex {
+
+/** Fixed-size LQG filter.
+ *
+ * NX must be positive.  NU and NZ may be zero, e.g., NU = 0 for a
+ * pure estimator; the arrays of a zero dimension then hold a single
+ * unused element, since zero-length arrays are not valid C++.
+ *
+ * \tparam NX state-space size
+ * \tparam NU input-space size
+ * \tparam NZ measurement-space size
+ */
+template<size_t NX, size_t NU, size_t NZ>
+struct LQG {
+    /** Array sizes of the input and measurement dimensions, at least 1 */
+    enum { NU_STORE = NU ? NU : 1, NZ_STORE = NZ ? NZ : 1 };
+
+    double x[NX];                 ///< state estimate
+    double u[NU_STORE];           ///< input
+    double z[NZ_STORE];           ///< measurement
+    double A[NX*NX];              ///< process model
+    double B[NX*NU_STORE];        ///< input model
+    double C[NZ_STORE*NX];        ///< measurement model
+    double P[NX*NX];              ///< covariance
+    double V[NX*NX];              ///< process noise
+    double W[NZ_STORE*NZ_STORE];  ///< measurement noise
+    double S[NX*NX];              ///< covariance factor, for the square-root filter
+    double Sv[NX*NX];             ///< process noise factor, for the square-root filter
+    double Sw[NZ_STORE*NZ_STORE]; ///< measurement noise factor, for the square-root filter
+    double Q[NX*NX];              ///< state cost
+    double R[NU_STORE*NU_STORE];  ///< actuation cost
+    double K[NX*NZ_STORE];        ///< kalman gain
+    double L[NU_STORE*NX];        ///< optimal gain
+
+    /** Zero-initialize all vectors and matrices. */
+    LQG() {
+        memset( this, 0, sizeof(*this) );
+    }
+
+    /** Point an rfx_lqg_t at this object's storage.
+     *
+     * The resulting struct must not be passed to rfx_lqg_destroy().
+     */
+    void view( rfx_lqg_t *lqg ) {
+        memset( lqg, 0, sizeof(*lqg) );
+        lqg->n_x = NX; lqg->n_u = NU; lqg->n_z = NZ;
+        lqg->x = x; lqg->u = u; lqg->z = z;
+        lqg->A = A; lqg->B = B; lqg->C = C;
+        lqg->P = P; lqg->V = V; lqg->W = W;
+        lqg->S = S; lqg->Sv = Sv; lqg->Sw = Sw;
+        lqg->Q = Q; lqg->R = R;
+        lqg->K = K; lqg->L = L;
+    }
+
+    /** Discrete time Kalman filter predict step.
+     *
+     * Same semantics as rfx_lqg_kf_predict().  Only the upper
+     * triangles of P and V are read; P is written in full.
+     */
+    void kf_predict() {
+        // x = A*x + B*u
+        double xp[NX];
+        for( size_t i = 0; i < NX; i ++ ) xp[i] = 0;
+        for( size_t j = 0; j < NX; j ++ )
+            for( size_t i = 0; i < NX; i ++ )
+                xp[i] += A[j*NX+i] * x[j];
+        for( size_t j = 0; j < NU; j ++ )
+            for( size_t i = 0; i < NX; i ++ )
+                xp[i] += B[j*NX+i] * u[j];
+        for( size_t i = 0; i < NX; i ++ ) x[i] = xp[i];
+
+        // T := A*P
+        double T[NX*NX];
+        sym_right( NX, P, A, T );
+
+        // P := T * A**T + V
+        for( size_t j = 0; j < NX; j ++ ) {
+            for( size_t i = 0; i <= j; i ++ ) {
+                double s = V[j*NX+i];
+                for( size_t k = 0; k < NX; k ++ )
+                    s += T[k*NX+i] * A[k*NX+j];
+                P[j*NX+i] = s;
+                P[i*NX+j] = s;
+            }
+        }
+    }
+
+    /** Discrete time Kalman filter correct step.
+     *
+     * Same semantics as rfx_lqg_kf_correct().  Only the upper
+     * triangles of P and W are read; P is written in full.
+     *
+     * \return 0 on success, nonzero if the innovation covariance is
+     *   not positive definite, in which case x and P are unchanged.
+     */
+    int kf_correct() {
+        // CP := C*P, size NZ*NX
+        double CP[NZ_STORE*NX];
+        sym_right( NZ, P, C, CP );
+
+        // Sz := C*P*C**T + W, upper triangle
+        double Sz[NZ_STORE*NZ_STORE];
+        for( size_t j = 0; j < NZ; j ++ ) {
+            for( size_t i = 0; i <= j; i ++ ) {
+                double s = W[j*NZ+i];
+                for( size_t k = 0; k < NX; k ++ )
+                    s += CP[k*NZ+i] * C[k*NZ+j];
+                Sz[j*NZ+i] = s;
+            }
+        }
+
+        // Sz := U where U**T * U = Sz
+        for( size_t j = 0; j < NZ; j ++ ) {
+            double d = Sz[j*NZ+j];
+            for( size_t k = 0; k < j; k ++ )
+                d -= Sz[j*NZ+k] * Sz[j*NZ+k];
+            if( ! (d > 0) ) return -1;
+            d = sqrt(d);
+            Sz[j*NZ+j] = d;
+            for( size_t i = j+1; i < NZ; i ++ ) {
+                double s = Sz[i*NZ+j];
+                for( size_t k = 0; k < j; k ++ )
+                    s -= Sz[j*NZ+k] * Sz[i*NZ+k];
+                Sz[i*NZ+j] = s / d;
+            }
+        }
+
+        // CP := Sz**-1 * CP, so that K = CP**T
+        for( size_t c = 0; c < NX; c ++ ) {
+            double *b = &CP[c*NZ];
+            // U**T * y = b
+            for( size_t i = 0; i < NZ; i ++ ) {
+                double s = b[i];
+                for( size_t k = 0; k < i; k ++ )
+                    s -= Sz[i*NZ+k] * b[k];
+                b[i] = s / Sz[i*NZ+i];
+            }
+            // U * b = y
+            for( size_t ii = NZ; ii > 0; ii -- ) {
+                size_t i = ii - 1;
+                double s = b[i];
+                for( size_t k = i+1; k < NZ; k ++ )
+                    s -= Sz[k*NZ+i] * b[k];
+                b[i] = s / Sz[i*NZ+i];
+            }
+        }
+        for( size_t j = 0; j < NZ; j ++ )
+            for( size_t i = 0; i < NX; i ++ )
+                K[j*NX+i] = CP[i*NZ+j];
+
+        // x := x + K * (z - C*x)
+        double r[NZ_STORE];
+        for( size_t i = 0; i < NZ; i ++ ) r[i] = z[i];
+        for( size_t j = 0; j < NX; j ++ )
+            for( size_t i = 0; i < NZ; i ++ )
+                r[i] -= C[j*NZ+i] * x[j];
+        for( size_t j = 0; j < NZ; j ++ )
+            for( size_t i = 0; i < NX; i ++ )
+                x[i] += K[j*NX+i] * r[j];
+
+        // KC := I - K*C
+        double KC[NX*NX];
+        for( size_t j = 0; j < NX; j ++ ) {
+            for( size_t i = 0; i < NX; i ++ ) {
+                double s = (i == j) ? 1.0 : 0.0;
+                for( size_t k = 0; k < NZ; k ++ )
+                    s -= K[k*NX+i] * C[j*NZ+k];
+                KC[j*NX+i] = s;
+            }
+        }
+
+        // P := (I - K*C) * P
+        double P1[NX*NX];
+        sym_right( NX, P, KC, P1 );
+        for( size_t j = 0; j < NX; j ++ ) {
+            for( size_t i = 0; i <= j; i ++ ) {
+                P[j*NX+i] = P1[j*NX+i];
+                P[i*NX+j] = P1[j*NX+i];
+            }
+        }
+        return 0;
+    }
+
+private:
+    /* Fails to compile for NX == 0 */
+    typedef char nx_positive[NX ? 1 : -1];
+
+    /* Y := X * P, where X is m*NX and only the upper triangle of the
+     * symmetric NX*NX matrix P is referenced. */
+    static void sym_right( size_t m, const double *Ps, const double *X, double *Y ) {
+        for( size_t j = 0; j < NX; j ++ ) {
+            for( size_t i = 0; i < m; i ++ ) {
+                double s = 0;
+                for( size_t k = 0; k < NX; k ++ ) {
+                    double p = (k <= j) ? Ps[j*NX+k] : Ps[k*NX+j];
+                    s += X[k*m+i] * p;
+                }
+                Y[j*m+i] = s;
+            }
+        }
+    }
+};
+
+}
+
+#endif //REFLEX_LQG_HPP
@@ -0,0 +1,142 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef REFLEX_LQG_BANK_H
+#define REFLEX_LQG_BANK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file lqg_bank.h
+ *
+ * Bank of independent, identically structured Kalman filters.
+ *
+ * All filters share the model matrices A, B, C, V, W.  The per-filter
+ * vectors and matrices are interleaved (structure-of-arrays): element
+ * k of filter i is stored at X[k*ld + i].  Kernels loop over filters
+ * in the innermost dimension, so each arithmetic operation runs
+ * across a block of filters in SIMD lanes, and blocks are distributed
+ * over a thread pool.
+ *
+ * Filters with different models go in separate banks.
+ */
+
+/** Lanes processed together by the bank kernels. */
+#define RFX_LQG_BANK_BLOCK 8
+
+/** Reference element k of filter i in interleaved array X. */
+#define RFX_LQG_BANK_REF(bank, X, k, i) ((X)[(k)*(bank)->ld + (i)])
+
+/** Kalman filter bank. */
+typedef struct rfx_lqg_bank {
+    size_t n;       ///< number of filters
+    size_t ld;      ///< interleave stride, n rounded up to RFX_LQG_BANK_BLOCK
+    size_t n_x;     ///< state size
+    size_t n_u;     ///< input size
+    size_t n_z;     ///< measurement size
+
+    double *A;      ///< shared process model, n_x*n_x
+    double *B;      ///< shared input model, n_x*n_u
+    double *C;      ///< shared measurement model, n_z*n_x
+    double *V;      ///< shared process noise, n_x*n_x
+    double *W;      ///< shared measurement noise, n_z*n_z
+
+    double *x;      ///< interleaved states, n_x*ld
+    double *u;      ///< interleaved inputs, n_u*ld
+    double *z;      ///< interleaved measurements, n_z*ld
+    double *P;      ///< interleaved covariances, n_x*n_x*ld
+    double *K;      ///< interleaved kalman gains, n_x*n_z*ld
+} rfx_lqg_bank_t;
+
+/** Allocate a bank of n filters.
+ *
+ * Models and states are zeroed and covariances set to identity.
+ *
+ * @return 0 on success, nonzero on allocation failure
+ */
+AA_API int rfx_lqg_bank_init( rfx_lqg_bank_t *bank, size_t n,
+                              size_t n_x, size_t n_u, size_t n_z );
+
+/** Free a bank. */
+AA_API void rfx_lqg_bank_destroy( rfx_lqg_bank_t *bank );
+
+/** Set state and (if non-NULL) full n_x*n_x covariance of filter i. */
+AA_API void rfx_lqg_bank_set( rfx_lqg_bank_t *bank, size_t i,
+                              const double *x, const double *P );
+
+/** Get state and (if non-NULL) full n_x*n_x covariance of filter i. */
+AA_API void rfx_lqg_bank_get( const rfx_lqg_bank_t *bank, size_t i,
+                              double *x, double *P );
+
+/** Set input of filter i. */
+AA_API void rfx_lqg_bank_set_u( rfx_lqg_bank_t *bank, size_t i, const double *u );
+
+/** Set measurement of filter i. */
+AA_API void rfx_lqg_bank_set_z( rfx_lqg_bank_t *bank, size_t i, const double *z );
+
+/** Predict step for every filter.
+ *
+ * Per filter, equivalent to rfx_lqg_kf_predict().
+ *
+ * @param pool thread pool, or NULL to run in the caller
+ */
+AA_API void rfx_lqg_bank_predict( rfx_lqg_bank_t *bank, rfx_tpool_t *pool );
+
+/** Correct step for filters with a measurement.
+ *
+ * Per filter, equivalent to rfx_lqg_kf_correct().  Filters whose
+ * mask entry is zero, or whose innovation covariance is not positive
+ * definite, keep their state, covariance, and gain.
+ *
+ * @param mask per-filter measurement flags, size n, or NULL for all
+ * @param pool thread pool, or NULL to run in the caller
+ * @return number of masked-in filters with an indefinite innovation covariance
+ */
+AA_API size_t rfx_lqg_bank_correct( rfx_lqg_bank_t *bank, const uint8_t *mask,
+                                    rfx_tpool_t *pool );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //REFLEX_LQG_BANK_H
@@ -0,0 +1,138 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef REFLEX_OSC_H
+#define REFLEX_OSC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file osc.h
+ *
+ * Operational-space impedance control, producing joint torques.
+ *
+ * \f[ \tau = \tau_0 + J^T \Lambda (a - J M^{-1} \tau_0) + J^T F_c + g \f]
+ *
+ * where
+ * - \f$ \Lambda = (J M^{-1} J^T)^{-1} \f$ is the task-space inertia,
+ * - \f$ a = -k_p x_e - k_d (J\dot{q} - \dot{x}_r) \f$ is the task acceleration,
+ * - \f$ F_c = F_r - k_f (F - F_r) \f$ is the commanded wrench,
+ * - \f$ \tau_0 = -M (k_q (q - q_r) + k_{dq} \dot{q}) \f$ is the jointspace impedance,
+ * - \f$ g \f$ is the gravity torque.
+ *
+ * This is the usual \f$ J^T \Lambda a + N^T \tau_0 \f$ with the
+ * dynamically consistent null-space projector
+ * \f$ N^T = I - J^T \Lambda J M^{-1} \f$ folded in, so the task and
+ * null-space terms share one solve against the factored
+ * \f$ \Lambda^{-1} \f$.
+ */
+
+/** Function to compute the joint-space mass matrix and gravity torque.
+ *
+ * @param cx context struct
+ * @param q joint configuration
+ * @param M mass matrix, n_q*n_q, column major
+ * @param g gravity torque, n_q
+ */
+typedef int (*rfx_kin_mass_fun) ( const void *cx, const double *q, double *M, double *g );
+
+/** Gains for operational-space control.
+ */
+typedef struct {
+    size_t n_q;
+    double p[6];   ///< workspace stiffness
+    double d[6];   ///< workspace damping
+    double f[6];   ///< force error gains
+    double *q;     ///< jointspace stiffness, for the null-space
+    double *dq;    ///< jointspace damping, for the null-space
+    double dls;    ///< damping added to the inverse task inertia (default 1e-6)
+} rfx_ctrl_osc_k_t;
+
+/// initialize
+AA_API void rfx_ctrl_osc_k_init( rfx_ctrl_osc_k_t *k, size_t n_q );
+/// destroy
+AA_API void rfx_ctrl_osc_k_destroy( rfx_ctrl_osc_k_t *k );
+
+/** Operational-space controller model and scratch space.
+ */
+typedef struct rfx_ctrl_osc {
+    size_t n_q;                ///< size of config space
+    rfx_kin_mass_fun mass_fun; ///< computes M and g
+    void *mass_cx;             ///< context for mass_fun
+    double *M;       ///< mass matrix, overwritten by its Cholesky factor, n_q*n_q
+    double *g;       ///< gravity torque, n_q
+    double *Y;       ///< M^-1 * J^T, n_q*6
+    double *L;       ///< Cholesky factor of the inverse task inertia, 6*6
+    double *tau0;    ///< null-space torque, n_q
+} rfx_ctrl_osc_t;
+
+/** Initialize the operational-space controller.
+ *  Malloc's arrays for each field
+ */
+AA_API void rfx_ctrl_osc_init( rfx_ctrl_osc_t *o, size_t n_q, rfx_kin_mass_fun mass_fun, void *mass_cx );
+
+/** Free the arrays of the operational-space controller */
+AA_API void rfx_ctrl_osc_destroy( rfx_ctrl_osc_t *o );
+
+/** Operational-space impedance control.
+ *
+ * Uses the act and ref state, jacobian, and limits of ws.  When a
+ * limit is violated, tau is gravity compensation plus joint damping
+ * so the arm holds rather than falling, and the limit status is
+ * returned.
+ *
+ * Performs no heap, region, or stack (VLA) allocation.
+ *
+ * \param ws The state and reference values
+ * \param k The gains
+ * \param o model and scratch space
+ * \param tau The joint torque to command, \f$ \tau \in \Re^{n_q} \f$
+ */
+AA_API rfx_status_t rfx_ctrl_ws_osc( const rfx_ctrl_ws_t *ws, const rfx_ctrl_osc_k_t *k,
+                                     rfx_ctrl_osc_t *o, double *tau );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //REFLEX_OSC_H
@@ -0,0 +1,149 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef REFLEX_QP_H
+#define REFLEX_QP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file qp.h
+ *
+ * Workspace velocity control as a bound-constrained quadratic program.
+ *
+ * Instead of stopping at a joint limit, the controller solves
+ *
+ * \f[ \min_u \frac{1}{2} \| J u - \dot{x}_u \|^2 + \frac{w}{2} \| u - \dot{q}_r \|^2 \f]
+ * \f[ \mathrm{s.t.}\ u_{min} \leq u \leq u_{max} \f]
+ *
+ * where \f$\dot{x}_u\f$ is the linear workspace control law of
+ * rfx_ctrl_ws_lin_vfwd(), \f$\dot{q}_r\f$ the jointspace posture
+ * velocity, and the bounds combine the joint position, velocity, and
+ * acceleration limits over one control period.
+ *
+ * The QP is solved with a primal active-set method, warm started
+ * from the previous solution and active set.  Every iterate is
+ * feasible, so the iteration count may be capped for a fixed
+ * worst-case time, returning the best feasible point found.
+ */
+
+/** Bound-constrained velocity controller state and scratch space.
+ */
+typedef struct rfx_ctrl_qp {
+    size_t n_q;       ///< size of config space
+    double dt;        ///< control period
+    double w;         ///< weight of the posture term, must be > 0 (default 1e-3)
+    double *dq_max;   ///< maximum joint speed (<=0 to ignore)
+    double *ddq_max;  ///< maximum joint acceleration (<=0 to ignore)
+    size_t max_iter;  ///< maximum active-set iterations (default 3*n_q)
+    size_t iter;      ///< iterations used by the last call
+
+    // scratch space
+    double *H;        ///< hessian, n_q*n_q
+    double *L;        ///< factor of free hessian block, n_q*n_q
+    double *g;        ///< gradient, n_q
+    double *lo;       ///< lower bound, n_q
+    double *hi;       ///< upper bound, n_q
+    double *x;        ///< last solution, n_q
+    double *p;        ///< free subproblem solution, n_q
+    size_t *free;     ///< indices of free variables, n_q
+    signed char *state; ///< -1 at lower bound, 1 at upper bound, 0 free
+} rfx_ctrl_qp_t;
+
+/** Initialize the QP controller.
+ *
+ * Velocity and acceleration limits start at zero (ignored).
+ */
+AA_API void rfx_ctrl_qp_init( rfx_ctrl_qp_t *qp, size_t n_q, double dt );
+
+/** Free the arrays of the QP controller */
+AA_API void rfx_ctrl_qp_destroy( rfx_ctrl_qp_t *qp );
+
+/** Forget the warm start. */
+AA_API void rfx_ctrl_qp_reset( rfx_ctrl_qp_t *qp );
+
+/** Solve a bound-constrained QP with a primal active-set method.
+ *
+ * \f[ \min_x \frac{1}{2} x^T H x + g^T x \quad \mathrm{s.t.}\ lo \leq x \leq hi \f]
+ *
+ * Uses qp->L, qp->p, qp->free, and qp->state as scratch, and
+ * qp->state and x as the warm start.
+ *
+ * \param qp scratch space and iteration limit
+ * \param H positive definite hessian, n_q*n_q
+ * \param g gradient, n_q
+ * \param lo lower bound, n_q
+ * \param hi upper bound, n_q
+ * \param x initial guess on entry, solution on exit
+ * \returns 0 on convergence, 1 if the iteration limit was reached
+ *          with x feasible, -1 if a subproblem could not be factored
+ */
+AA_API int rfx_ctrl_qp_box( rfx_ctrl_qp_t *qp, const double *H, const double *g,
+                            const double *lo, const double *hi, double *x );
+
+/** Linear Workspace Control with hard joint limits.
+ *
+ * Tracks the same workspace velocity as rfx_ctrl_ws_lin_vfwd(), but
+ * enforces q_min and q_max of ws, and the velocity and acceleration
+ * limits of qp, as bounds on u.  Joint limits no longer stop the
+ * arm; it slides along the constraint.  Other limits of ws still
+ * return their status and zero u.
+ *
+ * When bounds conflict, velocity limits take precedence over
+ * position limits, which take precedence over acceleration limits.
+ *
+ * Performs no heap, region, or stack (VLA) allocation.
+ *
+ * \param ws The state and reference values
+ * \param k The gains
+ * \param qp limits, warm start, and scratch space
+ * \param u The configuration velocity to command, \f$ u \in \Re^{n_q} \f$
+ */
+AA_API rfx_status_t rfx_ctrl_ws_lin_vfwd_qp( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k,
+                                             rfx_ctrl_qp_t *qp, double *u );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //REFLEX_QP_H
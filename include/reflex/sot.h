@@ -0,0 +1,245 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef REFLEX_SOT_H
+#define REFLEX_SOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file sot.h
+ *
+ * Prioritized stack-of-tasks velocity control.
+ *
+ * Each task i has a jacobian \f$J_i\f$ and a desired task velocity
+ * \f$\dot{x}_i\f$.  Tasks are solved in order of priority by
+ * recursive null-space projection:
+ *
+ * \f[ \tilde{J}_i = J_i N_{i-1} \f]
+ * \f[ \dot{q}_i = \dot{q}_{i-1} + \tilde{J}_i^* (\dot{x}_i - J_i \dot{q}_{i-1}) \f]
+ * \f[ N_i = N_{i-1} - \tilde{J}_i^* \tilde{J}_i \f]
+ *
+ * where \f$N_0 = I\f$ and \f$\tilde{J}_i^*\f$ is the damped
+ * least-squares inverse.  Tasks with equal priority are stacked into
+ * one level.  Each level does a single Cholesky factorization of
+ * \f$\tilde{J}_i \tilde{J}_i^T + \lambda I\f$ that is shared by the
+ * velocity and projector updates.
+ */
+
+/** Kinds of tasks */
+typedef enum rfx_sot_task_type {
+    RFX_SOT_POSE = 0,        ///< 6D pose, rows 0-5 of a workspace jacobian
+    RFX_SOT_POSITION = 1,    ///< 3D position, rows 0-2 of a workspace jacobian
+    RFX_SOT_ORIENTATION = 2, ///< 3D orientation, rows 3-5 of a workspace jacobian
+    RFX_SOT_COM = 3,         ///< 3D center of mass, 3*n_q jacobian
+    RFX_SOT_JOINT_LIMIT = 4, ///< push joints away from limits, one row per joint near a limit
+    RFX_SOT_POSTURE = 5,     ///< jointspace posture, identity jacobian
+    RFX_SOT_GENERIC = 6      ///< user supplied jacobian and velocity
+} rfx_sot_task_type_t;
+
+/** A single task in the stack. */
+typedef struct rfx_sot_task {
+    rfx_sot_task_type_t type;
+    int priority;    ///< smaller values have higher priority
+    size_t n_q;      ///< size of config space
+    size_t m_max;    ///< maximum number of rows
+    size_t m;        ///< number of rows for the current cycle
+    double *J;       ///< task jacobian, m*n_q, column major with leading dimension m
+    double *dx;      ///< desired task velocity, size m
+    double dls;      ///< damped least squares k, added to J*J^T (default 1e-3)
+} rfx_sot_task_t;
+
+/** Stack of tasks controller.
+ */
+typedef struct rfx_sot {
+    size_t n_q;            ///< size of config space
+    size_t n_task;         ///< number of tasks
+    rfx_sot_task_t *task;  ///< tasks, size n_task
+    size_t *order;         ///< task indices sorted by priority, size n_task
+    size_t n_level;        ///< number of levels solved on the last call
+
+    // scratch space, sized by rfx_sot_work_init()
+    size_t m_max;    ///< maximum rows of a level
+    double *N;       ///< null-space projector, upper triangle, n_q*n_q
+    double *Jt;      ///< projected level jacobian with residual column, m_max*(n_q+1)
+    double *C;       ///< Cholesky factor of Jt*Jt^T + dls*I, m_max*m_max
+} rfx_sot_t;
+
+/** Initialize the stack of tasks.
+ *
+ * Allocates n_task tasks.  Initialize each with rfx_sot_task_init(),
+ * then call rfx_sot_work_init().
+ */
+AA_API void rfx_sot_init( rfx_sot_t *sot, size_t n_q, size_t n_task );
+
+/** Initialize task i of the stack.
+ *
+ * \param sot the stack
+ * \param i index of the task
+ * \param type kind of task
+ * \param priority smaller values are solved first, equal values are stacked
+ * \param m rows for RFX_SOT_GENERIC and RFX_SOT_COM, ignored otherwise
+ * \returns the task
+ */
+AA_API rfx_sot_task_t *rfx_sot_task_init( rfx_sot_t *sot, size_t i, rfx_sot_task_type_t type,
+                                          int priority, size_t m );
+
+/** Order tasks by priority and allocate scratch space.
+ *
+ * Call after all tasks are initialized and whenever priorities change.
+ */
+AA_API void rfx_sot_work_init( rfx_sot_t *sot );
+
+/** Free all arrays of the stack. */
+AA_API void rfx_sot_destroy( rfx_sot_t *sot );
+
+/** Copy a task jacobian.
+ *
+ * Copies the rows of J that correspond to the task type into the
+ * task jacobian.  Column j of J is placed in joint idx[j] of the
+ * stack; all other columns of the task jacobian are zero.
+ *
+ * \param t the task
+ * \param n_j number of columns in J
+ * \param idx stack joint index of each column of J, or NULL for 0..n_j-1
+ * \param J jacobian, 6*n_j for pose, position, and orientation
+ *        tasks, m*n_j otherwise
+ * \param ldJ leading dimension of J
+ */
+AA_API void rfx_sot_task_jac( rfx_sot_task_t *t, size_t n_j, const size_t *idx,
+                              const double *J, size_t ldJ );
+
+/** Set desired velocity of a pose task.
+ *
+ * \f[ \dot{x} = \dot{x}_r - k (x - x_r) \f]
+ *
+ * \param t the task
+ * \param S actual pose dual quaternion
+ * \param S_r reference pose dual quaternion
+ * \param dx_r reference velocity, or NULL for zero
+ * \param k position error gains, size 6
+ */
+AA_API void rfx_sot_task_pose( rfx_sot_task_t *t, const double S[8], const double S_r[8],
+                               const double dx_r[6], const double k[6] );
+
+/** Set desired velocity of a position or center of mass task.
+ *
+ * \param t the task
+ * \param x actual position
+ * \param x_r reference position
+ * \param dx_r reference velocity, or NULL for zero
+ * \param k position error gains, size 3
+ */
+AA_API void rfx_sot_task_position( rfx_sot_task_t *t, const double x[3], const double x_r[3],
+                                   const double dx_r[3], const double k[3] );
+
+/** Set desired velocity of an orientation task.
+ *
+ * \param t the task
+ * \param r actual orientation quaternion
+ * \param r_r reference orientation quaternion
+ * \param w_r reference rotational velocity, or NULL for zero
+ * \param k orientation error gains, size 3
+ */
+AA_API void rfx_sot_task_orientation( rfx_sot_task_t *t, const double r[4], const double r_r[4],
+                                      const double w_r[3], const double k[3] );
+
+/** Set jacobian and desired velocity of a joint limit task.
+ *
+ * Adds one row for each joint within margin of a limit, driving
+ * that joint back toward the margin at rate k.  Joints away from
+ * their limits add no rows.
+ *
+ * \param t the task
+ * \param q actual configuration, size n_q
+ * \param q_min minimum joint values, size n_q
+ * \param q_max maximum joint values, size n_q
+ * \param margin distance from a limit where the task becomes active
+ * \param k gain
+ */
+AA_API void rfx_sot_task_jlimit( rfx_sot_task_t *t, const double *q,
+                                 const double *q_min, const double *q_max,
+                                 double margin, double k );
+
+/** Set jacobian and desired velocity of a posture task.
+ *
+ * \f[ \dot{q} = -k (q - q_r) \f]
+ *
+ * \param t the task
+ * \param q actual configuration, size n_q
+ * \param q_r reference configuration, size n_q
+ * \param k gains, size n_q
+ */
+AA_API void rfx_sot_task_posture( rfx_sot_task_t *t, const double *q, const double *q_r,
+                                  const double *k );
+
+/** Set a pose task from a workspace controller.
+ *
+ * Uses the jacobian, state, reference, gains, and limits of ws.
+ *
+ * \param t the task, of type RFX_SOT_POSE
+ * \param ws the workspace controller
+ * \param k the workspace controller gains
+ * \param idx stack joint index of each joint of ws, or NULL for 0..ws->n_q-1
+ * \returns the limit status of the workspace controller
+ */
+AA_API rfx_status_t rfx_sot_task_ctrl( rfx_sot_task_t *t, const rfx_ctrl_ws_t *ws,
+                                       const rfx_ctrl_ws_lin_k_t *k, const size_t *idx );
+
+/** Solve the stack of tasks.
+ *
+ * Performs no heap, region, or stack (VLA) allocation.
+ *
+ * \param sot the stack, with each task's J and dx set for this cycle
+ * \param u The configuration velocity to command, \f$ u \in \Re^{n_q} \f$
+ * \returns RFX_OK, or RFX_INVAL if a level could not be factored, in
+ *          which case u contains the solution of the higher priority
+ *          levels
+ */
+AA_API rfx_status_t rfx_sot_vfwd( rfx_sot_t *sot, double *u );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //REFLEX_SOT_H
@@ -136,12 +136,25 @@ enum rfx_tf_cor_opts {
     RFX_TF_COR_O_TRANS_MEAN = 0x2,
     RFX_TF_COR_O_ROT_UMEYAMA = 0x4,
     RFX_TF_COR_O_ROT_DAVENPORT = 0x8,
-    RFX_TF_COR_O_ROT_MEDIAN = 0x10
+    RFX_TF_COR_O_ROT_MEDIAN = 0x10,
+    /** Rotation median with rfx_tf_qangmedian_blocked() */
+    RFX_TF_COR_O_ROT_MEDIAN_BLOCKED = 0x20,
+    /** Approximate rotation median with rfx_tf_qwmedian() */
+    RFX_TF_COR_O_ROT_MEDIAN_WEISZFELD = 0x40,
+    /** Fit only the LMedS inliers, see rfx_tf_cor_ransac() */
+    RFX_TF_COR_O_RANSAC = 0x80
 };
 
 /**
  * Compute fit between corresponding transforms
  *
+ * At most one rotation median is computed.  If several median flags
+ * are set, RFX_TF_COR_O_ROT_MEDIAN_WEISZFELD takes precedence over
+ * RFX_TF_COR_O_ROT_MEDIAN_BLOCKED, which takes precedence over
+ * RFX_TF_COR_O_ROT_MEDIAN.
+ *
+ * Runs serially; see rfx_tf_cor_pool() to use threads.
+ *
  * @param[in] opts type of fit to perform (bitmask of enum rfx_tf_cor_opts)
  * @param[in] qx quaternion array 0
  * @param[in] ldqx leading dimensions of qx
@@ -161,6 +174,162 @@ void rfx_tf_cor( int opts, size_t n,
                  const double *vy, size_t ldvy,
                  double *Z );
 
+/**
+ * rfx_tf_cor() using the given thread pool.
+ *
+ * @param pool thread pool for RFX_TF_COR_O_ROT_MEDIAN_BLOCKED and
+ *   RFX_TF_COR_O_RANSAC, or NULL to run serially
+ */
+void rfx_tf_cor_pool( int opts, rfx_tpool_t *pool, size_t n,
+                      const double *qx, size_t ldqx,
+                      const double *vx, size_t ldvx,
+                      const double *qy, size_t ldqy,
+                      const double *vy, size_t ldvy,
+                      double *Z );
+
+/**
+ * Robust fit between corresponding transforms by random sampling.
+ *
+ * Draws minimal subsets of three translation pairs, solves each with
+ * rfx_tf_numeyama(), and scores the hypothesis over all samples by
+ * translation residual.  With a positive threshold, the score is the
+ * number of residuals within threshold (RANSAC).  Otherwise it is
+ * the median squared residual (LMedS), and inliers are those within
+ * 2.5 robust standard deviations.  Sampling stops once enough subsets
+ * have been drawn to find an all-inlier subset with the given
+ * confidence.  The inliers of the best hypothesis are then refit
+ * with rfx_tf_cor().
+ *
+ * With RFX_TF_COR_O_RANSAC, rfx_tf_cor() calls this with LMedS scoring.
+ *
+ * @param[in] opts type of refit to perform (bitmask of enum rfx_tf_cor_opts)
+ * @param[in] pool thread pool for scoring, or NULL to run serially
+ * @param[in] threshold inlier distance, or 0 for LMedS
+ * @param[in] confidence probability of drawing an all-inlier subset
+ * @param[in] max_iter maximum number of subsets
+ * @param[out] inlier inlier mask, n entries, may be NULL
+ * @param[out] Z output transform (quaternion, translation)
+ * @return number of inliers
+ */
+size_t rfx_tf_cor_ransac( int opts, rfx_tpool_t *pool, size_t n,
+                          const double *qx, size_t ldqx,
+                          const double *vx, size_t ldvx,
+                          const double *qy, size_t ldqy,
+                          const double *vy, size_t ldvy,
+                          double threshold, double confidence, size_t max_iter,
+                          uint8_t *inlier, double *Z );
+
+/**
+ * Fit a camera registration and per-marker offsets.
+ *
+ * Each sample relates a kinematic pose X of a marker mount to the
+ * camera pose Y of the marker, with an unknown offset per marker:
+ *
+ *     X * off[marker] = Z * Y
+ *
+ * Alternates between fitting Z with rfx_tf_cor() given the offsets,
+ * and fitting each offset given Z.  The per-marker fits are
+ * independent and run in parallel on the thread pool.  Iteration
+ * stops after max_iter rounds, or once Z changes by less than tol in
+ * both rotation angle and translation.
+ *
+ * @param[in] opts type of fit to perform (bitmask of enum rfx_tf_cor_opts)
+ * @param[in] pool thread pool, or NULL to run serially
+ * @param[in] n number of samples
+ * @param[in] X kinematic poses (quaternion, translation)
+ * @param[in] ldx leading dimension of X
+ * @param[in] Y camera poses (quaternion, translation)
+ * @param[in] ldy leading dimension of Y
+ * @param[in] n_marker number of markers
+ * @param[in] marker marker index of each sample, in [0,n_marker)
+ * @param[in] max_iter maximum number of rounds
+ * @param[in] tol convergence tolerance on the change in Z
+ * @param[out] Z camera registration
+ * @param[out] off marker offsets, 7 x n_marker, may be NULL
+ * @return number of rounds performed, or -1 on allocation failure
+ */
+ssize_t rfx_tf_cor_em( int opts, rfx_tpool_t *pool, size_t n,
+                       const double *X, size_t ldx,
+                       const double *Y, size_t ldy,
+                       size_t n_marker, const size_t *marker,
+                       size_t max_iter, double tol,
+                       double Z[7], double *off );
+
+/**
+ * Streaming fit between corresponding transforms.
+ *
+ * Keeps running sums for the Umeyama and Davenport rotation fits and
+ * a fixed histogram of translation residuals, so that samples are
+ * added and removed in constant time and memory is independent of
+ * the number of samples.  Removing the last sample resets the fit.
+ */
+typedef struct rfx_tf_cor_stream {
+    int opts;           ///< bitmask of enum rfx_tf_cor_opts
+    size_t n;           ///< samples in the fit
+    double x0[3];       ///< translation x of the anchor sample
+    double y0[3];       ///< translation y of the anchor sample
+    double sum_x[3];    ///< sum of x - x0
+    double sum_y[3];    ///< sum of y - y0
+    double sum_yx[9];   ///< sum of (y-y0)*(x-x0)**T
+    double K[16];       ///< sum of q*q**T over relative rotations
+
+    size_t n_bin;       ///< histogram bins per axis
+    double bin_width;   ///< histogram bin width
+    double lo[3];       ///< lower histogram edge per axis
+    double R_ref[9];    ///< rotation of the histogram residuals
+    size_t *hist;       ///< counts, 3 x (n_bin+2) with under/overflow
+
+    size_t n_warm;      ///< samples buffered before binning
+    size_t n_warm_used; ///< samples in the buffer
+    double *warm;       ///< buffered samples, 14 x n_warm
+    int anchored;       ///< histogram in use, buffer binned
+} rfx_tf_cor_stream_t;
+
+/**
+ * Initialize a streaming correspondence fit.
+ *
+ * The first n_warm samples are kept and give an exact translation
+ * median.  After that, the translation median is resolved to
+ * bin_width over a range of n_bin*bin_width centered on the median of
+ * the first n_warm samples.  Residuals outside that range saturate at
+ * the edges.
+ *
+ * @param opts type of fit, as for rfx_tf_cor().  The median rotation
+ *   fits have no streaming form and use Davenport instead.
+ * @param n_bin histogram bins per translation axis
+ * @param bin_width histogram resolution
+ * @param n_warm samples buffered before switching to the histogram
+ */
+int rfx_tf_cor_stream_init
+( rfx_tf_cor_stream_t *s, int opts,
+  size_t n_bin, double bin_width, size_t n_warm );
+
+/** Free streaming fit storage. */
+void rfx_tf_cor_stream_destroy( rfx_tf_cor_stream_t *s );
+
+/** Add a correspondence to the streaming fit. */
+void rfx_tf_cor_stream_add
+( rfx_tf_cor_stream_t *s,
+  const double qx[4], const double vx[3],
+  const double qy[4], const double vy[3] );
+
+/**
+ * Remove a previously added correspondence from the streaming fit.
+ *
+ * The arguments must be those of an earlier rfx_tf_cor_stream_add().
+ */
+void rfx_tf_cor_stream_remove
+( rfx_tf_cor_stream_t *s,
+  const double qx[4], const double vx[3],
+  const double qy[4], const double vy[3] );
+
+/**
+ * Compute the current fit, as rfx_tf_cor() would on the samples.
+ *
+ * @param[out] Z output transform (quaternion, translation)
+ * @return 0 on success, nonzero if there are no samples
+ */
+int rfx_tf_cor_stream_fit( const rfx_tf_cor_stream_t *s, double Z[7] );
 
 struct rfx_tf_filter {
     rfx_tf_dx X;  ///< state
@@ -238,6 +407,97 @@ int rfx_lqg_qutr_correct
   const double *E_obs,
   double *P, const double *W );
 
+/**
+ * Unscented Kalman filter prediction step for quaternion-translation pose
+ *
+ * Drop-in for rfx_lqg_qutr_predict(), with the same state and
+ * covariance layout.  The 27 sigma points are generated in the
+ * tangent space of the pose and propagated with the
+ * aa_tf_qutr_svel() model in a single batch.  Uses no heap or
+ * region allocation.
+ *
+ * @param dt time step
+ * @param E pose (quaternion, translation)
+ * @param dE velocity (translational, rotational)
+ * @param P covariance (13x13)
+ * @param V process noise (13x13)
+ * @return 0 on success, nonzero if P could not be factored
+ */
+int rfx_lqg_qutr_ukf_predict
+( double dt, double *E, double *dE, double *P, const double *V );
+
+/**
+ * Unscented Kalman filter correction step for quaternion-translation pose
+ *
+ * Drop-in for rfx_lqg_qutr_correct().  The innovation uses the same
+ * quaternion-derivative coordinates as rfx_lqg_qutr_innovate().
+ *
+ * @param dt time step (unused, for signature compatibility)
+ * @param E_est pose estimate
+ * @param dE_est velocity estimate
+ * @param E_obs pose measurement
+ * @param P covariance (13x13)
+ * @param W measurement noise (7x7)
+ * @return 0 on success, nonzero if P or the innovation covariance
+ *   could not be factored
+ */
+int rfx_lqg_qutr_ukf_correct
+( double dt, double *E_est, double *dE_est,
+  const double *E_obs,
+  double *P, const double *W );
+
+/**
+ * Process noise for the error-state pose filter.
+ *
+ * White acceleration on the translation and rotation, giving the
+ * usual dt^3/3, dt^2/2, dt blocks for each position-velocity pair.
+ *
+ * @param dt time step
+ * @param dx translational acceleration spectral density
+ * @param dtheta rotational acceleration spectral density
+ * @param V process noise (12x12)
+ */
+void rfx_lqg_qutr_eskf_process_noise
+( double dt, double dx, double dtheta, double *V );
+
+/**
+ * Error-state Kalman filter prediction step for quaternion-translation pose
+ *
+ * Same entry point as rfx_lqg_qutr_predict(), but the covariance is
+ * over the 12-element error state [dtheta, dp, dv, domega], with
+ * the rotation error in the tangent space: q = exp(dtheta/2) * q_est.
+ *
+ * @param dt time step
+ * @param E pose (quaternion, translation)
+ * @param dE velocity (translational, rotational)
+ * @param P error covariance (12x12)
+ * @param V process noise (12x12)
+ */
+int rfx_lqg_qutr_eskf_predict
+( double dt, double *E, double *dE, double *P, const double *V );
+
+/**
+ * Error-state Kalman filter correction step for quaternion-translation pose
+ *
+ * The residual is the rotation vector and translation from the
+ * estimate to the observation.  The estimated error is injected into
+ * E_est and dE_est and the covariance is reset to the new nominal
+ * rotation.
+ *
+ * @param dt time step (unused, for signature compatibility)
+ * @param E_est pose estimate
+ * @param dE_est velocity estimate
+ * @param E_obs pose measurement
+ * @param P error covariance (12x12)
+ * @param W measurement noise (6x6), rotation vector then translation
+ * @return 0 on success, nonzero if the innovation covariance is not
+ *   positive definite
+ */
+int rfx_lqg_qutr_eskf_correct
+( double dt, double *E_est, double *dE_est,
+  const double *E_obs,
+  double *P, const double *W );
+
 
 int rfx_tf_numeyama
 ( size_t n, double *_X, size_t ldx, double *_Y, size_t ldy, double tf[12] );
@@ -250,6 +510,34 @@ void rfx_tf_qlnmedian
 void rfx_tf_qangmedian
 ( size_t n, const double *Q, size_t ldq, double p[4] );
 
+/**
+ * Blocked, parallel version of rfx_tf_qangmedian().
+ *
+ * Finds the sample with least total rotation angle to all others.
+ * The all-pairs sums are computed in row blocks on the thread pool,
+ * with the inner loop vectorized over structure-of-arrays copies of
+ * the quaternions.
+ *
+ * @param pool thread pool, or NULL to run serially
+ */
+void rfx_tf_qangmedian_blocked
+( size_t n, const double *Q, size_t ldq, rfx_tpool_t *pool, double p[4] );
+
+/**
+ * Approximate geodesic median of unit quaternions.
+ *
+ * Weiszfeld iteration on the tangent space of the current estimate,
+ * starting from the Davenport mean.  Each iteration is O(n).  Unlike
+ * rfx_tf_qangmedian(), the result need not be one of the samples.
+ *
+ * @param tol stop when the update angle falls below tol
+ * @param max_iter maximum number of iterations
+ * @return number of iterations performed
+ */
+size_t rfx_tf_qwmedian
+( size_t n, const double *Q, size_t ldq,
+  double tol, size_t max_iter, double p[4] );
+
 int rfx_tf_dud_median
 ( size_t n, const double *Ex, size_t ldx, const double *Ey, size_t ldy, double z[7] ) AA_DEPRECATED;
 
@@ -288,6 +576,122 @@ int rfx_tf_madqg_correct_median_window
   size_t n_obs, const double *E_obs,
   double *P, const double *W );
 
+/**
+ * Median of the most recent poses.
+ *
+ * The rotation is the medoid under aa_tf_qangle_rel(), as
+ * rfx_tf_qangmedian(), and the translation is the per-axis median,
+ * averaging the middle pair for even counts.  Adding an observation
+ * is O(n) in the window size.
+ */
+typedef struct rfx_tf_median_window {
+    size_t max;         ///< window capacity
+    size_t n;           ///< poses in the window
+    size_t i;           ///< next slot to replace
+    double *E;          ///< poses, 7 x max
+    double *sum;        ///< total angle from each slot to the others
+    double *x_sorted;   ///< translations sorted per axis, max x 3
+} rfx_tf_median_window_t;
+
+/** Initialize an empty window of max poses. */
+int rfx_tf_median_window_init( rfx_tf_median_window_t *w, size_t max );
+
+/** Free window storage. */
+void rfx_tf_median_window_destroy( rfx_tf_median_window_t *w );
+
+/** Add a pose, replacing the oldest when the window is full. */
+void rfx_tf_median_window_add( rfx_tf_median_window_t *w, const double E[7] );
+
+/** Median pose of the window, identity when empty. */
+void rfx_tf_median_window_get( const rfx_tf_median_window_t *w, double z[7] );
+
+/**
+ * rfx_tf_madqg_correct_median_window() with an incremental window.
+ */
+int rfx_tf_madqg_correct_median_window2
+( double dt, rfx_tf_median_window_t *win,
+  double *E_est, double *dx_est,
+  size_t n_obs, const double *E_obs,
+  double *P, const double *W );
+
+/* Multi-hypothesis tracking */
+/* Track several pose hypotheses when observations may be mislabeled */
+
+/** One pose hypothesis of rfx_tf_mht_t. */
+typedef struct rfx_tf_mht_hyp {
+    double E[7];        ///< pose estimate (quaternion, translation)
+    double dE[6];       ///< velocity estimate (translational, rotational)
+    double P[12*12];    ///< error covariance, see rfx_lqg_qutr_eskf_predict()
+    double log_w;       ///< normalized log weight
+    ssize_t i_obs;      ///< observation used in the last step, -1 for none
+} rfx_tf_mht_hyp_t;
+
+/**
+ * Multi-hypothesis pose tracker.
+ *
+ * Each step expands every hypothesis by each gated observation and
+ * by a missed detection, scores the children by innovation
+ * likelihood, merges children within merge_theta and merge_x of a
+ * heavier one, and keeps at most max_hyp whose weight is within
+ * log_prune of the best.  Hypotheses are expanded in parallel.
+ *
+ * The tuning fields are set by rfx_tf_mht_init() and may be changed
+ * between steps.
+ */
+typedef struct rfx_tf_mht {
+    size_t max_hyp;             ///< hypothesis capacity
+    size_t max_obs;             ///< observations used per step
+    size_t n_hyp;               ///< current hypotheses
+    rfx_tf_mht_hyp_t *hyp;      ///< hypotheses, hyp[0] is the most likely
+    rfx_tf_mht_hyp_t *child;    ///< expansion buffer, max_hyp*(max_obs+1)
+    size_t *order;              ///< selection workspace
+
+    double V[12*12];            ///< process noise
+    double W[6*6];              ///< measurement noise
+    double gate;                ///< normalized innovation squared gate
+    double log_miss;            ///< log likelihood of a miss relative to a detection at the gate
+    double log_prune;           ///< log weight ratio to the best for pruning
+    double merge_theta;         ///< merge threshold, rotation angle
+    double merge_x;             ///< merge threshold, translation
+} rfx_tf_mht_t;
+
+/**
+ * Initialize a multi-hypothesis tracker with one hypothesis.
+ *
+ * @param max_hyp maximum number of hypotheses
+ * @param max_obs maximum observations per step, extra observations
+ *   are ignored
+ * @param E0 initial pose
+ * @param P0 initial error covariance (12x12)
+ * @param V process noise (12x12)
+ * @param W measurement noise (6x6)
+ * @return 0 on success, nonzero on allocation failure
+ */
+int rfx_tf_mht_init
+( rfx_tf_mht_t *mht, size_t max_hyp, size_t max_obs,
+  const double E0[7], const double *P0,
+  const double *V, const double *W );
+
+/** Free tracker storage. */
+void rfx_tf_mht_destroy( rfx_tf_mht_t *mht );
+
+/**
+ * Predict and correct all hypotheses.
+ *
+ * @param pool thread pool, or NULL to run serially
+ * @param dt time step
+ * @param n_obs number of observations
+ * @param E_obs observed poses, 7 x n_obs
+ * @param E_est most likely pose, may be NULL
+ * @param dE_est most likely velocity, may be NULL
+ * @return 0 on success, nonzero if no hypothesis has a positive
+ *   definite innovation covariance
+ */
+int rfx_tf_mht_step
+( rfx_tf_mht_t *mht, rfx_tpool_t *pool, double dt,
+  size_t n_obs, const double *E_obs,
+  double *E_est, double *dE_est );
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
@@ -0,0 +1,107 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef REFLEX_TPOOL_H
+#define REFLEX_TPOOL_H
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file tpool.h
+ *
+ * Minimal fork-join thread pool.
+ *
+ * Worker threads are created once and sleep between jobs.  A job is
+ * a parallel loop: rfx_tpool_run() calls fun(cx,i) for every i in
+ * [0,n), with the calling thread participating, and returns when all
+ * calls have finished.  Indices are claimed dynamically, so uneven
+ * iteration costs balance across threads.
+ */
+
+/** Body of a parallel loop. */
+typedef void rfx_tpool_fun( void *cx, size_t i );
+
+/** Thread pool. */
+typedef struct rfx_tpool {
+    size_t n_thread;            ///< participating threads, including the caller
+    pthread_t *thread;          ///< worker threads, n_thread-1
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_work;   ///< signaled when a job is posted
+    pthread_cond_t cond_done;   ///< signaled when the last worker finishes
+    uint64_t gen;               ///< job counter
+    int shutdown;               ///< set to stop workers
+    size_t n_pending;           ///< workers still inside the current job
+
+    rfx_tpool_fun *fun;         ///< current job body
+    void *cx;                   ///< current job context
+    size_t n;                   ///< current job size
+    size_t next;                ///< next unclaimed index, atomic
+} rfx_tpool_t;
+
+/** Create a pool.
+ *
+ * @param n_thread participating threads including the caller, 0 to
+ *   use the number of online processors
+ * @return 0 on success, nonzero on thread creation failure
+ */
+AA_API int rfx_tpool_init( rfx_tpool_t *pool, size_t n_thread );
+
+/** Stop and join all workers. */
+AA_API void rfx_tpool_destroy( rfx_tpool_t *pool );
+
+/** Call fun(cx,i) for i in [0,n) and wait for completion.
+ *
+ * Jobs must not be posted concurrently from several threads, and fun
+ * must not post jobs to the same pool.  A NULL pool runs the loop
+ * serially in the caller.
+ */
+AA_API void rfx_tpool_run( rfx_tpool_t *pool, size_t n,
+                           rfx_tpool_fun *fun, void *cx );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //REFLEX_TPOOL_H
@@ -0,0 +1,221 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef REFLEX_TRACE_H
+#define REFLEX_TRACE_H
+
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file trace.h
+ *
+ * Real-time tracing of controller latency.
+ *
+ * Controllers with a trace attached (rfx_ctrl_t::trace) record the
+ * cycles spent in each stage of every call into a record, which is
+ * pushed onto a single-producer, single-consumer ring buffer without
+ * locks or system calls.  A non-real-time thread drains the ring
+ * with rfx_trace_drain() into log-linear (HDR-style) histograms.
+ *
+ * Instrumentation is compiled in only when RFX_TRACE is defined
+ * (configure --enable-trace).  Otherwise the trace macros expand to
+ * nothing and attaching a trace has no effect.
+ */
+
+/** Stages of a control step */
+typedef enum rfx_trace_stage {
+    RFX_TRACE_KIN = 0,     ///< forward kinematics and jacobian
+    RFX_TRACE_ERROR = 1,   ///< workspace error and desired velocity
+    RFX_TRACE_LIMIT = 2,   ///< limit checks
+    RFX_TRACE_PINV = 3,    ///< damped jacobian inverse
+    RFX_TRACE_PROJECT = 4, ///< null-space projection
+    RFX_TRACE_TOTAL = 5,   ///< entire call
+    RFX_TRACE_N_STAGE = 6
+} rfx_trace_stage_t;
+
+/** Timing of one control step */
+typedef struct rfx_trace_rec {
+    uint64_t seq;                          ///< step number
+    uint64_t cycles[RFX_TRACE_N_STAGE];    ///< ticks spent in each stage
+} rfx_trace_rec_t;
+
+/** Trace ring buffer and current record */
+typedef struct rfx_trace {
+    size_t n;                 ///< capacity of ring, a power of two
+    rfx_trace_rec_t *ring;    ///< records, size n
+    uint64_t head;            ///< records pushed, written by the control thread
+    uint64_t tail;            ///< records drained, written by the reader
+    uint64_t dropped;         ///< records dropped because the ring was full
+
+    // control thread state
+    rfx_trace_rec_t rec;      ///< record in progress
+    uint64_t t_enter;         ///< tick at entry
+    uint64_t t_mark;          ///< tick at the last stage boundary
+    unsigned depth;           ///< nesting of traced calls
+} rfx_trace_t;
+
+/** Number of linear sub-buckets per power of two, as a power of two */
+#define RFX_TRACE_HIST_SUB_BITS 4
+
+/** Number of buckets to cover all 64-bit values */
+#define RFX_TRACE_HIST_N ((64 - RFX_TRACE_HIST_SUB_BITS + 1) << RFX_TRACE_HIST_SUB_BITS)
+
+/** Log-linear histogram of tick counts.
+ *
+ * Values below 2^RFX_TRACE_HIST_SUB_BITS are exact, larger values
+ * are recorded with a relative error below 2^-RFX_TRACE_HIST_SUB_BITS.
+ */
+typedef struct rfx_trace_hist {
+    uint64_t n;                         ///< number of values
+    uint64_t min;                       ///< smallest value
+    uint64_t max;                       ///< largest value
+    double sum;                         ///< sum of values
+    uint64_t count[RFX_TRACE_HIST_N];   ///< bucket counts
+} rfx_trace_hist_t;
+
+/** Current tick count.
+ *
+ * The time stamp counter on x86, otherwise nanoseconds of the
+ * monotonic clock.
+ */
+static inline uint64_t rfx_trace_now( void ) {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned lo, hi;
+    __asm__ __volatile__ ( "rdtsc" : "=a"(lo), "=d"(hi) );
+    return ((uint64_t)hi << 32) | lo;
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/** Initialize a trace.
+ *
+ * \param t the trace
+ * \param n minimum ring capacity, rounded up to a power of two
+ */
+AA_API void rfx_trace_init( rfx_trace_t *t, size_t n );
+
+/** Free the ring of a trace */
+AA_API void rfx_trace_destroy( rfx_trace_t *t );
+
+/** Push the record in progress onto the ring.
+ *
+ * Called by RFX_TRACE_EXIT().  Wait-free; drops the record if the
+ * ring is full.
+ */
+AA_API void rfx_trace_push( rfx_trace_t *t );
+
+/** Drain records from the ring.
+ *
+ * Call from a single reader thread.
+ *
+ * \param t the trace
+ * \param hist if non-null, histograms to add each stage's ticks to,
+ *        size RFX_TRACE_N_STAGE
+ * \param recs if non-null, destination for the drained records
+ * \param n_recs maximum records to drain
+ * \returns number of records drained
+ */
+AA_API size_t rfx_trace_drain( rfx_trace_t *t, rfx_trace_hist_t *hist,
+                               rfx_trace_rec_t *recs, size_t n_recs );
+
+/** Initialize a histogram to empty */
+AA_API void rfx_trace_hist_init( rfx_trace_hist_t *h );
+
+/** Add a value to a histogram */
+AA_API void rfx_trace_hist_add( rfx_trace_hist_t *h, uint64_t v );
+
+/** Value at a percentile, 0 <= p <= 100, to histogram precision */
+AA_API uint64_t rfx_trace_hist_percentile( const rfx_trace_hist_t *h, double p );
+
+/** Print a summary of each stage */
+AA_API void rfx_trace_hist_print( FILE *f, const rfx_trace_hist_t *hist );
+
+#ifdef RFX_TRACE
+
+/** Begin a traced call */
+#define RFX_TRACE_ENTER(t)                                      \
+    do { rfx_trace_t *rfx_trace_ = (t);                         \
+        if( rfx_trace_ && 0 == rfx_trace_->depth++ ) {          \
+            memset( rfx_trace_->rec.cycles, 0,                  \
+                    sizeof(rfx_trace_->rec.cycles) );           \
+            rfx_trace_->t_enter = rfx_trace_->t_mark =          \
+                rfx_trace_now();                                \
+        } } while(0)
+
+/** Charge ticks since the last mark to stage */
+#define RFX_TRACE_MARK(t, stage)                                \
+    do { rfx_trace_t *rfx_trace_ = (t);                         \
+        if( rfx_trace_ ) {                                      \
+            uint64_t rfx_trace_t_ = rfx_trace_now();            \
+            rfx_trace_->rec.cycles[stage] +=                    \
+                rfx_trace_t_ - rfx_trace_->t_mark;              \
+            rfx_trace_->t_mark = rfx_trace_t_;                  \
+        } } while(0)
+
+/** End a traced call, pushing the record at the outermost call */
+#define RFX_TRACE_EXIT(t)                                       \
+    do { rfx_trace_t *rfx_trace_ = (t);                         \
+        if( rfx_trace_ && 0 == --rfx_trace_->depth ) {          \
+            rfx_trace_->rec.cycles[RFX_TRACE_TOTAL] =           \
+                rfx_trace_now() - rfx_trace_->t_enter;          \
+            rfx_trace_push( rfx_trace_ );                       \
+        } } while(0)
+
+#else
+
+#define RFX_TRACE_ENTER(t) ((void)0)
+#define RFX_TRACE_MARK(t, stage) ((void)0)
+#define RFX_TRACE_EXIT(t) ((void)0)
+
+#endif //RFX_TRACE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //REFLEX_TRACE_H
@@ -150,14 +150,10 @@ int main( int argc, char **argv ) {
 
     /* --- compute optimal gains --- */
     // Control LQR gain
-    aa_tick("lqr: ",NULL);
     rfx_lqg_lqr_gain( &lqg );
-    aa_tock();
 
     // Estimation Kalman-Bucy gain
-    aa_tick("kbf: ",NULL);
     rfx_lqg_kbf_gain( &lqg );
-    aa_tock();
 
     // check the the LQR gain is what we expect
     {
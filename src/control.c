@@ -83,6 +83,53 @@ void rfx_ctrlx_state_init_region( struct rfx_ctrlx_state *x, aa_mem_region_t *re
     AA_MEM_SET( x->F, 0, 6 );
 }
 
+/* Query LAPACK for the optimal SVD work size of a 6*n_q matrix */
+static int ws_work_lapack_size( size_t n_q ) {
+    int m = 6, n = (int)n_q, r = (int)AA_MIN(6,n_q);
+    int lwork = -1, info;
+    double A[1], s[1], U[1], Vt[1], work;
+    dgesvd_( "S", "S", &m, &n,
+             A, &m, s,
+             U, &m, Vt, &r,
+             &work, &lwork, &info );
+    return (int)work;
+}
+
+static void ws_work_set( rfx_ctrl_ws_work_t *w, size_t n_q, double *ptr ) {
+    w->n_q = n_q;
+    w->dq_r = ptr;           ptr += n_q;
+    w->J_star = ptr;         ptr += 6*n_q;
+    w->A = ptr;              ptr += 6*n_q;
+    w->U = ptr;              ptr += 6*6;
+    w->s = ptr;              ptr += 6;
+    w->Vt = ptr;             ptr += 6*n_q;
+    w->lapack = ptr;
+}
+
+static size_t ws_work_count( size_t n_q, int n_lapack ) {
+    return 19*n_q + 6*6 + 6 + (size_t)n_lapack;
+}
+
+void rfx_ctrl_ws_work_init( rfx_ctrl_ws_work_t *w, size_t n_q ) {
+    int n_lapack = ws_work_lapack_size( n_q );
+    ws_work_set( w, n_q, AA_NEW0_AR(double, ws_work_count(n_q,n_lapack)) );
+    w->n_lapack = n_lapack;
+}
+
+void rfx_ctrl_ws_work_init_region( rfx_ctrl_ws_work_t *w, aa_mem_region_t *reg, size_t n_q ) {
+    int n_lapack = ws_work_lapack_size( n_q );
+    size_t n = ws_work_count(n_q,n_lapack);
+    double *ptr = AA_MEM_REGION_NEW_N( reg, double, n );
+    AA_MEM_SET( ptr, 0, n );
+    ws_work_set( w, n_q, ptr );
+    w->n_lapack = n_lapack;
+}
+
+void rfx_ctrl_ws_work_destroy( rfx_ctrl_ws_work_t *w ) {
+    // all fields are in one allocation
+    free(w->dq_r);
+}
+
 void rfx_ctrl_ws_init( rfx_ctrl_ws_t *g, size_t n ) {
     memset( g, 0, sizeof(*g) );
     g->n_q = n;
@@ -94,6 +141,9 @@ void rfx_ctrl_ws_init( rfx_ctrl_ws_t *g, size_t n ) {
 
     g->q_min = AA_NEW0_AR( double, n );
     g->q_max = AA_NEW0_AR( double, n );
+
+    g->work = AA_NEW( rfx_ctrl_ws_work_t );
+    rfx_ctrl_ws_work_init( g->work, n );
 }
 
 void rfx_ctrlx_state_destroy( struct rfx_ctrlx_state *x ) {
@@ -111,73 +161,104 @@ void rfx_ctrl_ws_destroy( rfx_ctrl_ws_t *g ) {
     free(g->J);
     free(g->q_min);
     free(g->q_max);
+
+    if( g->work ) {
+        rfx_ctrl_ws_work_destroy(g->work);
+        free(g->work);
+    }
 }
 
 AA_API void rfx_ctrl_ws_lin_k_init( rfx_ctrl_ws_lin_k_t *k, size_t n_q  ) {
     k->n_q = n_q;
+    k->pinv = RFX_CTRL_PINV_SVD;
     k->q = AA_NEW0_AR( double, k->n_q );
 }
 AA_API void rfx_ctrl_ws_lin_k_destroy( rfx_ctrl_ws_lin_k_t *k ) {
     free(k->q);
 }
 
+rfx_status_t rfx_ctrl_limit_status( unsigned limits ) {
+    static const rfx_status_t order[] = {
+        RFX_LIMIT_FORCE,
+        RFX_LIMIT_MOMENT,
+        RFX_LIMIT_CONFIGURATION,
+        RFX_LIMIT_POSITION,
+        RFX_LIMIT_CONFIGURATION_ERROR,
+        RFX_LIMIT_POSITION_ERROR,
+        RFX_LIMIT_FORCE_ERROR,
+        RFX_LIMIT_MOMENT_ERROR
+    };
+    for( size_t i = 0; i < sizeof(order)/sizeof(order[0]); i ++ ) {
+        if( limits & RFX_LIMIT_BIT(order[i]) ) return order[i];
+    }
+    return RFX_OK;
+}
+
+/* Branch-free check of joint bounds */
+static int check_limit_q( size_t n, const double *q, const double *q_min, const double *q_max ) {
+    int v = 0;
+    for( size_t i = 0; i < n; i++ ) {
+        v |= (q[i] < q_min[i]) | (q[i] > q_max[i]);
+    }
+    return v;
+}
+
 // FIXME: check directions for all limits
 // FIXME: add hard limits
-static rfx_status_t check_limit( const rfx_ctrl_t *g, const double dx[3] ) {
+unsigned rfx_ctrl_limit_check( const rfx_ctrl_t *g, const double dx[6] ) {
+    unsigned m = 0;
     // F_max
     if( (g->F_max > 0) /* has limit */ &&
         (aa_la_dot( 3, g->act.F, g->act.F ) > g->F_max*g->F_max) /* magnitude check */ &&
         0 < aa_la_dot( 3, g->act.F, dx ) /*direction check*/ )
     {
-        return RFX_LIMIT_FORCE;
+        m |= RFX_LIMIT_BIT(RFX_LIMIT_FORCE);
     }
     // M_max
     if( (g->M_max > 0) &&
         (aa_la_dot( 3, g->act.F+3, g->act.F+3 ) > g->M_max*g->M_max) )
-        return RFX_LIMIT_MOMENT;
+        m |= RFX_LIMIT_BIT(RFX_LIMIT_MOMENT);
     // q_min, q_max
-    for( size_t i = 0; i < g->n_q; i++ ) {
-        if( (g->act.q[i] < g->q_min[i]) || (g->act.q[i] > g->q_max[i] ) )
-            return RFX_LIMIT_CONFIGURATION;
-    }
+    if( check_limit_q( g->n_q, g->act.q, g->q_min, g->q_max ) )
+        m |= RFX_LIMIT_BIT(RFX_LIMIT_CONFIGURATION);
     // x_min, x_max
     double x[3], x_r[3];
     aa_tf_duqu_trans( g->act.S, x );
-    aa_tf_duqu_trans( g->ref.S, x_r );
-    for( size_t i = 0; i < 3; i++ ) {
-        if( (x[i] < g->x_min[i]) || (x[i] > g->x_max[i] ) )
-            return RFX_LIMIT_POSITION;
+    {
+        int v = 0;
+        for( size_t i = 0; i < 3; i++ ) {
+            v |= (x[i] < g->x_min[i]) | (x[i] > g->x_max[i]);
+        }
+        if( v ) m |= RFX_LIMIT_BIT(RFX_LIMIT_POSITION);
     }
     // e_q_max
     if( (g->e_q_max > 0) &&
         ( aa_la_ssd(g->n_q, g->act.q, g->ref.q) > g->e_q_max * g->e_q_max ) )
-        return RFX_LIMIT_CONFIGURATION_ERROR;
+        m |= RFX_LIMIT_BIT(RFX_LIMIT_CONFIGURATION_ERROR);
     // e_x_max
-    if( (g->e_x_max > 0) &&
-        ( aa_la_ssd(3, x, x_r) > g->e_x_max * g->e_x_max ) )
-        return RFX_LIMIT_POSITION_ERROR;
+    if( g->e_x_max > 0 ) {
+        aa_tf_duqu_trans( g->ref.S, x_r );
+        if( aa_la_ssd(3, x, x_r) > g->e_x_max * g->e_x_max )
+            m |= RFX_LIMIT_BIT(RFX_LIMIT_POSITION_ERROR);
+    }
     // e_F_max
     if( (g->e_F_max > 0) &&
         ( aa_la_ssd(3, g->act.F, g->ref.F) > g->e_F_max * g->e_F_max ) )
-        return RFX_LIMIT_FORCE_ERROR;;
+        m |= RFX_LIMIT_BIT(RFX_LIMIT_FORCE_ERROR);
     // e_M_max
     if( (g->e_M_max > 0) &&
         ( aa_la_ssd(3, g->act.F+3, g->ref.F+3) > g->e_M_max * g->e_M_max ) )
-        return RFX_LIMIT_MOMENT_ERROR;
+        m |= RFX_LIMIT_BIT(RFX_LIMIT_MOMENT_ERROR);
 
-    return RFX_OK;
+    return m;
 }
 
 /*
- * u = J^* * (  dx_r - k_p * (x - x_r) -  k_f * (F - F_r) )
+ * dx_u = dx_r - k_p * (x - x_r) -  k_f * (F - F_r)
  */
-rfx_status_t rfx_ctrl_ws_lin_vfwd( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k, double *u ) {
-    double dx_u[6], x_e[6];
-    double dq_r[ws->n_q];
-
-    assert( ws->n_q == k->n_q );
-
-    AA_MEM_ZERO(u, ws->n_q );
+static rfx_status_t ws_lin_dx( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k, double dx_u[6],
+                               unsigned *limits ) {
+    double x_e[6];
 
     // find position error
     /* aa_la_vsub( 3, ws->x, ws->x_r, x_e ); */
@@ -213,11 +294,196 @@ rfx_status_t rfx_ctrl_ws_lin_vfwd( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_li
             - k->p[i] * x_e[i]
             - k->f[i] * (ws->act.F[i] - ws->ref.F[i]);
     }
+    RFX_TRACE_MARK( ws->trace, RFX_TRACE_ERROR );
+
+    // check limits
+    *limits = rfx_ctrl_limit_check( ws, dx_u );
+    RFX_TRACE_MARK( ws->trace, RFX_TRACE_LIMIT );
+    return rfx_ctrl_limit_status( *limits );
+}
+
+/*
+ * In-place Cholesky factorization of a 6x6 symmetric positive
+ * definite matrix, lower triangle.
+ */
+static int chol6( double A[36] ) {
+    for( size_t j = 0; j < 6; j ++ ) {
+        double d = AA_MATREF(A,6,j,j);
+        for( size_t l = 0; l < j; l ++ ) d -= AA_MATREF(A,6,j,l) * AA_MATREF(A,6,j,l);
+        if( d <= 0 ) return -1;
+        d = sqrt(d);
+        AA_MATREF(A,6,j,j) = d;
+        for( size_t i = j+1; i < 6; i ++ ) {
+            double a = AA_MATREF(A,6,i,j);
+            for( size_t l = 0; l < j; l ++ ) a -= AA_MATREF(A,6,i,l) * AA_MATREF(A,6,j,l);
+            AA_MATREF(A,6,i,j) = a / d;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Solve L*L^T*x = b in place, L from chol6()
+ */
+static void chol6_solve( const double L[36], double x[6] ) {
+    for( size_t i = 0; i < 6; i ++ ) {
+        double a = x[i];
+        for( size_t l = 0; l < i; l ++ ) a -= AA_MATREF(L,6,i,l) * x[l];
+        x[i] = a / AA_MATREF(L,6,i,i);
+    }
+    for( size_t i = 6; i-- > 0; ) {
+        double a = x[i];
+        for( size_t l = i+1; l < 6; l ++ ) a -= AA_MATREF(L,6,l,i) * x[l];
+        x[i] = a / AA_MATREF(L,6,i,i);
+    }
+}
+
+/*
+ * Lower bound on the smallest eigenvalue of A = L*L^T:
+ *
+ * 1/lambda_min(A) <= trace(A^{-1}) = ||L^{-1}||_F^2
+ *
+ * The bound is tight when one eigenvalue is much smaller than the
+ * rest, i.e., near a singularity.
+ */
+static double chol6_eiglow( const double L[36] ) {
+    double t = 0;
+    for( size_t j = 0; j < 6; j ++ ) {
+        // column j of L^{-1}, zero above the diagonal
+        double x[6];
+        for( size_t i = j; i < 6; i ++ ) {
+            double a = (i == j) ? 1 : 0;
+            for( size_t l = j; l < i; l ++ ) a -= AA_MATREF(L,6,i,l) * x[l];
+            x[i] = a / AA_MATREF(L,6,i,i);
+            t += x[i]*x[i];
+        }
+    }
+    return 1 / t;
+}
+
+/*
+ * Deadzone damping of A = J*J^T, lower triangle, the equivalent of
+ * damping each singular value of J with s^2 < s2min in the SVD.
+ *
+ * While the bound from chol6_eiglow() is at least s2min, A is
+ * factored undamped.  Otherwise, each eigenvalue e < s2min of A is
+ * lifted to s2min along its eigenvector v,
+ *
+ * A += (s2min - e) * v * v^T,
+ *
+ * which leaves the other directions undamped.
+ *
+ * On return, L is the Cholesky factor of the damped A.
+ */
+static int chol6_deadzone( double A[36], double s2min, double L[36] ) {
+    AA_MEM_CPY( L, A, 36 );
+    if( 0 == chol6(L) && chol6_eiglow(L) >= s2min ) return 0;
+
+    double V[36], w[6], work[64];
+    int n = 6, lwork = 64, info;
+    AA_MEM_CPY( V, A, 36 );
+    dsyev_( "V", "L", &n, V, &n, w, work, &lwork, &info );
+    if( info ) return -1;
+
+    // eigenvalues are ascending
+    for( size_t k = 0; k < 6 && w[k] < s2min; k ++ ) {
+        double lambda = s2min - w[k];
+        const double *v = V + 6*k;
+        for( size_t j = 0; j < 6; j ++ ) {
+            for( size_t i = j; i < 6; i ++ ) {
+                AA_MATREF(A,6,i,j) += lambda * v[i] * v[j];
+            }
+        }
+    }
+    AA_MEM_CPY( L, A, 36 );
+    return chol6(L);
+}
 
+/*
+ * Damped least squares with null-space projection, 6 x n_q jacobian:
+ *
+ * u = dq_r + J^T * (J*J^T + lambda*I)^{-1} * (dx - J*dq_r)
+ *
+ * Inlined with a constant n_q for the common arm sizes.
+ */
+static inline int dls6( size_t n_q, const double *J, double s2min, double dls,
+                        const double dx[6], const double *dq_r, double *u )
+{
+    double A[36], y[6];
+
+    // y = dx - J*dq_r
+    for( size_t i = 0; i < 6; i ++ ) y[i] = dx[i];
+    for( size_t j = 0; j < n_q; j ++ ) {
+        for( size_t i = 0; i < 6; i ++ ) {
+            y[i] -= AA_MATREF(J,6,i,j) * dq_r[j];
+        }
+    }
+
+    // A = J * J^T, lower triangle
+    for( size_t j = 0; j < 6; j ++ ) {
+        for( size_t i = j; i < 6; i ++ ) {
+            double a = 0;
+            for( size_t l = 0; l < n_q; l ++ ) {
+                a += AA_MATREF(J,6,i,l) * AA_MATREF(J,6,j,l);
+            }
+            AA_MATREF(A,6,i,j) = a;
+        }
+    }
+
+    // damping
+    if( s2min > 0 ) {
+        double L[36];
+        if( chol6_deadzone(A, s2min, L) ) return -1;
+        chol6_solve( L, y );
+    } else {
+        for( size_t i = 0; i < 6; i ++ ) AA_MATREF(A,6,i,i) += dls;
+        if( chol6(A) ) return -1;
+        chol6_solve( A, y );
+    }
+
+    // u = dq_r + J^T * y
+    for( size_t j = 0; j < n_q; j ++ ) {
+        double a = dq_r[j];
+        for( size_t i = 0; i < 6; i ++ ) {
+            a += AA_MATREF(J,6,i,j) * y[i];
+        }
+        u[j] = a;
+    }
+    return 0;
+}
+
+static int ws_dls6( size_t n_q, const double *J, const rfx_ctrl_ws_lin_k_t *k,
+                    const double dx[6], const double *dq_r, double *u )
+{
+    switch( n_q ) {
+    case 6: return dls6( 6, J, k->s2min, k->dls, dx, dq_r, u );
+    case 7: return dls6( 7, J, k->s2min, k->dls, dx, dq_r, u );
+    default: return dls6( n_q, J, k->s2min, k->dls, dx, dq_r, u );
+    }
+}
+
+rfx_status_t rfx_ctrl_ws_lin_dx( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k,
+                                double dx_u[6], unsigned *limits ) {
+    unsigned m;
+    rfx_status_t r = ws_lin_dx( ws, k, dx_u, &m );
+    if( limits ) *limits = m;
+    return r;
+}
+
+/*
+ * u = J^* * (  dx_r - k_p * (x - x_r) -  k_f * (F - F_r) )
+ */
+static rfx_status_t ws_lin_vfwd( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k, double *u ) {
+    double dx_u[6];
+    double dq_r[ws->n_q];
+    unsigned limits;
+
+    assert( ws->n_q == k->n_q );
+
+    AA_MEM_ZERO(u, ws->n_q );
 
-    // check force limits
     {
-        rfx_status_t r = check_limit( ws, dx_u );
+        rfx_status_t r = ws_lin_dx( ws, k, dx_u, &limits );
         if( RFX_OK != r ) {
             AA_MEM_ZERO( u, ws->n_q );
             return r;
@@ -230,6 +496,16 @@ rfx_status_t rfx_ctrl_ws_lin_vfwd( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_li
         dq_r[i] = -k->q[i] * (ws->act.q[i] - ws->ref.q[i]);// + ws->dq_r[i];
     }
 
+    if( RFX_CTRL_PINV_CHOL6 == k->pinv ) {
+        int i = ws_dls6( ws->n_q, ws->J, k, dx_u, dq_r, u );
+        RFX_TRACE_MARK( ws->trace, RFX_TRACE_PINV );
+        if( i ) {
+            AA_MEM_ZERO( u, ws->n_q );
+            return RFX_INVAL;
+        }
+        return RFX_OK;
+    }
+
     // find damped inverse
     double J_star[6*ws->n_q];  // q is probally small, assume this fits on the stack
 
@@ -239,15 +515,359 @@ rfx_status_t rfx_ctrl_ws_lin_vfwd( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_li
     } else  {
         aa_la_dpinv( 6, ws->n_q, k->dls, ws->J, J_star );
     }
+    RFX_TRACE_MARK( ws->trace, RFX_TRACE_PINV );
 
     // damped least squares with null-space projection
     aa_la_xlsnp( 6, ws->n_q, ws->J, J_star, dx_u, dq_r, u );
+    RFX_TRACE_MARK( ws->trace, RFX_TRACE_PROJECT );
 
     /* aa_la_dlsnp( 6, ws->n_q, k->dls, ws->J, dx_u, dq_r, u ); */
 
     return RFX_OK;
 }
 
+rfx_status_t rfx_ctrl_ws_lin_vfwd( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k, double *u ) {
+    RFX_TRACE_ENTER( ws->trace );
+    rfx_status_t r = ws_lin_vfwd( ws, k, u );
+    RFX_TRACE_EXIT( ws->trace );
+    return r;
+}
+
+/*
+ * Damped pseudo-inverse from the SVD, J^* = V * S^+ * U^T
+ *
+ * s2min > 0: deadzone, only damp singular values with s^2 < s2min
+ * otherwise: damped least squares, s / (s^2 + dls)
+ */
+static int ws_work_pinv( const rfx_ctrl_ws_lin_k_t *k, const double *J, rfx_ctrl_ws_work_t *w ) {
+    size_t n_q = w->n_q;
+    size_t r = AA_MIN(6,n_q);
+    int m = 6, n = (int)n_q, ri = (int)r, info;
+
+    AA_MEM_CPY( w->A, J, 6*n_q );
+    dgesvd_( "S", "S", &m, &n,
+             w->A, &m, w->s,
+             w->U, &m, w->Vt, &ri,
+             w->lapack, &w->n_lapack, &info );
+    if( info ) return info;
+
+    // scale U^T by the inverted singular values, reuse A for S^+ U^T
+    double *SU = w->A;
+    for( size_t i = 0; i < r; i ++ ) {
+        double s = w->s[i];
+        double s2 = s*s;
+        double f;
+        if( k->s2min > 0 ) {
+            f = s / ( (s2 < k->s2min) ? k->s2min : s2 );
+        } else {
+            f = s / ( s2 + k->dls );
+        }
+        for( size_t j = 0; j < 6; j ++ ) {
+            AA_MATREF(SU, r, i, j) = f * AA_MATREF(w->U, 6, j, i);
+        }
+    }
+
+    // J^* = V * (S^+ * U^T)
+    for( size_t j = 0; j < 6; j ++ ) {
+        for( size_t i = 0; i < n_q; i ++ ) {
+            double a = 0;
+            for( size_t l = 0; l < r; l ++ ) {
+                a += AA_MATREF(w->Vt, r, l, i) * AA_MATREF(SU, r, l, j);
+            }
+            AA_MATREF(w->J_star, n_q, i, j) = a;
+        }
+    }
+
+    return 0;
+}
+
+static rfx_status_t ws_lin_vfwd_work( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k,
+                                      rfx_ctrl_ws_work_t *work, double *u ) {
+    double dx_u[6];
+    size_t n_q = ws->n_q;
+
+    assert( n_q == k->n_q );
+    assert( n_q == work->n_q );
+
+    AA_MEM_ZERO(u, n_q );
+
+    {
+        rfx_status_t r = ws_lin_dx( ws, k, dx_u, &work->limits );
+        if( RFX_OK != r ) return r;
+    }
+
+    // jointspace reference velocity
+    for( size_t i = 0; i < n_q; i ++ ) {
+        work->dq_r[i] = -k->q[i] * (ws->act.q[i] - ws->ref.q[i]);
+    }
+
+    if( RFX_CTRL_PINV_CHOL6 == k->pinv ) {
+        int i = ws_dls6( n_q, ws->J, k, dx_u, work->dq_r, u );
+        RFX_TRACE_MARK( ws->trace, RFX_TRACE_PINV );
+        if( i ) {
+            AA_MEM_ZERO( u, n_q );
+            return RFX_INVAL;
+        }
+        return RFX_OK;
+    }
+
+    // find damped inverse
+    {
+        int i = ws_work_pinv( k, ws->J, work );
+        RFX_TRACE_MARK( ws->trace, RFX_TRACE_PINV );
+        if( i ) return RFX_INVAL;
+    }
+
+    // null-space projection
+    // u = J^* * dx_u + (I - J^* * J) * dq_r
+    //   = dq_r + J^* * (dx_u - J * dq_r)
+    for( size_t j = 0; j < n_q; j ++ ) {
+        for( size_t i = 0; i < 6; i ++ ) {
+            dx_u[i] -= AA_MATREF(ws->J, 6, i, j) * work->dq_r[j];
+        }
+    }
+    for( size_t i = 0; i < n_q; i ++ ) {
+        double a = work->dq_r[i];
+        for( size_t j = 0; j < 6; j ++ ) {
+            a += AA_MATREF(work->J_star, n_q, i, j) * dx_u[j];
+        }
+        u[i] = a;
+    }
+    RFX_TRACE_MARK( ws->trace, RFX_TRACE_PROJECT );
+
+    return RFX_OK;
+}
+
+rfx_status_t rfx_ctrl_ws_lin_vfwd_work( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k,
+                                        rfx_ctrl_ws_work_t *work, double *u ) {
+    RFX_TRACE_ENTER( ws->trace );
+    rfx_status_t r = ws_lin_vfwd_work( ws, k, work, u );
+    RFX_TRACE_EXIT( ws->trace );
+    return r;
+}
+
+void rfx_ctrl_ws_batch_init( rfx_ctrl_ws_batch_t *b, size_t n, size_t n_q ) {
+    b->n = n;
+    b->n_q = n_q;
+    double *ptr = AA_NEW0_AR( double, n * (7*n_q + 6 + 36 + 36 + 12 + 4) );
+    b->J = ptr;       ptr += 6*n_q*n;
+    b->dq_r = ptr;    ptr += n_q*n;
+    b->y = ptr;       ptr += 6*n;
+    b->A = ptr;       ptr += 36*n;
+    b->L = ptr;       ptr += 36*n;
+    b->w = ptr;       ptr += 12*n;
+    b->e = ptr;       ptr += n;
+    b->lambda = ptr;  ptr += n;
+    b->s2min = ptr;   ptr += n;
+    b->valid = ptr;
+}
+
+void rfx_ctrl_ws_batch_destroy( rfx_ctrl_ws_batch_t *b ) {
+    // all fields are in one allocation
+    free(b->J);
+}
+
+/* Index element i of arm a in a batch array of n arms */
+#define BATCH_REF(X,n,i,a) ((X)[(i)*(n)+(a)])
+
+/*
+ * Cholesky factorization of n 6x6 matrices.  Arms that are not
+ * positive definite get valid[a] = 0 and an identity factor.
+ */
+static void batch_chol6( size_t n, double *restrict A, double *restrict ok ) {
+    for( size_t j = 0; j < 6; j ++ ) {
+        for( size_t a = 0; a < n; a ++ ) {
+            double d = BATCH_REF(A,n,7*j,a);
+            for( size_t l = 0; l < j; l ++ ) {
+                double x = BATCH_REF(A,n,j+6*l,a);
+                d -= x*x;
+            }
+            double good = (d > 0) ? 1 : 0;
+            ok[a] *= good;
+            BATCH_REF(A,n,7*j,a) = (d > 0) ? sqrt(d) : 1;
+        }
+        for( size_t i = j+1; i < 6; i ++ ) {
+            for( size_t a = 0; a < n; a ++ ) {
+                double x = BATCH_REF(A,n,i+6*j,a);
+                for( size_t l = 0; l < j; l ++ ) {
+                    x -= BATCH_REF(A,n,i+6*l,a) * BATCH_REF(A,n,j+6*l,a);
+                }
+                BATCH_REF(A,n,i+6*j,a) = ok[a] * x / BATCH_REF(A,n,7*j,a);
+            }
+        }
+    }
+}
+
+/* Solve L*L^T*x = b in place for n arms */
+static void batch_chol6_solve( size_t n, const double *restrict L, double *restrict x ) {
+    for( size_t i = 0; i < 6; i ++ ) {
+        for( size_t a = 0; a < n; a ++ ) {
+            double y = BATCH_REF(x,n,i,a);
+            for( size_t l = 0; l < i; l ++ ) y -= BATCH_REF(L,n,i+6*l,a) * BATCH_REF(x,n,l,a);
+            BATCH_REF(x,n,i,a) = y / BATCH_REF(L,n,7*i,a);
+        }
+    }
+    for( size_t i = 6; i-- > 0; ) {
+        for( size_t a = 0; a < n; a ++ ) {
+            double y = BATCH_REF(x,n,i,a);
+            for( size_t l = i+1; l < 6; l ++ ) y -= BATCH_REF(L,n,l+6*i,a) * BATCH_REF(x,n,l,a);
+            BATCH_REF(x,n,i,a) = y / BATCH_REF(L,n,7*i,a);
+        }
+    }
+}
+
+/*
+ * Deadzone damping for n arms, see chol6_deadzone().  The
+ * factorization and eigenvalue bound are batched; the few arms near
+ * a singularity are damped one at a time.  Damped arms get their
+ * rank-one updates in A and lambda = 0.
+ */
+static void batch_deadzone( rfx_ctrl_ws_batch_t *b, size_t n ) {
+    double *L = b->L;
+    double *ok = b->w;  // borrow the first row of w
+    double *x = b->w + 6*n;
+    double *e = b->e;
+    AA_MEM_CPY( L, b->A, 36*n );
+    for( size_t a = 0; a < n; a ++ ) ok[a] = 1;
+    batch_chol6( n, L, ok );
+
+    // e = 1 / ||L^{-1}||_F^2, see chol6_eiglow()
+    for( size_t a = 0; a < n; a ++ ) e[a] = 0;
+    for( size_t j = 0; j < 6; j ++ ) {
+        for( size_t i = j; i < 6; i ++ ) {
+            for( size_t a = 0; a < n; a ++ ) {
+                double y = (i == j) ? 1 : 0;
+                for( size_t l = j; l < i; l ++ ) y -= BATCH_REF(L,n,i+6*l,a) * BATCH_REF(x,n,l,a);
+                y /= BATCH_REF(L,n,7*i,a);
+                BATCH_REF(x,n,i,a) = y;
+                e[a] += y*y;
+            }
+        }
+    }
+    for( size_t a = 0; a < n; a ++ ) e[a] = 1 / e[a];
+
+    for( size_t a = 0; a < n; a ++ ) {
+        b->lambda[a] = 0;
+        if( b->s2min[a] <= 0 || (ok[a] > 0 && e[a] >= b->s2min[a]) ) continue;
+        double A[36], La[36];
+        for( size_t j = 0; j < 6; j ++ ) {
+            for( size_t i = j; i < 6; i ++ ) AA_MATREF(A,6,i,j) = BATCH_REF(b->A,n,i+6*j,a);
+        }
+        chol6_deadzone( A, b->s2min[a], La );
+        for( size_t j = 0; j < 6; j ++ ) {
+            for( size_t i = j; i < 6; i ++ ) BATCH_REF(b->A,n,i+6*j,a) = AA_MATREF(A,6,i,j);
+        }
+    }
+}
+
+rfx_status_t rfx_ctrl_ws_lin_vfwd_batch( rfx_ctrl_ws_batch_t *b, size_t n,
+                                         const rfx_ctrl_ws_t *const *ws,
+                                         const rfx_ctrl_ws_lin_k_t *const *k,
+                                         double *const *u, rfx_status_t *r )
+{
+    assert( n <= b->n );
+    size_t n_q = b->n_q;
+    rfx_status_t result = RFX_OK;
+    int any_deadzone = 0;
+
+    // per-arm workspace error and limits, gather into the batch
+    for( size_t a = 0; a < n; a ++ ) {
+        double dx_u[6];
+        unsigned limits;
+        assert( ws[a]->n_q == k[a]->n_q );
+        assert( ws[a]->n_q <= n_q );
+        AA_MEM_ZERO( u[a], ws[a]->n_q );
+        r[a] = ws_lin_dx( ws[a], k[a], dx_u, &limits );
+        if( RFX_OK != r[a] ) {
+            if( RFX_OK == result ) result = r[a];
+            // solve an identity system and discard the result
+            b->valid[a] = 0;
+            b->s2min[a] = 0;
+            b->lambda[a] = 1;
+            for( size_t i = 0; i < 6; i ++ ) BATCH_REF(b->y,n,i,a) = 0;
+            for( size_t j = 0; j < 6*n_q; j ++ ) BATCH_REF(b->J,n,j,a) = 0;
+            for( size_t j = 0; j < n_q; j ++ ) BATCH_REF(b->dq_r,n,j,a) = 0;
+            continue;
+        }
+        b->valid[a] = 1;
+        b->s2min[a] = k[a]->s2min;
+        b->lambda[a] = k[a]->dls;
+        if( k[a]->s2min > 0 ) any_deadzone = 1;
+        for( size_t i = 0; i < 6; i ++ ) BATCH_REF(b->y,n,i,a) = dx_u[i];
+        size_t n_j = 6*ws[a]->n_q;
+        for( size_t j = 0; j < n_j; j ++ ) BATCH_REF(b->J,n,j,a) = ws[a]->J[j];
+        for( size_t j = n_j; j < 6*n_q; j ++ ) BATCH_REF(b->J,n,j,a) = 0;
+        for( size_t j = 0; j < ws[a]->n_q; j ++ ) {
+            BATCH_REF(b->dq_r,n,j,a) = -k[a]->q[j] * (ws[a]->act.q[j] - ws[a]->ref.q[j]);
+        }
+        for( size_t j = ws[a]->n_q; j < n_q; j ++ ) BATCH_REF(b->dq_r,n,j,a) = 0;
+    }
+
+    // A = J * J^T, lower triangle
+    for( size_t j = 0; j < 6; j ++ ) {
+        for( size_t i = j; i < 6; i ++ ) {
+            double *Aij = b->A + (i+6*j)*n;
+            for( size_t a = 0; a < n; a ++ ) Aij[a] = 0;
+            for( size_t l = 0; l < n_q; l ++ ) {
+                const double *Ji = b->J + (i+6*l)*n;
+                const double *Jj = b->J + (j+6*l)*n;
+                for( size_t a = 0; a < n; a ++ ) Aij[a] += Ji[a] * Jj[a];
+            }
+        }
+    }
+
+    // damping
+    if( any_deadzone ) {
+        batch_deadzone( b, n );
+        for( size_t a = 0; a < n; a ++ ) {
+            if( b->s2min[a] <= 0 ) b->lambda[a] = b->valid[a] > 0 ? k[a]->dls : 1;
+        }
+    }
+    for( size_t i = 0; i < 6; i ++ ) {
+        double *Aii = b->A + 7*i*n;
+        for( size_t a = 0; a < n; a ++ ) Aii[a] += b->lambda[a];
+    }
+
+    // y = dx_u - J*dq_r
+    for( size_t l = 0; l < n_q; l ++ ) {
+        const double *dq = b->dq_r + l*n;
+        for( size_t i = 0; i < 6; i ++ ) {
+            const double *Jil = b->J + (i+6*l)*n;
+            double *yi = b->y + i*n;
+            for( size_t a = 0; a < n; a ++ ) yi[a] -= Jil[a] * dq[a];
+        }
+    }
+
+    // y = (J*J^T + lambda*I)^{-1} * y
+    {
+        double *ok = b->w;
+        for( size_t a = 0; a < n; a ++ ) ok[a] = 1;
+        batch_chol6( n, b->A, ok );
+        batch_chol6_solve( n, b->A, b->y );
+        for( size_t a = 0; a < n; a ++ ) {
+            if( b->valid[a] > 0 && ok[a] <= 0 ) {
+                b->valid[a] = 0;
+                r[a] = RFX_INVAL;
+                if( RFX_OK == result ) result = RFX_INVAL;
+            }
+        }
+    }
+
+    // u = dq_r + J^T * y, scatter
+    for( size_t a = 0; a < n; a ++ ) {
+        if( b->valid[a] <= 0 ) continue;
+        for( size_t j = 0; j < ws[a]->n_q; j ++ ) {
+            double x = BATCH_REF(b->dq_r,n,j,a);
+            for( size_t i = 0; i < 6; i ++ ) {
+                x += BATCH_REF(b->J,n,i+6*j,a) * BATCH_REF(b->y,n,i,a);
+            }
+            u[a][j] = x;
+        }
+    }
+
+    return result;
+}
+
 rfx_status_t rfx_ctrl_ws_sdx( rfx_ctrl_ws_t *ws, double dt ) {
 
     // translation
@@ -296,6 +916,7 @@ rfx_ctrlx_lin_t *rfx_ctrlx_lin_alloc( aa_mem_region_t *reg, size_t n_q, rfx_kin_
     p->ctrl->n_q = n_q;
     p->kin_fun = kin_fun;
     p->kin_fun_cx = kin_fun_cx;
+    p->cache = NULL;
 
     rfx_ctrlx_state_init_region( &p->ctrl->act, reg, n_q );
     rfx_ctrlx_state_init_region( &p->ctrl->ref, reg, n_q );
@@ -308,6 +929,9 @@ rfx_ctrlx_lin_t *rfx_ctrlx_lin_alloc( aa_mem_region_t *reg, size_t n_q, rfx_kin_
 
     p->ctrl->J = AA_MEM_REGION_NEW_N( reg, double, n_q*6 );
 
+    p->ctrl->work = AA_MEM_REGION_NEW( reg, rfx_ctrl_ws_work_t );
+    rfx_ctrl_ws_work_init_region( p->ctrl->work, reg, n_q );
+
     p->k->n_q = n_q;
     p->k->q = AA_MEM_REGION_NEW_N( reg, double, n_q );
     AA_MEM_SET( p->k->q, 0, n_q );
@@ -316,14 +940,111 @@ rfx_ctrlx_lin_t *rfx_ctrlx_lin_alloc( aa_mem_region_t *reg, size_t n_q, rfx_kin_
     return p;
 }
 
+rfx_ctrlx_kin_cache_t *rfx_ctrlx_lin_cache_alloc( aa_mem_region_t *reg, rfx_ctrlx_lin_t *ctrl,
+                                                  double q_tol, size_t max_age ) {
+    size_t n_q = ctrl->ctrl->n_q;
+    rfx_ctrlx_kin_cache_t *c = AA_MEM_REGION_NEW( reg, rfx_ctrlx_kin_cache_t );
+    memset( c, 0, sizeof(*c) );
+    c->n_q = n_q;
+    c->q_tol = q_tol;
+    c->max_age = max_age;
+    c->q = AA_MEM_REGION_NEW_N( reg, double, n_q );
+    c->J = AA_MEM_REGION_NEW_N( reg, double, 6*n_q );
+    for( size_t i = 0; i < 3; i ++ ) {
+        c->slot[i].q = AA_MEM_REGION_NEW_N( reg, double, n_q );
+        c->slot[i].J = AA_MEM_REGION_NEW_N( reg, double, 6*n_q );
+    }
+    c->front = 0;
+    c->middle = 1;
+    c->back = 2;
+    ctrl->cache = c;
+    return c;
+}
+
+void rfx_ctrlx_lin_set_kin( const rfx_ctrlx_lin_t *ctrl, const double *q,
+                            const double E[7], const double *J ) {
+    rfx_ctrlx_kin_cache_t *c = ctrl->cache;
+    assert( c );
+    // fill the back slot, then publish it as in rfx_ctrl_ref_publish()
+    unsigned b = c->back;
+    AA_MEM_CPY( c->slot[b].q, q, c->n_q );
+    AA_MEM_CPY( c->slot[b].J, J, 6*c->n_q );
+    aa_tf_qutr2duqu( E, c->slot[b].S );
+    unsigned m = __atomic_exchange_n( &c->middle, b | RFX_CTRL_REF_FRESH, __ATOMIC_ACQ_REL );
+    c->back = m & ~RFX_CTRL_REF_FRESH;
+}
+
+/* Take injected values from rfx_ctrlx_lin_set_kin(), control thread side */
+static void kin_cache_sync( rfx_ctrlx_kin_cache_t *c ) {
+    if( __atomic_load_n( &c->middle, __ATOMIC_RELAXED ) & RFX_CTRL_REF_FRESH ) {
+        unsigned m = __atomic_exchange_n( &c->middle, c->front, __ATOMIC_ACQ_REL );
+        unsigned f = c->front = m & ~RFX_CTRL_REF_FRESH;
+        AA_MEM_CPY( c->q, c->slot[f].q, c->n_q );
+        AA_MEM_CPY( c->J, c->slot[f].J, 6*c->n_q );
+        AA_MEM_CPY( c->S, c->slot[f].S, 8 );
+        c->age = 0;
+        c->valid = 1;
+    }
+}
+
+void rfx_ctrlx_lin_cache_clear( const rfx_ctrlx_lin_t *ctrl ) {
+    if( ctrl->cache ) ctrl->cache->valid = 0;
+}
+
+/* Set act.S and J of the controller at q, from the cache if possible */
+static void ctrlx_lin_kin( const rfx_ctrlx_lin_t *ctrlx, const double *q ) {
+    rfx_ctrl_t *ctrl = ctrlx->ctrl;
+    rfx_ctrlx_kin_cache_t *c = ctrlx->cache;
+    size_t n_q = ctrl->n_q;
+
+    if( c ) kin_cache_sync( c );
+    if( c && c->valid && c->age < c->max_age ) {
+        int hit = 1;
+        for( size_t i = 0; i < n_q; i ++ ) {
+            hit &= fabs(q[i] - c->q[i]) <= c->q_tol;
+        }
+        if( hit ) {
+            // first order pose update, dx = J * (q - q_c)
+            double dx[6] = {0};
+            for( size_t j = 0; j < n_q; j ++ ) {
+                double dq = q[j] - c->q[j];
+                for( size_t i = 0; i < 6; i ++ ) {
+                    dx[i] += AA_MATREF( c->J, 6, i, j ) * dq;
+                }
+            }
+            aa_tf_duqu_svel( c->S, dx, 1.0, ctrl->act.S );
+            AA_MEM_CPY( ctrl->J, c->J, 6*n_q );
+            c->age ++;
+            c->n_hit ++;
+            return;
+        }
+    }
+
+    double E[7];
+    ctrlx->kin_fun( ctrlx->kin_fun_cx, q, E, ctrl->J );
+    aa_tf_qutr2duqu( E, ctrl->act.S );
+
+    if( c ) {
+        AA_MEM_CPY( c->q, q, n_q );
+        AA_MEM_CPY( c->S, ctrl->act.S, 8 );
+        AA_MEM_CPY( c->J, ctrl->J, 6*n_q );
+        c->age = 0;
+        c->valid = 1;
+        c->n_miss ++;
+    }
+}
+
 AA_API rfx_status_t rfx_ctrlx_lin_vfwd( const rfx_ctrlx_lin_t *ctrl, const double *q,
                                         double *u ) {
+    RFX_TRACE_ENTER( ctrl->ctrl->trace );
+    rfx_ctrl_ref_sync( ctrl->ctrl );
     AA_MEM_CPY( ctrl->ctrl->act.q, q, ctrl->ctrl->n_q );
 
-    double E[7];
-    ctrl->kin_fun( ctrl->kin_fun_cx, q, E, ctrl->ctrl->J );
-    aa_tf_qutr2duqu( E, ctrl->ctrl->act.S );
-    return rfx_ctrl_ws_lin_vfwd( ctrl->ctrl, ctrl->k, u );
+    ctrlx_lin_kin( ctrl, q );
+    RFX_TRACE_MARK( ctrl->ctrl->trace, RFX_TRACE_KIN );
+    rfx_status_t r = rfx_ctrl_ws_lin_vfwd_work( ctrl->ctrl, ctrl->k, ctrl->ctrl->work, u );
+    RFX_TRACE_EXIT( ctrl->ctrl->trace );
+    return r;
 }
 
 int rfx_ctrlx_fun_lin_vfwd ( void *cx,
@@ -335,18 +1056,20 @@ int rfx_ctrlx_fun_lin_vfwd ( void *cx,
     // actual
     rfx_ctrl_t *ctrl = ctrlx->ctrl;
     size_t nq = ctrl->n_q;
+    RFX_TRACE_ENTER( ctrl->trace );
     AA_MEM_CPY(ctrl->act.q, q_a, nq);
     AA_MEM_CPY(ctrl->act.dq, dq_a, nq);
-    double E[7];
-    ctrlx->kin_fun( ctrlx->kin_fun_cx, q_a, E, ctrl->J );
-    aa_tf_qutr2duqu( E, ctrl->act.S );
+    ctrlx_lin_kin( ctrlx, q_a );
+    RFX_TRACE_MARK( ctrl->trace, RFX_TRACE_KIN );
 
     // reference
     aa_tf_qutr2duqu( E_r, ctrl->ref.S );
     AA_MEM_CPY(ctrl->ref.dx, dx_r, 6 );
 
     // result
-    return rfx_ctrl_ws_lin_vfwd( ctrlx->ctrl, ctrlx->k, dq_r );
+    int r = rfx_ctrl_ws_lin_vfwd_work( ctrlx->ctrl, ctrlx->k, ctrl->work, dq_r );
+    RFX_TRACE_EXIT( ctrl->trace );
+    return r;
 }
 
 AA_API void
@@ -0,0 +1,123 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <amino.h>
+#include "reflex.h"
+
+/* dS = derivative of S at velocity dx0 + t*ddx */
+static void integ_diff( const double S[8], const double dx0[6], const double ddx[6],
+                        double t, double dS[8] ) {
+    double dx[6];
+    for( size_t i = 0; i < 6; i ++ ) dx[i] = dx0[i] + t * ddx[i];
+    aa_tf_duqu_vel2diff( S, dx, dS );
+}
+
+static void integ_rk4( const double S0[8], const double dx[6], const double ddx[6],
+                       double dt, double S1[8] ) {
+    double k1[8], k2[8], k3[8], k4[8], S[8];
+
+    integ_diff( S0, dx, ddx, 0, k1 );
+
+    for( size_t i = 0; i < 8; i ++ ) S[i] = S0[i] + dt/2 * k1[i];
+    integ_diff( S, dx, ddx, dt/2, k2 );
+
+    for( size_t i = 0; i < 8; i ++ ) S[i] = S0[i] + dt/2 * k2[i];
+    integ_diff( S, dx, ddx, dt/2, k3 );
+
+    for( size_t i = 0; i < 8; i ++ ) S[i] = S0[i] + dt * k3[i];
+    integ_diff( S, dx, ddx, dt, k4 );
+
+    for( size_t i = 0; i < 8; i ++ ) {
+        S1[i] = S0[i] + dt/6 * (k1[i] + 2*k2[i] + 2*k3[i] + k4[i]);
+    }
+    aa_tf_duqu_normalize( S1 );
+}
+
+static void integ_exp( const double S0[8], const double dx[6], const double ddx[6],
+                       double dt, double S1[8] ) {
+    double r0[4], v0[3], r1[4], v1[3], w[3];
+    aa_tf_duqu2qv( S0, r0, v0 );
+
+    // translation, exact for constant acceleration
+    for( size_t i = 0; i < 3; i ++ ) {
+        v1[i] = v0[i] + dt * (dx[i] + dt/2 * ddx[i]);
+    }
+
+    // rotation, exponential of the midpoint velocity
+    for( size_t i = 0; i < 3; i ++ ) {
+        w[i] = dx[3+i] + dt/2 * ddx[3+i];
+    }
+    aa_tf_qsvel( r0, w, dt, r1 );
+
+    aa_tf_qv2duqu( r1, v1, S1 );
+}
+
+void rfx_ctrl_integ_duqu( rfx_ctrl_integ_t method, const double S0[8],
+                          const double dx[6], const double ddx[6],
+                          double dt, double S1[8] ) {
+    static const double zero[6] = {0};
+    if( NULL == ddx ) ddx = zero;
+
+    switch( method ) {
+    case RFX_CTRL_INTEG_RK4:
+        integ_rk4( S0, dx, ddx, dt, S1 );
+        return;
+    case RFX_CTRL_INTEG_EXP:
+        integ_exp( S0, dx, ddx, dt, S1 );
+        return;
+    case RFX_CTRL_INTEG_EULER:
+        break;
+    }
+    aa_tf_duqu_svel( S0, dx, dt, S1 );
+}
+
+rfx_status_t rfx_ctrl_ws_sdx_integ( rfx_ctrl_ws_t *ws, rfx_ctrl_integ_t method,
+                                    const double ddx[6], double dt ) {
+    double S1[8];
+    rfx_ctrl_integ_duqu( method, ws->ref.S, ws->ref.dx, ddx, dt, S1 );
+    AA_MEM_CPY( ws->ref.S, S1, 8 );
+    if( ddx ) {
+        for( size_t i = 0; i < 6; i ++ ) ws->ref.dx[i] += dt * ddx[i];
+    }
+    return RFX_OK;
+}
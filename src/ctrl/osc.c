@@ -0,0 +1,182 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <amino.h>
+#include <cblas.h>
+#include "reflex.h"
+
+void rfx_ctrl_osc_k_init( rfx_ctrl_osc_k_t *k, size_t n_q ) {
+    memset( k, 0, sizeof(*k) );
+    k->n_q = n_q;
+    k->q = AA_NEW0_AR( double, n_q );
+    k->dq = AA_NEW0_AR( double, n_q );
+    k->dls = 1e-6;
+}
+
+void rfx_ctrl_osc_k_destroy( rfx_ctrl_osc_k_t *k ) {
+    free( k->q );
+    free( k->dq );
+}
+
+void rfx_ctrl_osc_init( rfx_ctrl_osc_t *o, size_t n_q, rfx_kin_mass_fun mass_fun, void *mass_cx ) {
+    size_t n = n_q;
+    o->n_q = n;
+    o->mass_fun = mass_fun;
+    o->mass_cx = mass_cx;
+    o->M = AA_NEW0_AR( double, n*n + n + 6*n + 6*6 + n );
+    o->g = o->M + n*n;
+    o->Y = o->g + n;
+    o->L = o->Y + 6*n;
+    o->tau0 = o->L + 6*6;
+}
+
+void rfx_ctrl_osc_destroy( rfx_ctrl_osc_t *o ) {
+    // all fields are in one allocation
+    free( o->M );
+}
+
+rfx_status_t rfx_ctrl_ws_osc( const rfx_ctrl_ws_t *ws, const rfx_ctrl_osc_k_t *k,
+                              rfx_ctrl_osc_t *o, double *tau ) {
+    const size_t n = ws->n_q;
+    const int ni = (int)n;
+    const int six = 6, one = 1;
+    int info;
+
+    assert( n == k->n_q );
+    assert( n == o->n_q );
+
+    o->mass_fun( o->mass_cx, ws->act.q, o->M, o->g );
+
+    // workspace velocity
+    double dx[6];
+    cblas_dgemv( CblasColMajor, CblasNoTrans,
+                 6, ni,
+                 1.0, ws->J, 6,
+                 ws->act.dq, 1,
+                 0.0, dx, 1 );
+
+    // relative dual quaternion -> twist -> velocity
+    double x_e[6];
+    {
+        double twist[8], de[8];
+        aa_tf_duqu_mulc( ws->act.S, ws->ref.S, de );  // de = d*conj(d_r)
+        aa_tf_duqu_minimize(de);
+        aa_tf_duqu_ln( de, twist );     // twist = log( de )
+        aa_tf_duqu_twist2vel( ws->act.S, twist, x_e );
+    }
+
+    // task acceleration and commanded wrench
+    double a[6], F_c[6];
+    for( size_t i = 0; i < 6; i ++ ) {
+        a[i] = - k->p[i] * x_e[i] - k->d[i] * (dx[i] - ws->ref.dx[i]);
+        F_c[i] = ws->ref.F[i] - k->f[i] * (ws->act.F[i] - ws->ref.F[i]);
+    }
+
+    {
+        rfx_status_t r = rfx_ctrl_limit_status( rfx_ctrl_limit_check( ws, a ) );
+        if( RFX_OK != r ) {
+            // hold: gravity compensation and joint damping
+            for( size_t i = 0; i < n; i ++ ) {
+                tau[i] = o->g[i] - k->dq[i] * ws->act.dq[i];
+            }
+            return r;
+        }
+    }
+
+    // tau0 := -M * (k_q * (q - q_r) + k_dq * dq)
+    for( size_t i = 0; i < n; i ++ ) {
+        tau[i] = k->q[i] * (ws->act.q[i] - ws->ref.q[i]) + k->dq[i] * ws->act.dq[i];
+    }
+    cblas_dgemv( CblasColMajor, CblasNoTrans,
+                 ni, ni,
+                 -1.0, o->M, ni,
+                 tau, 1,
+                 0.0, o->tau0, 1 );
+
+    // M = U**T * U
+    dpotrf_( "U", &ni, o->M, &ni, &info );
+    if( info ) {
+        AA_MEM_CPY( tau, o->g, n );
+        return RFX_INVAL;
+    }
+
+    // Y := M**-1 * J**T
+    for( size_t j = 0; j < 6; j ++ ) {
+        for( size_t i = 0; i < n; i ++ ) {
+            AA_MATREF( o->Y, n, i, j ) = AA_MATREF( ws->J, 6, j, i );
+        }
+    }
+    dpotrs_( "U", &ni, &six, o->M, &ni, o->Y, &ni, &info );
+
+    // L := J * M**-1 * J**T + dls*I = Lambda**-1
+    cblas_dgemm( CblasColMajor, CblasNoTrans, CblasNoTrans,
+                 6, 6, ni,
+                 1.0, ws->J, 6,
+                 o->Y, ni,
+                 0.0, o->L, 6 );
+    for( size_t i = 0; i < 6; i ++ ) AA_MATREF( o->L, 6, i, i ) += k->dls;
+    dpotrf_( "U", &six, o->L, &six, &info );
+    if( info ) {
+        AA_MEM_CPY( tau, o->g, n );
+        return RFX_INVAL;
+    }
+
+    // b := Lambda * (a - J * M**-1 * tau0) + F_c
+    cblas_dgemv( CblasColMajor, CblasTrans,
+                 ni, 6,
+                 -1.0, o->Y, ni,
+                 o->tau0, 1,
+                 1.0, a, 1 );
+    dpotrs_( "U", &six, &one, o->L, &six, a, &six, &info );
+    for( size_t i = 0; i < 6; i ++ ) a[i] += F_c[i];
+
+    // tau := tau0 + g + J**T * b
+    for( size_t i = 0; i < n; i ++ ) tau[i] = o->tau0[i] + o->g[i];
+    cblas_dgemv( CblasColMajor, CblasTrans,
+                 6, ni,
+                 1.0, ws->J, 6,
+                 a, 1,
+                 1.0, tau, 1 );
+
+    return RFX_OK;
+}
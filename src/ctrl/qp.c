@@ -0,0 +1,248 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <amino.h>
+#include <cblas.h>
+#include "reflex.h"
+
+void rfx_ctrl_qp_init( rfx_ctrl_qp_t *qp, size_t n_q, double dt ) {
+    size_t n = n_q;
+    AA_MEM_ZERO( qp, 1 );
+    qp->n_q = n;
+    qp->dt = dt;
+    qp->w = 1e-3;
+    qp->max_iter = 3*n;
+
+    qp->dq_max = AA_NEW0_AR( double, 2*n*n + 9*n );
+    qp->ddq_max = qp->dq_max + n;
+    qp->H = qp->ddq_max + n;
+    qp->L = qp->H + n*n;
+    qp->g = qp->L + n*n;
+    qp->lo = qp->g + n;
+    qp->hi = qp->lo + n;
+    qp->x = qp->hi + n;
+    qp->p = qp->x + n;
+    qp->free = AA_NEW0_AR( size_t, n );
+    qp->state = AA_NEW0_AR( signed char, n );
+}
+
+void rfx_ctrl_qp_destroy( rfx_ctrl_qp_t *qp ) {
+    free( qp->dq_max );
+    free( qp->free );
+    free( qp->state );
+}
+
+void rfx_ctrl_qp_reset( rfx_ctrl_qp_t *qp ) {
+    AA_MEM_ZERO( qp->x, qp->n_q );
+    AA_MEM_ZERO( qp->state, qp->n_q );
+}
+
+int rfx_ctrl_qp_box( rfx_ctrl_qp_t *qp, const double *H, const double *g,
+                     const double *lo, const double *hi, double *x ) {
+    const size_t n = qp->n_q;
+    signed char *s = qp->state;
+    size_t *fr = qp->free;
+    double *L = qp->L;
+    double *p = qp->p;
+
+    // feasible start from the warm start
+    for( size_t i = 0; i < n; i ++ ) {
+        if( lo[i] >= hi[i] )  s[i] = -1;
+        if( s[i] < 0 )        x[i] = lo[i];
+        else if( s[i] > 0 )   x[i] = hi[i];
+        else                  x[i] = AA_MAX( lo[i], AA_MIN( hi[i], x[i] ) );
+    }
+
+    for( qp->iter = 0; qp->iter < qp->max_iter; qp->iter ++ ) {
+        // free variables
+        size_t nf = 0;
+        for( size_t i = 0; i < n; i ++ ) {
+            if( 0 == s[i] ) fr[nf++] = i;
+        }
+
+        if( nf > 0 ) {
+            // L := H_FF, p := -(g_F + H_FA x_A)
+            for( size_t b = 0; b < nf; b ++ ) {
+                size_t i = fr[b];
+                for( size_t a = 0; a <= b; a ++ ) {
+                    AA_MATREF( L, nf, a, b ) = AA_MATREF( H, n, fr[a], i );
+                }
+                double r = g[i];
+                for( size_t j = 0; j < n; j ++ ) {
+                    if( s[j] ) r += AA_MATREF( H, n, i, j ) * x[j];
+                }
+                p[b] = -r;
+            }
+            int nfi = (int)nf, one = 1, info;
+            dpotrf_( "U", &nfi, L, &nfi, &info );
+            if( info ) return -1;
+            dpotrs_( "U", &nfi, &one, L, &nfi, p, &nfi, &info );
+
+            // step toward p until a bound blocks
+            double alpha = 1;
+            size_t block = n;
+            signed char side = 0;
+            for( size_t b = 0; b < nf; b ++ ) {
+                size_t i = fr[b];
+                double d = p[b] - x[i];
+                if( p[b] < lo[i] && (lo[i] - x[i]) > alpha * d ) {
+                    alpha = (lo[i] - x[i]) / d;
+                    block = i;
+                    side = -1;
+                } else if( p[b] > hi[i] && (hi[i] - x[i]) < alpha * d ) {
+                    alpha = (hi[i] - x[i]) / d;
+                    block = i;
+                    side = 1;
+                }
+            }
+            for( size_t b = 0; b < nf; b ++ ) {
+                size_t i = fr[b];
+                x[i] += alpha * (p[b] - x[i]);
+            }
+            if( block < n ) {
+                s[block] = side;
+                x[block] = (side < 0) ? lo[block] : hi[block];
+                continue;
+            }
+        }
+
+        // full step: release the bound with the most negative multiplier
+        size_t release = n;
+        double worst = 0;
+        for( size_t i = 0; i < n; i ++ ) {
+            if( 0 == s[i] || lo[i] >= hi[i] ) continue;
+            double d = g[i];
+            for( size_t j = 0; j < n; j ++ ) d += AA_MATREF( H, n, i, j ) * x[j];
+            double v = (s[i] < 0) ? -d : d;   // > 0 when moving off the bound descends
+            if( v > worst ) {
+                worst = v;
+                release = i;
+            }
+        }
+        if( release == n ) return 0;
+        s[release] = 0;
+    }
+
+    return 1;
+}
+
+/* Intersect [*lo, *hi] with [a, b], collapsing to the nearest end of
+ * [*lo, *hi] if they are disjoint */
+static void box_clamp( double *lo, double *hi, double a, double b ) {
+    double l = AA_MAX( *lo, AA_MIN( *hi, a ) );
+    double h = AA_MAX( *lo, AA_MIN( *hi, b ) );
+    *lo = l;
+    *hi = h;
+}
+
+rfx_status_t rfx_ctrl_ws_lin_vfwd_qp( const rfx_ctrl_ws_t *ws, const rfx_ctrl_ws_lin_k_t *k,
+                                      rfx_ctrl_qp_t *qp, double *u ) {
+    const size_t n = ws->n_q;
+    const int ni = (int)n;
+    double dx_u[6];
+
+    assert( ws->n_q == k->n_q );
+    assert( ws->n_q == qp->n_q );
+
+    {
+        // joint limits become constraints of the QP
+        unsigned limits;
+        rfx_ctrl_ws_lin_dx( ws, k, dx_u, &limits );
+        rfx_status_t r = rfx_ctrl_limit_status( limits & ~RFX_LIMIT_BIT(RFX_LIMIT_CONFIGURATION) );
+        if( RFX_OK != r ) {
+            AA_MEM_ZERO( u, n );
+            rfx_ctrl_qp_reset( qp );
+            return r;
+        }
+    }
+
+    // H := J**T * J + w*I
+    cblas_dsyrk( CblasColMajor, CblasUpper, CblasTrans,
+                 ni, 6,
+                 1.0, ws->J, 6,
+                 0.0, qp->H, ni );
+    for( size_t j = 0; j < n; j ++ ) {
+        AA_MATREF( qp->H, n, j, j ) += qp->w;
+        for( size_t i = j+1; i < n; i ++ ) {
+            AA_MATREF( qp->H, n, i, j ) = AA_MATREF( qp->H, n, j, i );
+        }
+    }
+
+    // g := -(J**T * dx_u + w * dq_r)
+    for( size_t i = 0; i < n; i ++ ) {
+        qp->g[i] = qp->w * k->q[i] * (ws->act.q[i] - ws->ref.q[i]);
+    }
+    cblas_dgemv( CblasColMajor, CblasTrans,
+                 6, ni,
+                 -1.0, ws->J, 6,
+                 dx_u, 1,
+                 1.0, qp->g, 1 );
+
+    // bounds, in order of precedence
+    for( size_t i = 0; i < n; i ++ ) {
+        double lo = -HUGE_VAL, hi = HUGE_VAL;
+        if( qp->dq_max[i] > 0 ) {
+            lo = -qp->dq_max[i];
+            hi = qp->dq_max[i];
+        }
+        box_clamp( &lo, &hi,
+                   (ws->q_min[i] - ws->act.q[i]) / qp->dt,
+                   (ws->q_max[i] - ws->act.q[i]) / qp->dt );
+        if( qp->ddq_max[i] > 0 ) {
+            box_clamp( &lo, &hi,
+                       ws->act.dq[i] - qp->ddq_max[i] * qp->dt,
+                       ws->act.dq[i] + qp->ddq_max[i] * qp->dt );
+        }
+        qp->lo[i] = lo;
+        qp->hi[i] = hi;
+    }
+
+    if( rfx_ctrl_qp_box( qp, qp->H, qp->g, qp->lo, qp->hi, qp->x ) < 0 ) {
+        AA_MEM_ZERO( u, n );
+        rfx_ctrl_qp_reset( qp );
+        return RFX_INVAL;
+    }
+
+    AA_MEM_CPY( u, qp->x, n );
+    return RFX_OK;
+}
@@ -0,0 +1,108 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <amino.h>
+#include "reflex.h"
+
+/*
+ * Triple buffer: the writer fills back, then swaps it with middle;
+ * the reader swaps middle with front when middle is fresh, then
+ * reads front.  The swaps are the only shared accesses.
+ */
+
+void rfx_ctrl_ref_chan_init( rfx_ctrl_ref_chan_t *c, size_t n_q ) {
+    memset( c, 0, sizeof(*c) );
+    c->n_q = n_q;
+    for( size_t i = 0; i < 3; i ++ ) {
+        rfx_ctrlx_state_init( &c->buf[i], n_q );
+    }
+    c->front = 0;
+    c->middle = 1;
+    c->back = 2;
+}
+
+void rfx_ctrl_ref_chan_destroy( rfx_ctrl_ref_chan_t *c ) {
+    for( size_t i = 0; i < 3; i ++ ) {
+        rfx_ctrlx_state_destroy( &c->buf[i] );
+    }
+}
+
+static void state_copy( size_t n_q, const struct rfx_ctrlx_state *src, struct rfx_ctrlx_state *dst ) {
+    AA_MEM_CPY( dst->q, src->q, n_q );
+    AA_MEM_CPY( dst->dq, src->dq, n_q );
+    AA_MEM_CPY( dst->S, src->S, 8 );
+    AA_MEM_CPY( dst->dx, src->dx, 6 );
+    AA_MEM_CPY( dst->F, src->F, 6 );
+}
+
+uint64_t rfx_ctrl_ref_publish( rfx_ctrl_ref_chan_t *c, const struct rfx_ctrlx_state *ref ) {
+    unsigned b = c->back;
+    state_copy( c->n_q, ref, &c->buf[b] );
+    c->seq[b] = ++c->n_pub;
+    // release: buffer contents are visible before the index
+    unsigned m = __atomic_exchange_n( &c->middle, b | RFX_CTRL_REF_FRESH, __ATOMIC_ACQ_REL );
+    c->back = m & ~RFX_CTRL_REF_FRESH;
+    return c->seq[b];
+}
+
+int rfx_ctrl_ref_read( rfx_ctrl_ref_chan_t *c, struct rfx_ctrlx_state *ref, uint64_t *seq ) {
+    int fresh = 0;
+    if( __atomic_load_n( &c->middle, __ATOMIC_RELAXED ) & RFX_CTRL_REF_FRESH ) {
+        // acquire: see the writer's buffer contents
+        unsigned m = __atomic_exchange_n( &c->middle, c->front, __ATOMIC_ACQ_REL );
+        c->front = m & ~RFX_CTRL_REF_FRESH;
+        fresh = 1;
+    }
+    unsigned f = c->front;
+    // copy only new states so local changes to ref, e.g., from
+    // rfx_ctrl_ws_sdx(), persist between publications
+    if( fresh ) state_copy( c->n_q, &c->buf[f], ref );
+    if( seq ) *seq = c->seq[f];
+    return fresh;
+}
+
+int rfx_ctrl_ref_sync( rfx_ctrl_t *g ) {
+    if( NULL == g->ref_chan ) return 0;
+    assert( g->ref_chan->n_q == g->n_q );
+    return rfx_ctrl_ref_read( g->ref_chan, &g->ref, NULL );
+}
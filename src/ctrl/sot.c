@@ -0,0 +1,303 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <amino.h>
+#include <cblas.h>
+#include "reflex.h"
+
+void rfx_sot_init( rfx_sot_t *sot, size_t n_q, size_t n_task ) {
+    AA_MEM_ZERO( sot, 1 );
+    sot->n_q = n_q;
+    sot->n_task = n_task;
+    sot->task = AA_NEW0_AR( rfx_sot_task_t, n_task );
+    sot->order = AA_NEW0_AR( size_t, n_task );
+    for( size_t i = 0; i < n_task; i ++ ) sot->order[i] = i;
+}
+
+rfx_sot_task_t *rfx_sot_task_init( rfx_sot_t *sot, size_t i, rfx_sot_task_type_t type,
+                                   int priority, size_t m ) {
+    assert( i < sot->n_task );
+    rfx_sot_task_t *t = &sot->task[i];
+    switch( type ) {
+    case RFX_SOT_POSE:        m = 6; break;
+    case RFX_SOT_POSITION:    m = 3; break;
+    case RFX_SOT_ORIENTATION: m = 3; break;
+    case RFX_SOT_COM:         if( 0 == m ) m = 3; break;
+    case RFX_SOT_JOINT_LIMIT: m = sot->n_q; break;
+    case RFX_SOT_POSTURE:     m = sot->n_q; break;
+    case RFX_SOT_GENERIC:     break;
+    }
+    t->type = type;
+    t->priority = priority;
+    t->n_q = sot->n_q;
+    t->m_max = m;
+    t->m = (RFX_SOT_JOINT_LIMIT == type) ? 0 : m;
+    t->J = AA_NEW0_AR( double, m * sot->n_q );
+    t->dx = AA_NEW0_AR( double, m );
+    t->dls = 1e-3;
+    return t;
+}
+
+void rfx_sot_work_init( rfx_sot_t *sot ) {
+    size_t n = sot->n_q;
+
+    // stable sort by priority
+    for( size_t i = 1; i < sot->n_task; i ++ ) {
+        size_t x = sot->order[i];
+        size_t j = i;
+        for( ; j > 0 && sot->task[sot->order[j-1]].priority > sot->task[x].priority; j-- ) {
+            sot->order[j] = sot->order[j-1];
+        }
+        sot->order[j] = x;
+    }
+
+    // largest level
+    sot->m_max = 0;
+    for( size_t i = 0; i < sot->n_task; ) {
+        int p = sot->task[sot->order[i]].priority;
+        size_t m = 0;
+        for( ; i < sot->n_task && p == sot->task[sot->order[i]].priority; i ++ ) {
+            m += sot->task[sot->order[i]].m_max;
+        }
+        sot->m_max = AA_MAX( sot->m_max, m );
+    }
+
+    free( sot->N );
+    sot->N = AA_NEW_AR( double, n*n + sot->m_max*(n+1) + sot->m_max*sot->m_max );
+    sot->Jt = sot->N + n*n;
+    sot->C = sot->Jt + sot->m_max*(n+1);
+}
+
+void rfx_sot_destroy( rfx_sot_t *sot ) {
+    for( size_t i = 0; i < sot->n_task; i ++ ) {
+        free( sot->task[i].J );
+        free( sot->task[i].dx );
+    }
+    free( sot->task );
+    free( sot->order );
+    free( sot->N );
+}
+
+void rfx_sot_task_jac( rfx_sot_task_t *t, size_t n_j, const size_t *idx,
+                       const double *J, size_t ldJ ) {
+    size_t r0 = (RFX_SOT_ORIENTATION == t->type) ? 3 : 0;
+    size_t m = t->m;
+    AA_MEM_ZERO( t->J, m * t->n_q );
+    for( size_t j = 0; j < n_j; j ++ ) {
+        size_t c = idx ? idx[j] : j;
+        assert( c < t->n_q );
+        AA_MEM_CPY( t->J + c*m, J + j*ldJ + r0, m );
+    }
+}
+
+void rfx_sot_task_pose( rfx_sot_task_t *t, const double S[8], const double S_r[8],
+                        const double dx_r[6], const double k[6] ) {
+    double x_e[6];
+    {
+        double twist[8], de[8];
+        aa_tf_duqu_mulc( S, S_r, de );  // de = d*conj(d_r)
+        aa_tf_duqu_minimize(de);
+        aa_tf_duqu_ln( de, twist );     // twist = log( de )
+        aa_tf_duqu_twist2vel( S, twist, x_e );
+    }
+    for( size_t i = 0; i < 6; i ++ ) {
+        t->dx[i] = (dx_r ? dx_r[i] : 0) - k[i] * x_e[i];
+    }
+}
+
+void rfx_sot_task_position( rfx_sot_task_t *t, const double x[3], const double x_r[3],
+                            const double dx_r[3], const double k[3] ) {
+    for( size_t i = 0; i < 3; i ++ ) {
+        t->dx[i] = (dx_r ? dx_r[i] : 0) - k[i] * (x[i] - x_r[i]);
+    }
+}
+
+void rfx_sot_task_orientation( rfx_sot_task_t *t, const double r[4], const double r_r[4],
+                               const double w_r[3], const double k[3] ) {
+    double r_e[4], w_e[3];
+    aa_tf_qmulc( r, r_r, r_e );
+    aa_tf_qminimize( r_e );
+    aa_tf_quat2rotvec( r_e, w_e );
+    for( size_t i = 0; i < 3; i ++ ) {
+        t->dx[i] = (w_r ? w_r[i] : 0) - k[i] * w_e[i];
+    }
+}
+
+void rfx_sot_task_jlimit( rfx_sot_task_t *t, const double *q,
+                          const double *q_min, const double *q_max,
+                          double margin, double k ) {
+    size_t n = t->n_q;
+    size_t m = 0;
+    for( size_t j = 0; j < n; j ++ ) {
+        m += (q[j] < q_min[j] + margin) || (q[j] > q_max[j] - margin);
+    }
+    t->m = m;
+    AA_MEM_ZERO( t->J, m*n );
+    size_t i = 0;
+    for( size_t j = 0; j < n; j ++ ) {
+        double lo = q_min[j] + margin;
+        double hi = q_max[j] - margin;
+        if( q[j] < lo ) {
+            AA_MATREF( t->J, m, i, j ) = 1;
+            t->dx[i++] = k * (lo - q[j]);
+        } else if( q[j] > hi ) {
+            AA_MATREF( t->J, m, i, j ) = 1;
+            t->dx[i++] = k * (hi - q[j]);
+        }
+    }
+}
+
+void rfx_sot_task_posture( rfx_sot_task_t *t, const double *q, const double *q_r,
+                           const double *k ) {
+    size_t n = t->n_q;
+    AA_MEM_ZERO( t->J, n*n );
+    for( size_t j = 0; j < n; j ++ ) {
+        AA_MATREF( t->J, n, j, j ) = 1;
+        t->dx[j] = -k[j] * (q[j] - q_r[j]);
+    }
+}
+
+rfx_status_t rfx_sot_task_ctrl( rfx_sot_task_t *t, const rfx_ctrl_ws_t *ws,
+                                const rfx_ctrl_ws_lin_k_t *k, const size_t *idx ) {
+    assert( RFX_SOT_POSE == t->type );
+    rfx_status_t r = rfx_ctrl_ws_lin_dx( ws, k, t->dx, NULL );
+    rfx_sot_task_jac( t, ws->n_q, idx, ws->J, 6 );
+    return r;
+}
+
+rfx_status_t rfx_sot_vfwd( rfx_sot_t *sot, double *u ) {
+    const size_t n = sot->n_q;
+    const int ni = (int)n;
+    double *N = sot->N;
+    int ident = 1;  // N is still the identity
+
+    AA_MEM_ZERO( u, n );
+    sot->n_level = 0;
+
+    for( size_t l = 0; l < sot->n_task; ) {
+        // rows in this level
+        int p = sot->task[sot->order[l]].priority;
+        size_t l_end = l;
+        size_t m = 0;
+        double dls = 0;
+        for( ; l_end < sot->n_task && p == sot->task[sot->order[l_end]].priority; l_end ++ ) {
+            const rfx_sot_task_t *t = &sot->task[sot->order[l_end]];
+            m += t->m;
+            dls = AA_MAX( dls, t->dls );
+        }
+        if( 0 == m ) {
+            l = l_end;
+            continue;
+        }
+        assert( m <= sot->m_max );
+        int mi = (int)m;
+        double *Jt = sot->Jt;
+        double *r = Jt + m*n;
+
+        // Jt := J*N, r := dx - J*u
+        for( size_t r0 = 0; l < l_end; l ++ ) {
+            const rfx_sot_task_t *t = &sot->task[sot->order[l]];
+            int mt = (int)t->m;
+            if( 0 == mt ) continue;
+            if( ident ) {
+                for( size_t j = 0; j < n; j ++ ) {
+                    AA_MEM_CPY( &AA_MATREF(Jt, m, r0, j), &AA_MATREF(t->J, t->m, 0, j), t->m );
+                }
+            } else {
+                cblas_dsymm( CblasColMajor, CblasRight, CblasUpper,
+                             mt, ni,
+                             1.0, N, ni,
+                             t->J, mt,
+                             0.0, Jt + r0, mi );
+            }
+            AA_MEM_CPY( r + r0, t->dx, t->m );
+            cblas_dgemv( CblasColMajor, CblasNoTrans,
+                         mt, ni,
+                         -1.0, t->J, mt,
+                         u, 1,
+                         1.0, r + r0, 1 );
+            r0 += t->m;
+        }
+
+        // C := Jt * Jt**T + dls*I = U**T * U
+        double *C = sot->C;
+        cblas_dsyrk( CblasColMajor, CblasUpper, CblasNoTrans,
+                     mi, ni,
+                     1.0, Jt, mi,
+                     0.0, C, mi );
+        for( size_t i = 0; i < m; i ++ ) AA_MATREF(C, m, i, i) += dls;
+        int info;
+        dpotrf_( "U", &mi, C, &mi, &info );
+        if( info ) return RFX_INVAL;
+
+        // [Z, z] := U**-T * [Jt, r]
+        int nrhs = ni + 1;
+        cblas_dtrsm( CblasColMajor, CblasLeft, CblasUpper, CblasTrans, CblasNonUnit,
+                     mi, nrhs,
+                     1.0, C, mi,
+                     Jt, mi );
+
+        // u := u + Jt**T * C**-1 * r = u + Z**T * z
+        cblas_dgemv( CblasColMajor, CblasTrans,
+                     mi, ni,
+                     1.0, Jt, mi,
+                     r, 1,
+                     1.0, u, 1 );
+        sot->n_level ++;
+
+        // N := N - Jt**T * C**-1 * Jt = N - Z**T * Z
+        if( l < sot->n_task ) {
+            if( ident ) {
+                AA_MEM_ZERO( N, n*n );
+                for( size_t i = 0; i < n; i ++ ) AA_MATREF(N, n, i, i) = 1;
+                ident = 0;
+            }
+            cblas_dsyrk( CblasColMajor, CblasUpper, CblasTrans,
+                         ni, mi,
+                         -1.0, Jt, mi,
+                         1.0, N, ni );
+        }
+    }
+
+    return RFX_OK;
+}
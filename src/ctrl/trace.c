@@ -0,0 +1,158 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <amino.h>
+#include <inttypes.h>
+#include "reflex.h"
+
+void rfx_trace_init( rfx_trace_t *t, size_t n ) {
+    memset( t, 0, sizeof(*t) );
+    size_t c = 1;
+    while( c < n ) c <<= 1;
+    t->n = c;
+    t->ring = AA_NEW0_AR( rfx_trace_rec_t, c );
+}
+
+void rfx_trace_destroy( rfx_trace_t *t ) {
+    free( t->ring );
+}
+
+void rfx_trace_push( rfx_trace_t *t ) {
+    uint64_t head = t->head;
+    uint64_t tail = __atomic_load_n( &t->tail, __ATOMIC_ACQUIRE );
+    t->rec.seq ++;
+    if( head - tail >= t->n ) {
+        t->dropped ++;
+        return;
+    }
+    t->ring[head & (t->n - 1)] = t->rec;
+    // release: record is visible before the new head
+    __atomic_store_n( &t->head, head + 1, __ATOMIC_RELEASE );
+}
+
+size_t rfx_trace_drain( rfx_trace_t *t, rfx_trace_hist_t *hist,
+                        rfx_trace_rec_t *recs, size_t n_recs ) {
+    uint64_t tail = t->tail;
+    uint64_t head = __atomic_load_n( &t->head, __ATOMIC_ACQUIRE );
+    size_t i = 0;
+    for( ; tail != head && i < n_recs; tail ++, i ++ ) {
+        const rfx_trace_rec_t *r = &t->ring[tail & (t->n - 1)];
+        if( hist ) {
+            for( size_t s = 0; s < RFX_TRACE_N_STAGE; s ++ ) {
+                rfx_trace_hist_add( &hist[s], r->cycles[s] );
+            }
+        }
+        if( recs ) recs[i] = *r;
+    }
+    // release: done reading before the slots are reused
+    __atomic_store_n( &t->tail, tail, __ATOMIC_RELEASE );
+    return i;
+}
+
+/*
+ * Histogram buckets: values below 2^SUB are exact.  Above that, each
+ * power of two is split into 2^SUB linear sub-buckets.
+ */
+
+#define SUB RFX_TRACE_HIST_SUB_BITS
+
+static size_t hist_index( uint64_t v ) {
+    if( v < (1u << SUB) ) return (size_t)v;
+    unsigned msb = 63u - (unsigned)__builtin_clzll( v );
+    unsigned shift = msb - SUB;
+    return ((size_t)(shift + 1) << SUB) + (size_t)((v >> shift) - (1u << SUB));
+}
+
+static uint64_t hist_value( size_t i ) {
+    if( i < (1u << SUB) ) return i;
+    unsigned shift = (unsigned)(i >> SUB) - 1;
+    uint64_t sub = (i & ((1u << SUB) - 1)) + (1u << SUB);
+    return sub << shift;
+}
+
+void rfx_trace_hist_init( rfx_trace_hist_t *h ) {
+    memset( h, 0, sizeof(*h) );
+    h->min = UINT64_MAX;
+}
+
+void rfx_trace_hist_add( rfx_trace_hist_t *h, uint64_t v ) {
+    h->count[hist_index(v)] ++;
+    h->n ++;
+    h->sum += (double)v;
+    if( v < h->min ) h->min = v;
+    if( v > h->max ) h->max = v;
+}
+
+uint64_t rfx_trace_hist_percentile( const rfx_trace_hist_t *h, double p ) {
+    if( 0 == h->n ) return 0;
+    double target = p / 100 * (double)h->n;
+    uint64_t c = 0;
+    for( size_t i = 0; i < RFX_TRACE_HIST_N; i ++ ) {
+        c += h->count[i];
+        if( (double)c >= target && c > 0 ) {
+            // highest value in the bucket
+            uint64_t v = (i + 1 < RFX_TRACE_HIST_N) ? hist_value(i+1) - 1 : UINT64_MAX;
+            return AA_MAX( h->min, AA_MIN( h->max, v ) );
+        }
+    }
+    return h->max;
+}
+
+void rfx_trace_hist_print( FILE *f, const rfx_trace_hist_t *hist ) {
+    static const char *name[RFX_TRACE_N_STAGE] = {
+        "kin", "error", "limit", "pinv", "project", "total"
+    };
+    fprintf( f, "%-8s %10s %10s %10s %10s %10s %10s %10s\n",
+             "stage", "n", "min", "mean", "p50", "p99", "p99.9", "max" );
+    for( size_t s = 0; s < RFX_TRACE_N_STAGE; s ++ ) {
+        const rfx_trace_hist_t *h = &hist[s];
+        if( 0 == h->n ) continue;
+        fprintf( f, "%-8s %10" PRIu64 " %10" PRIu64 " %10.0f %10" PRIu64 " %10" PRIu64
+                 " %10" PRIu64 " %10" PRIu64 "\n",
+                 name[s], h->n, h->min, h->sum / (double)h->n,
+                 rfx_trace_hist_percentile( h, 50 ),
+                 rfx_trace_hist_percentile( h, 99 ),
+                 rfx_trace_hist_percentile( h, 99.9 ),
+                 h->max );
+    }
+}
@@ -70,10 +70,6 @@ struct tf_cor {
     double Y[7];
 };
 
-static void tf_cor_em( int opts, size_t k, size_t n,
-                       struct tf_cor *cor,
-                       double *Z );
-
 #define TF_COR_LD (sizeof(struct tf_cor)/sizeof(double))
 
 static int tf_cor_compar( const void *_a, const void *_b ) {
@@ -85,94 +81,6 @@ static int tf_cor_compar( const void *_a, const void *_b ) {
 }
 
 
-static void tf_cor_em( int opts, size_t k, size_t n,
-                       struct tf_cor *cor,
-                       double *Z )
-{
-    void *top = aa_mem_region_local_alloc(1);
-    // count markers
-    size_t m = 1;
-    for( size_t i = 1; i < n; i ++ ) {
-        if( !aa_feq(cor[i].id, cor[i-1].id, 0) ) {
-            m++;
-        }
-    }
-
-    // find end indices
-    size_t i_end[m];
-    size_t i_beg[m];
-    size_t *i_mark = AA_MEM_REGION_LOCAL_NEW_N( size_t, n );
-    i_beg[0] = 0;
-    for( size_t i=0, j=0; i < n-1; i ++ ) {
-        i_mark[i] = j;
-        if( !aa_feq(cor[i].id, cor[i+1].id, 0) ) {
-            i_end[j] = i+1;
-            j++;
-            i_beg[j] = i+1;
-        }
-    }
-    i_end[m-1] = n;
-    i_mark[n-1] = m-1;
-
-
-    // initialize offsets
-    rfx_tf *tf_off = AA_MEM_REGION_LOCAL_NEW_N( rfx_tf, m );
-    for( size_t i = 0; i < m; i ++ ) {
-        AA_MEM_CPY( tf_off[i].r.data, aa_tf_quat_ident, 4 );
-        AA_MEM_SET( tf_off[i].v.data, 0, 3 );
-    }
-
-    rfx_tf *X_conj = AA_MEM_REGION_LOCAL_NEW_N( rfx_tf, n );
-    for( size_t i = 0; i < n; i ++ ) {
-        aa_tf_qutr_conj(cor[i].X, X_conj[i].data);
-    }
-
-    // iterate
-    rfx_tf *X_p = AA_MEM_REGION_LOCAL_NEW_N( rfx_tf, n );
-    rfx_tf *Y_p = AA_MEM_REGION_LOCAL_NEW_N( rfx_tf, n );
-    for( size_t j = 0; j < k; j ++ ) {
-        // apply offsets
-        for( size_t i = 0; i < n; i ++ )
-            aa_tf_qutr_mul(cor[i].X, tf_off[ i_mark[i] ].data, X_p[i].data );
-        // compute registration
-        rfx_tf_cor( opts, n,
-                    X_p[0].r.data, 7,
-                    X_p[0].v.data, 7,
-                    cor[0].Y, TF_COR_LD,
-                    cor[0].Y+4, TF_COR_LD,
-                    Z );
-        if( opt_verbosity)  {
-            printf("em %lu:  ", j);
-            aa_dump_vec(stdout, Z, 7 );
-        }
-
-        // update offsets
-        // T_fk*T_off = Z*T_cam  =>  T_off * (Z*T_cam)^* = T_fk^*
-        for( size_t i = 0; i < n; i ++ ) {
-            double tmp[7];
-            aa_tf_qutr_mul(Z, cor[i].Y, tmp);
-            aa_tf_qutr_conj(tmp, Y_p[i].data);
-        }
-
-        for( size_t i = 0; i < m; i ++ ) {
-            size_t beg = i_beg[i];
-            rfx_tf_cor( opts, i_end[i] - beg,
-                        X_conj[beg].r.data, 7,
-                        X_conj[beg].v.data, 7,
-                        Y_p[beg].r.data, 7,
-                        Y_p[beg].v.data, 7,
-                        tf_off[i].data );
-            if( opt_verbosity) {
-                printf("  ");
-                aa_dump_vec(stdout, tf_off[i].data, 7 );
-            }
-        }
-
-    }
-    aa_mem_region_local_pop(top);
-}
-
-
 const char *opt_file_cam = NULL;
 const char *opt_file_fk = NULL;
 const char *opt_file_out = NULL;
@@ -180,6 +88,8 @@ const char *opt_file_id = NULL;
 size_t opt_test = 0;
 int opt_cor_opts = 0;
 size_t opt_em_count = 10;
+double opt_em_tol = 0;
+size_t opt_threads = 0;
 
 double opt_zmax_theta = 1;
 double opt_zmax_x = 1;
@@ -187,7 +97,7 @@ double opt_zmax_x = 1;
 int main( int argc, char **argv )
 {
     /* Parse */
-    for( int c; -1 != (c = getopt(argc, argv, "c:k:i:o:DUamvn:?")); ) {
+    for( int c; -1 != (c = getopt(argc, argv, "c:k:i:o:DUamvn:e:j:?")); ) {
         switch(c) {
         case 'v':
             opt_verbosity++;
@@ -219,6 +129,12 @@ int main( int argc, char **argv )
         case 'n':
             opt_em_count = (size_t)atoi(optarg)+1;
             break;
+        case 'e':
+            opt_em_tol = atof(optarg);
+            break;
+        case 'j':
+            opt_threads = (size_t)atoi(optarg);
+            break;
         case '?':   /* help     */
             puts( "Usage: rfx-camcal -k FK_POSE_FILE -c CAM_POSE_FILE \n"
                   "Calibrate a camera from list of kinematics and camera transforms"
@@ -233,6 +149,8 @@ int main( int argc, char **argv )
                   "  -a,                                  Use mean translation\n"
                   "  -m,                                  Use median translation\n"
                   "  -n ITERATIONS,                       EM iterations\n"
+                  "  -e TOLERANCE,                        Stop EM when the fit changes less than TOLERANCE\n"
+                  "  -j THREADS,                          Worker threads, default all processors\n"
                   "  -v,                                  Be verbose\n"
                   "  -?,                                  Program help text\n"
                   "\n"
@@ -291,12 +209,44 @@ int main( int argc, char **argv )
     aa_cla_dlacpy( ' ', 1, (int)count, ids, 1, &cor[0].id, TF_COR_LD );
     aa_aheap_sort( cor, count, sizeof(*cor), &tf_cor_compar );
 
-    double E[7];
+    // marker indices
+    size_t *marker = AA_NEW_AR( size_t, count );
+    size_t n_marker = 1;
+    marker[0] = 0;
+    for( size_t i = 1; i < count; i ++ ) {
+        if( !aa_feq(cor[i].id, cor[i-1].id, 0) ) n_marker++;
+        marker[i] = n_marker-1;
+    }
 
-    tf_cor_em( opt_cor_opts,
-               opt_em_count,  count,
-               cor, E );
+    rfx_tpool_t pool;
+    if( rfx_tpool_init( &pool, opt_threads ) ) {
+        fprintf(stderr, "Could not create thread pool\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double E[7];
+    double *off = AA_NEW_AR( double, 7*n_marker );
+    ssize_t iter = rfx_tf_cor_em( opt_cor_opts, &pool, count,
+                                  cor[0].X, TF_COR_LD,
+                                  cor[0].Y, TF_COR_LD,
+                                  n_marker, marker,
+                                  opt_em_count, opt_em_tol,
+                                  E, off );
+    if( iter < 0 ) {
+        fprintf(stderr, "EM calibration failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if( opt_verbosity ) {
+        printf("em %ld:  ", iter);
+        aa_dump_vec(stdout, E, 7 );
+        for( size_t i = 0; i < n_marker; i ++ ) {
+            printf("  ");
+            aa_dump_vec(stdout, off + 7*i, 7 );
+        }
+    }
     write_tf( global_output, "EM", E );
+
+    rfx_tpool_destroy( &pool );
 }
 
 
@@ -0,0 +1,391 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <amino.h>
+#include "reflex.h"
+
+#define NB RFX_LQG_BANK_BLOCK
+
+/* Block temporaries are indexed [k*NB + l] for element k, lane l. */
+
+AA_API int rfx_lqg_bank_init( rfx_lqg_bank_t *bank, size_t n,
+                              size_t n_x, size_t n_u, size_t n_z )
+{
+    memset( bank, 0, sizeof(*bank) );
+    bank->n = n;
+    bank->ld = (n + NB - 1) / NB * NB;
+    bank->n_x = n_x;
+    bank->n_u = n_u;
+    bank->n_z = n_z;
+
+    size_t ld = bank->ld;
+    size_t n_model = n_x*n_x + n_x*n_u + n_z*n_x + n_x*n_x + n_z*n_z;
+    size_t n_lane = n_x + n_u + n_z + n_x*n_x + n_x*n_z;
+
+    // one allocation, aligned for vector loads of whole blocks
+    void *ptr;
+    if( posix_memalign( &ptr, 64, sizeof(double) * (n_model + n_lane*ld) ) )
+        return -1;
+    double *d = (double*)ptr;
+    memset( d, 0, sizeof(double) * (n_model + n_lane*ld) );
+
+    bank->x = d; d += n_x*ld;
+    bank->u = d; d += n_u*ld;
+    bank->z = d; d += n_z*ld;
+    bank->P = d; d += n_x*n_x*ld;
+    bank->K = d; d += n_x*n_z*ld;
+    bank->A = d; d += n_x*n_x;
+    bank->B = d; d += n_x*n_u;
+    bank->C = d; d += n_z*n_x;
+    bank->V = d; d += n_x*n_x;
+    bank->W = d;
+
+    // padding lanes included, so they stay finite
+    for( size_t k = 0; k < n_x; k ++ )
+        for( size_t l = 0; l < ld; l ++ )
+            bank->P[(k*n_x+k)*ld + l] = 1;
+
+    return 0;
+}
+
+AA_API void rfx_lqg_bank_destroy( rfx_lqg_bank_t *bank )
+{
+    free( bank->x );
+    memset( bank, 0, sizeof(*bank) );
+}
+
+static void lane_set( size_t ld, size_t n, double *X, size_t i, const double *v )
+{
+    for( size_t k = 0; k < n; k ++ ) X[k*ld + i] = v[k];
+}
+
+static void lane_get( size_t ld, size_t n, const double *X, size_t i, double *v )
+{
+    for( size_t k = 0; k < n; k ++ ) v[k] = X[k*ld + i];
+}
+
+AA_API void rfx_lqg_bank_set( rfx_lqg_bank_t *bank, size_t i,
+                              const double *x, const double *P )
+{
+    if( x ) lane_set( bank->ld, bank->n_x, bank->x, i, x );
+    if( P ) lane_set( bank->ld, bank->n_x*bank->n_x, bank->P, i, P );
+}
+
+AA_API void rfx_lqg_bank_get( const rfx_lqg_bank_t *bank, size_t i,
+                              double *x, double *P )
+{
+    if( x ) lane_get( bank->ld, bank->n_x, bank->x, i, x );
+    if( P ) lane_get( bank->ld, bank->n_x*bank->n_x, bank->P, i, P );
+}
+
+AA_API void rfx_lqg_bank_set_u( rfx_lqg_bank_t *bank, size_t i, const double *u )
+{
+    lane_set( bank->ld, bank->n_u, bank->u, i, u );
+}
+
+AA_API void rfx_lqg_bank_set_z( rfx_lqg_bank_t *bank, size_t i, const double *z )
+{
+    lane_set( bank->ld, bank->n_z, bank->z, i, z );
+}
+
+/*-- Block Kernels --*/
+
+static void predict_block( const rfx_lqg_bank_t *bank, size_t f0 )
+{
+    const size_t ld = bank->ld, n_x = bank->n_x, n_u = bank->n_u;
+    const double *A = bank->A, *B = bank->B, *V = bank->V;
+    double *x = bank->x + f0;
+    const double *u = bank->u + f0;
+    double *P = bank->P + f0;
+
+    // x := A*x + B*u
+    double xp[n_x*NB];
+    for( size_t i = 0; i < n_x; i ++ ) {
+        double *y = &xp[i*NB];
+        for( size_t l = 0; l < NB; l ++ ) y[l] = 0;
+        for( size_t j = 0; j < n_x; j ++ ) {
+            double a = A[j*n_x+i];
+            for( size_t l = 0; l < NB; l ++ ) y[l] += a * x[j*ld+l];
+        }
+        for( size_t j = 0; j < n_u; j ++ ) {
+            double b = B[j*n_x+i];
+            for( size_t l = 0; l < NB; l ++ ) y[l] += b * u[j*ld+l];
+        }
+    }
+    for( size_t i = 0; i < n_x; i ++ )
+        for( size_t l = 0; l < NB; l ++ ) x[i*ld+l] = xp[i*NB+l];
+
+    // T := A*P
+    double T[n_x*n_x*NB];
+    for( size_t j = 0; j < n_x; j ++ ) {
+        for( size_t i = 0; i < n_x; i ++ ) {
+            double *t = &T[(j*n_x+i)*NB];
+            for( size_t l = 0; l < NB; l ++ ) t[l] = 0;
+            for( size_t k = 0; k < n_x; k ++ ) {
+                double a = A[k*n_x+i];
+                const double *p = &P[(j*n_x+k)*ld];
+                for( size_t l = 0; l < NB; l ++ ) t[l] += a * p[l];
+            }
+        }
+    }
+
+    // P := T*A**T + V
+    for( size_t j = 0; j < n_x; j ++ ) {
+        for( size_t i = 0; i <= j; i ++ ) {
+            double s[NB];
+            for( size_t l = 0; l < NB; l ++ ) s[l] = V[j*n_x+i];
+            for( size_t k = 0; k < n_x; k ++ ) {
+                double a = A[k*n_x+j];
+                const double *t = &T[(k*n_x+i)*NB];
+                for( size_t l = 0; l < NB; l ++ ) s[l] += t[l] * a;
+            }
+            for( size_t l = 0; l < NB; l ++ ) {
+                P[(j*n_x+i)*ld+l] = s[l];
+                P[(i*n_x+j)*ld+l] = s[l];
+            }
+        }
+    }
+}
+
+static size_t correct_block( const rfx_lqg_bank_t *bank, const uint8_t *mask, size_t f0 )
+{
+    const size_t ld = bank->ld, n_x = bank->n_x, n_z = bank->n_z;
+    const double *C = bank->C, *W = bank->W;
+    double *x = bank->x + f0;
+    const double *z = bank->z + f0;
+    double *P = bank->P + f0;
+    double *K = bank->K + f0;
+
+    // lane weight: 1 to correct, 0 to keep
+    double w[NB];
+    size_t n_meas = 0;
+    for( size_t l = 0; l < NB; l ++ ) {
+        size_t f = f0 + l;
+        w[l] = (f < bank->n && (NULL == mask || mask[f])) ? 1.0 : 0.0;
+        n_meas += (w[l] > 0);
+    }
+    if( 0 == n_meas ) return 0;
+
+    // CP := C*P, n_z*n_x
+    double CP[n_z*n_x*NB];
+    for( size_t j = 0; j < n_x; j ++ ) {
+        for( size_t i = 0; i < n_z; i ++ ) {
+            double *t = &CP[(j*n_z+i)*NB];
+            for( size_t l = 0; l < NB; l ++ ) t[l] = 0;
+            for( size_t k = 0; k < n_x; k ++ ) {
+                double c = C[k*n_z+i];
+                const double *p = &P[(j*n_x+k)*ld];
+                for( size_t l = 0; l < NB; l ++ ) t[l] += c * p[l];
+            }
+        }
+    }
+
+    // U := C*P*C**T + W, upper triangle
+    double U[n_z*n_z*NB];
+    for( size_t j = 0; j < n_z; j ++ ) {
+        for( size_t i = 0; i <= j; i ++ ) {
+            double *s = &U[(j*n_z+i)*NB];
+            for( size_t l = 0; l < NB; l ++ ) s[l] = W[j*n_z+i];
+            for( size_t k = 0; k < n_x; k ++ ) {
+                double c = C[k*n_z+j];
+                const double *t = &CP[(k*n_z+i)*NB];
+                for( size_t l = 0; l < NB; l ++ ) s[l] += t[l] * c;
+            }
+        }
+    }
+
+    // U := chol(U), U**T * U = C*P*C**T + W
+    // Indefinite lanes get a unit pivot to stay finite and weight 0.
+    double ok[NB];
+    for( size_t l = 0; l < NB; l ++ ) ok[l] = 1;
+    for( size_t j = 0; j < n_z; j ++ ) {
+        double *ujj = &U[(j*n_z+j)*NB];
+        for( size_t k = 0; k < j; k ++ ) {
+            const double *ukj = &U[(j*n_z+k)*NB];
+            for( size_t l = 0; l < NB; l ++ ) ujj[l] -= ukj[l]*ukj[l];
+        }
+        for( size_t l = 0; l < NB; l ++ ) {
+            int pd = ujj[l] > 0;
+            ok[l] = pd ? ok[l] : 0;
+            ujj[l] = sqrt( pd ? ujj[l] : 1.0 );
+        }
+        for( size_t i = j+1; i < n_z; i ++ ) {
+            double *uji = &U[(i*n_z+j)*NB];
+            for( size_t k = 0; k < j; k ++ ) {
+                const double *ukj = &U[(j*n_z+k)*NB];
+                const double *uki = &U[(i*n_z+k)*NB];
+                for( size_t l = 0; l < NB; l ++ ) uji[l] -= ukj[l]*uki[l];
+            }
+            for( size_t l = 0; l < NB; l ++ ) uji[l] /= ujj[l];
+        }
+    }
+
+    size_t n_fail = 0;
+    for( size_t l = 0; l < NB; l ++ ) {
+        n_fail += (w[l] > 0 && ok[l] == 0);
+        w[l] *= ok[l];
+    }
+
+    // Y := (U**T*U)**-1 * CP, so that K = Y**T
+    double Y[n_z*n_x*NB];
+    memcpy( Y, CP, sizeof(Y) );
+    for( size_t c = 0; c < n_x; c ++ ) {
+        double *y = &Y[c*n_z*NB];
+        for( size_t i = 0; i < n_z; i ++ ) {
+            double *yi = &y[i*NB];
+            for( size_t k = 0; k < i; k ++ ) {
+                const double *uki = &U[(i*n_z+k)*NB];
+                for( size_t l = 0; l < NB; l ++ ) yi[l] -= uki[l] * y[k*NB+l];
+            }
+            const double *uii = &U[(i*n_z+i)*NB];
+            for( size_t l = 0; l < NB; l ++ ) yi[l] /= uii[l];
+        }
+        for( size_t ii = n_z; ii > 0; ii -- ) {
+            size_t i = ii - 1;
+            double *yi = &y[i*NB];
+            for( size_t k = i+1; k < n_z; k ++ ) {
+                const double *uik = &U[(k*n_z+i)*NB];
+                for( size_t l = 0; l < NB; l ++ ) yi[l] -= uik[l] * y[k*NB+l];
+            }
+            const double *uii = &U[(i*n_z+i)*NB];
+            for( size_t l = 0; l < NB; l ++ ) yi[l] /= uii[l];
+        }
+    }
+    // K := w*Y**T + (1-w)*K, unmeasured lanes keep their gain
+    for( size_t j = 0; j < n_z; j ++ )
+        for( size_t i = 0; i < n_x; i ++ )
+            for( size_t l = 0; l < NB; l ++ ) {
+                double *k = &K[(j*n_x+i)*ld+l];
+                *k += w[l] * (Y[(i*n_z+j)*NB+l] - *k);
+            }
+
+    // x := x + w*K*(z - C*x)
+    double r[n_z*NB];
+    for( size_t i = 0; i < n_z; i ++ ) {
+        double *ri = &r[i*NB];
+        for( size_t l = 0; l < NB; l ++ ) ri[l] = z[i*ld+l];
+        for( size_t j = 0; j < n_x; j ++ ) {
+            double c = C[j*n_z+i];
+            for( size_t l = 0; l < NB; l ++ ) ri[l] -= c * x[j*ld+l];
+        }
+        for( size_t l = 0; l < NB; l ++ ) ri[l] *= w[l];
+    }
+    for( size_t j = 0; j < n_z; j ++ )
+        for( size_t i = 0; i < n_x; i ++ )
+            for( size_t l = 0; l < NB; l ++ )
+                x[i*ld+l] += Y[(i*n_z+j)*NB+l] * r[j*NB+l];
+
+    // P := (I - w*K*C)*P = P - w*K*CP
+    for( size_t j = 0; j < n_x; j ++ ) {
+        for( size_t i = 0; i <= j; i ++ ) {
+            double s[NB];
+            for( size_t l = 0; l < NB; l ++ ) s[l] = 0;
+            for( size_t k = 0; k < n_z; k ++ ) {
+                const double *kik = &Y[(i*n_z+k)*NB];
+                const double *ckj = &CP[(j*n_z+k)*NB];
+                for( size_t l = 0; l < NB; l ++ ) s[l] += kik[l] * ckj[l];
+            }
+            for( size_t l = 0; l < NB; l ++ ) {
+                double p = P[(j*n_x+i)*ld+l] - w[l]*s[l];
+                P[(j*n_x+i)*ld+l] = p;
+                P[(i*n_x+j)*ld+l] = p;
+            }
+        }
+    }
+
+    return n_fail;
+}
+
+/*-- Drivers --*/
+
+struct bank_cx {
+    rfx_lqg_bank_t *bank;
+    const uint8_t *mask;
+    size_t blocks;      // blocks per task
+    size_t n_fail;
+};
+
+static void predict_task( void *vcx, size_t t )
+{
+    struct bank_cx *cx = (struct bank_cx*)vcx;
+    size_t b1 = AA_MIN( (t+1)*cx->blocks, cx->bank->ld / NB );
+    for( size_t b = t*cx->blocks; b < b1; b ++ )
+        predict_block( cx->bank, b*NB );
+}
+
+static void correct_task( void *vcx, size_t t )
+{
+    struct bank_cx *cx = (struct bank_cx*)vcx;
+    size_t b1 = AA_MIN( (t+1)*cx->blocks, cx->bank->ld / NB );
+    size_t n_fail = 0;
+    for( size_t b = t*cx->blocks; b < b1; b ++ )
+        n_fail += correct_block( cx->bank, cx->mask, b*NB );
+    if( n_fail )
+        __atomic_fetch_add( &cx->n_fail, n_fail, __ATOMIC_RELAXED );
+}
+
+/* Split into a few tasks per thread so uneven progress balances. */
+static size_t bank_tasks( rfx_lqg_bank_t *bank, rfx_tpool_t *pool, struct bank_cx *cx )
+{
+    size_t n_block = bank->ld / NB;
+    size_t n_thread = pool ? pool->n_thread : 1;
+    size_t n_task = AA_MIN( n_block, 4*n_thread );
+    if( 0 == n_task ) return 0;
+    cx->blocks = (n_block + n_task - 1) / n_task;
+    return (n_block + cx->blocks - 1) / cx->blocks;
+}
+
+AA_API void rfx_lqg_bank_predict( rfx_lqg_bank_t *bank, rfx_tpool_t *pool )
+{
+    struct bank_cx cx = {.bank = bank, .mask = NULL, .blocks = 0, .n_fail = 0};
+    size_t n_task = bank_tasks( bank, pool, &cx );
+    rfx_tpool_run( pool, n_task, predict_task, &cx );
+}
+
+AA_API size_t rfx_lqg_bank_correct( rfx_lqg_bank_t *bank, const uint8_t *mask,
+                                    rfx_tpool_t *pool )
+{
+    struct bank_cx cx = {.bank = bank, .mask = mask, .blocks = 0, .n_fail = 0};
+    size_t n_task = bank_tasks( bank, pool, &cx );
+    rfx_tpool_run( pool, n_task, correct_task, &cx );
+    return cx.n_fail;
+}
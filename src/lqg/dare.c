@@ -0,0 +1,356 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <amino.h>
+#include <cblas.h>
+#include "reflex.h"
+
+#define SDA_MAX_ITER 64
+#define SDA_TOL 1e-13
+
+static void symmetrize( size_t n, double *X )
+{
+    for( size_t j = 0; j < n; j ++ ) {
+        for( size_t i = j+1; i < n; i ++ ) {
+            double x = (AA_MATREF(X, n, i, j) + AA_MATREF(X, n, j, i)) / 2;
+            AA_MATREF(X, n, i, j) = x;
+            AA_MATREF(X, n, j, i) = x;
+        }
+    }
+}
+
+static double max_abs( size_t n, const double *X )
+{
+    double m = 0;
+    for( size_t i = 0; i < n; i ++ ) m = AA_MAX( m, fabs(X[i]) );
+    return m;
+}
+
+/* Structured doubling for X = A**T*X*A - A**T*X*(I + G*X)**-1*G*X*A + H,
+ * iterating in place on A, G, H; H converges to X.
+ *
+ *   A' = A * (I + G*H)**-1 * A
+ *   G' = G + A * (I + G*H)**-1 * G * A**T
+ *   H' = H + A**T * H * (I + G*H)**-1 * A
+ */
+static int sda( size_t n, double *A, double *G, double *H )
+{
+    int ni = (int)n, n2i = (int)(2*n);
+    int info = 0;
+    int r = 1;
+
+    double *ptr = (double*)aa_mem_region_local_alloc( sizeof(double)*(4*n*n) + sizeof(int)*n );
+    double *M = ptr;            // I + G*H, then scratch
+    double *Y = M + n*n;        // [Y1 Y2] = M**-1 * [A G]
+    double *T = Y + 2*n*n;
+    int *ipiv = (int*)(T + n*n);
+    double *Y1 = Y, *Y2 = Y + n*n;
+
+    for( size_t k = 0; k < SDA_MAX_ITER; k ++ ) {
+        // M := I + G*H
+        cblas_dgemm( CblasColMajor, CblasNoTrans, CblasNoTrans,
+                     ni, ni, ni,
+                     1.0, G, ni,
+                     H, ni,
+                     0.0, M, ni );
+        for( size_t i = 0; i < n; i ++ ) AA_MATREF(M, n, i, i) += 1;
+
+        memcpy( Y1, A, sizeof(double)*n*n );
+        memcpy( Y2, G, sizeof(double)*n*n );
+        dgesv_( &ni, &n2i, M, &ni, ipiv, Y, &ni, &info );
+        if( info ) { r = -1; break; }
+
+        // H := H + A**T * (H * Y1)
+        cblas_dgemm( CblasColMajor, CblasNoTrans, CblasNoTrans,
+                     ni, ni, ni,
+                     1.0, H, ni,
+                     Y1, ni,
+                     0.0, T, ni );
+        cblas_dgemm( CblasColMajor, CblasTrans, CblasNoTrans,
+                     ni, ni, ni,
+                     1.0, A, ni,
+                     T, ni,
+                     0.0, M, ni );
+        cblas_daxpy( ni*ni, 1.0, M, 1, H, 1 );
+        symmetrize( n, H );
+        double dh = max_abs( n*n, M );
+
+        // G := G + A * (Y2 * A**T)
+        cblas_dgemm( CblasColMajor, CblasNoTrans, CblasTrans,
+                     ni, ni, ni,
+                     1.0, Y2, ni,
+                     A, ni,
+                     0.0, T, ni );
+        cblas_dgemm( CblasColMajor, CblasNoTrans, CblasNoTrans,
+                     ni, ni, ni,
+                     1.0, A, ni,
+                     T, ni,
+                     1.0, G, ni );
+        symmetrize( n, G );
+
+        // A := A * Y1
+        cblas_dgemm( CblasColMajor, CblasNoTrans, CblasNoTrans,
+                     ni, ni, ni,
+                     1.0, A, ni,
+                     Y1, ni,
+                     0.0, T, ni );
+        memcpy( A, T, sizeof(double)*n*n );
+
+        if( dh <= SDA_TOL * max_abs(n*n, H) ) { r = 0; break; }
+    }
+
+    aa_mem_region_local_pop( ptr );
+    return r;
+}
+
+/* G := B * R**-1 * B**T, B is n*m */
+static int riccati_g( size_t n, size_t m, const double *B, const double *R, double *G )
+{
+    int ni = (int)n, mi = (int)m, info;
+    double *ptr = (double*)aa_mem_region_local_alloc( sizeof(double)*(m*m + m*n) );
+    double *Rf = ptr;
+    double *RB = Rf + m*m;
+
+    memcpy( Rf, R, sizeof(double)*m*m );
+    for( size_t j = 0; j < n; j ++ )
+        for( size_t i = 0; i < m; i ++ )
+            AA_MATREF(RB, m, i, j) = AA_MATREF(B, n, j, i);
+    dposv_( "U", &mi, &ni, Rf, &mi, RB, &mi, &info );
+    if( 0 == info ) {
+        cblas_dgemm( CblasColMajor, CblasNoTrans, CblasNoTrans,
+                     ni, ni, mi,
+                     1.0, B, ni,
+                     RB, mi,
+                     0.0, G, ni );
+    }
+
+    aa_mem_region_local_pop( ptr );
+    return info ? -1 : 0;
+}
+
+AA_API int rfx_lqg_dare( size_t n_x, size_t n_u,
+                         const double *A, const double *B,
+                         const double *Q, const double *R,
+                         double *X )
+{
+    double *ptr = (double*)aa_mem_region_local_alloc( sizeof(double)*2*n_x*n_x );
+    double *A0 = ptr;
+    double *G = A0 + n_x*n_x;
+
+    int r = riccati_g( n_x, n_u, B, R, G );
+    if( 0 == r ) {
+        memcpy( A0, A, sizeof(double)*n_x*n_x );
+        memcpy( X, Q, sizeof(double)*n_x*n_x );
+        r = sda( n_x, A0, G, X );
+    }
+
+    aa_mem_region_local_pop( ptr );
+    return r;
+}
+
+AA_API int rfx_lqg_kf_dare_gain( rfx_lqg_t *lqg )
+{
+    size_t n_x = lqg->n_x, n_z = lqg->n_z;
+
+    // dual of the control equation: A -> A**T, B -> C**T, Q -> V, R -> W
+    double *ptr = (double*)aa_mem_region_local_alloc( sizeof(double)*(n_x*n_x + n_x*n_z) );
+    double *At = ptr;
+    double *Ct = At + n_x*n_x;
+    for( size_t j = 0; j < n_x; j ++ ) {
+        for( size_t i = 0; i < n_x; i ++ )
+            AA_MATREF(At, n_x, j, i) = AA_MATREF(lqg->A, n_x, i, j);
+        for( size_t i = 0; i < n_z; i ++ )
+            AA_MATREF(Ct, n_x, j, i) = AA_MATREF(lqg->C, n_z, i, j);
+    }
+
+    int r = rfx_lqg_dare( n_x, n_z, At, Ct, lqg->V, lqg->W, lqg->P );
+    aa_mem_region_local_pop( ptr );
+
+    if( r >= 0 ) {
+        // P is the predicted covariance; correct it
+        if( rfx_lqg_kf_correct_gain( n_x, n_z, lqg->C, lqg->P, lqg->W, lqg->K ) )
+            return -1;
+        rfx_lqg_kf_correct_cov( n_x, n_z, lqg->C, lqg->P, lqg->K );
+    }
+    return r;
+}
+
+AA_API int rfx_lqg_dlqr_gain( rfx_lqg_t *lqg )
+{
+    size_t n_x = lqg->n_x, n_u = lqg->n_u;
+    int nxi = (int)n_x, nui = (int)n_u, info;
+
+    double *ptr = (double*)aa_mem_region_local_alloc( sizeof(double)*(n_x*n_x + n_x*n_u + n_u*n_u) );
+    double *X = ptr;
+    double *XB = X + n_x*n_x;
+    double *M = XB + n_x*n_u;
+
+    int r = rfx_lqg_dare( n_x, n_u, lqg->A, lqg->B, lqg->Q, lqg->R, X );
+    if( r >= 0 ) {
+        // XB := X*B
+        cblas_dgemm( CblasColMajor, CblasNoTrans, CblasNoTrans,
+                     nxi, nui, nxi,
+                     1.0, X, nxi,
+                     lqg->B, nxi,
+                     0.0, XB, nxi );
+        // M := R + B**T*X*B
+        memcpy( M, lqg->R, sizeof(double)*n_u*n_u );
+        cblas_dgemm( CblasColMajor, CblasTrans, CblasNoTrans,
+                     nui, nui, nxi,
+                     1.0, lqg->B, nxi,
+                     XB, nxi,
+                     1.0, M, nui );
+        // L := B**T*X*A, then L := M**-1 * L
+        cblas_dgemm( CblasColMajor, CblasTrans, CblasNoTrans,
+                     nui, nxi, nxi,
+                     1.0, XB, nxi,
+                     lqg->A, nxi,
+                     0.0, lqg->L, nui );
+        dposv_( "U", &nui, &nxi, M, &nui, lqg->L, &nui, &info );
+        if( info ) r = -1;
+    }
+
+    aa_mem_region_local_pop( ptr );
+    return r;
+}
+
+/*-- Steady-State Switching --*/
+
+static int ss_model_changed( const rfx_lqg_ss_t *ss, const rfx_lqg_t *lqg )
+{
+    size_t xx = sizeof(double)*lqg->n_x*lqg->n_x;
+    size_t zx = sizeof(double)*lqg->n_z*lqg->n_x;
+    size_t zz = sizeof(double)*lqg->n_z*lqg->n_z;
+    return memcmp( ss->A, lqg->A, xx ) || memcmp( ss->C, lqg->C, zx ) ||
+        memcmp( ss->V, lqg->V, xx ) || memcmp( ss->W, lqg->W, zz );
+}
+
+static void ss_solve( rfx_lqg_ss_t *ss, const rfx_lqg_t *lqg )
+{
+    size_t n_x = lqg->n_x, n_z = lqg->n_z;
+    memcpy( ss->A, lqg->A, sizeof(double)*n_x*n_x );
+    memcpy( ss->C, lqg->C, sizeof(double)*n_z*n_x );
+    memcpy( ss->V, lqg->V, sizeof(double)*n_x*n_x );
+    memcpy( ss->W, lqg->W, sizeof(double)*n_z*n_z );
+
+    rfx_lqg_t tmp = *lqg;
+    tmp.P = ss->P;
+    tmp.K = ss->K;
+    ss->status = rfx_lqg_kf_dare_gain( &tmp );
+    ss->steady = 0;
+    ss->count = 0;
+}
+
+AA_API void rfx_lqg_ss_init( rfx_lqg_ss_t *ss, const rfx_lqg_t *lqg )
+{
+    size_t n_x = lqg->n_x, n_z = lqg->n_z;
+    memset( ss, 0, sizeof(*ss) );
+    ss->tol = 1e-6;
+    ss->n_conv = 10;
+
+    ss->K = AA_NEW0_AR( double, n_x*n_z + 3*n_x*n_x + 2*n_z*n_x + n_z*n_z );
+    ss->P = ss->K + n_x*n_z;
+    ss->A = ss->P + n_x*n_x;
+    ss->C = ss->A + n_x*n_x;
+    ss->V = ss->C + n_z*n_x;
+    ss->W = ss->V + n_x*n_x;
+
+    ss_solve( ss, lqg );
+}
+
+AA_API void rfx_lqg_ss_destroy( rfx_lqg_ss_t *ss )
+{
+    free( ss->K );
+    memset( ss, 0, sizeof(*ss) );
+}
+
+AA_API int rfx_lqg_kf_step_ss( rfx_lqg_t *lqg, rfx_lqg_ss_t *ss )
+{
+    size_t n_x = lqg->n_x, n_z = lqg->n_z;
+
+    if( ss_model_changed(ss, lqg) )
+        ss_solve( ss, lqg );
+
+    if( ss->steady ) {
+        // x = A*x + B*u
+        double x[n_x];
+        aa_lsim_dstep( n_x, lqg->n_u,
+                       lqg->A, lqg->B,
+                       lqg->x, lqg->u,
+                       x );
+        // x = x + K * (z - C*x)
+        double r[n_z];
+        memcpy( r, lqg->z, sizeof(r) );
+        cblas_dgemv( CblasColMajor, CblasNoTrans,
+                     (int)n_z, (int)n_x,
+                     -1.0, lqg->C, (int)n_z,
+                     x, 1,
+                     1.0, r, 1 );
+        cblas_dgemv( CblasColMajor, CblasNoTrans,
+                     (int)n_x, (int)n_z,
+                     1.0, ss->K, (int)n_x,
+                     r, 1,
+                     1.0, x, 1 );
+        memcpy( lqg->x, x, sizeof(x) );
+        return 1;
+    }
+
+    rfx_lqg_kf_predict( lqg );
+    if( rfx_lqg_kf_correct( lqg ) ) {
+        // no gain this tick to compare against the steady state
+        ss->count = 0;
+        return 0;
+    }
+
+    if( 0 == ss->status ) {
+        double d = 0;
+        for( size_t i = 0; i < n_x*n_z; i ++ )
+            d = AA_MAX( d, fabs(lqg->K[i] - ss->K[i]) );
+        ss->count = (d <= ss->tol * max_abs(n_x*n_z, ss->K)) ? ss->count + 1 : 0;
+        if( ss->count >= ss->n_conv ) {
+            ss->steady = 1;
+            memcpy( lqg->K, ss->K, sizeof(double)*n_x*n_z );
+            memcpy( lqg->P, ss->P, sizeof(double)*n_x*n_x );
+        }
+    }
+    return 0;
+}
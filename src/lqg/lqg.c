@@ -48,11 +48,10 @@
 #define SYMM_PART CblasUpper
 #define SYMM_PARTC "U"
 
-AA_API void rfx_lqg_kf_predict_cov( size_t n, const double *A, const double *V, double *P )
+/* P = A * P * A**T + V, T is n*n scratch */
+static void kf_predict_cov_work( size_t n, const double *A, const double *V, double *P, double *T )
 {
-    // P = A * P * A**T + V
     int ni = (int)n;
-    double *T = (double*)aa_mem_region_local_tmpalloc( 2 * n*n * sizeof(P[0]) );
 
     // T := A*P
     cblas_dsymm( CblasColMajor, CblasRight, SYMM_PART,
@@ -72,17 +71,16 @@ AA_API void rfx_lqg_kf_predict_cov( size_t n, const double *A, const double *V,
                  1.0, P, ni );
 }
 
-int rfx_lqg_kf_correct_gain
-( size_t n_x, size_t n_z, const double *C, const double *P, const double *W, double *K )
+/* K = P * C**T * (C*P*C**T + W)**-1, work is n_z*n_x + n_z*n_z */
+static int kf_correct_gain_work
+( size_t n_x, size_t n_z, const double *C, const double *P, const double *W, double *K,
+  double *work )
 {
     int nxi = (int)n_x;
     int nzi = (int)n_z;
 
-    double *ptr = (double*) aa_mem_region_local_alloc( sizeof(ptr[0]) *
-                                                       (n_z*n_x + n_z*n_z) );
-
-    double *CP = ptr;
-    double *Kp = &ptr[n_z*n_x];
+    double *CP = work;
+    double *Kp = &work[n_z*n_x];
 
     // P is symmetric, so P*C^T == (C*P^T)^T == (C*P)^T
 
@@ -114,6 +112,7 @@ int rfx_lqg_kf_correct_gain
     dpotrf_( SYMM_PARTC, &nzi,
              Kp, &nzi,
              &info );
+    if( info ) return info;
 
     // Solve it!
     dpotrs_( SYMM_PARTC, &nzi, &nxi,
@@ -126,20 +125,18 @@ int rfx_lqg_kf_correct_gain
         for( size_t i = 0; i < n_x; i ++ )
             K[j*n_x+i] = CP[i*n_z+j];
 
-    int i = 0;
-
-    return i;
+    return info;
 }
 
-void rfx_lqg_kf_correct_cov
-( size_t n_x, size_t n_z, const double *C, double *P, double *K )
+/* P = (I - K*C) * P, work is 2*n_x*n_x */
+static void kf_correct_cov_work
+( size_t n_x, size_t n_z, const double *C, double *P, const double *K, double *work )
 {
     int nxi = (int)n_x;
     int nzi = (int)n_z;
 
-    double *ptr = (double*)aa_mem_region_local_tmpalloc( 2 * n_x*n_x * sizeof(P[0]) );
-    double *KC = ptr;
-    double *P1 = &ptr[n_x*n_x];
+    double *KC = work;
+    double *P1 = &work[n_x*n_x];
 
     // P := (I - K*C) * P
     cblas_dgemm( CblasColMajor, CblasNoTrans, CblasNoTrans,
@@ -159,6 +156,28 @@ void rfx_lqg_kf_correct_cov
     dlacpy_( SYMM_PARTC, &nxi, &nxi, P1, &nxi, P, &nxi );
 }
 
+AA_API void rfx_lqg_kf_predict_cov( size_t n, const double *A, const double *V, double *P )
+{
+    double *T = (double*)aa_mem_region_local_tmpalloc( n*n * sizeof(P[0]) );
+    kf_predict_cov_work( n, A, V, P, T );
+}
+
+int rfx_lqg_kf_correct_gain
+( size_t n_x, size_t n_z, const double *C, const double *P, const double *W, double *K )
+{
+    double *ptr = (double*) aa_mem_region_local_alloc( sizeof(ptr[0]) *
+                                                       (n_z*n_x + n_z*n_z) );
+    int i = kf_correct_gain_work( n_x, n_z, C, P, W, K, ptr );
+    aa_mem_region_local_pop( ptr );
+    return i;
+}
+
+void rfx_lqg_kf_correct_cov
+( size_t n_x, size_t n_z, const double *C, double *P, double *K )
+{
+    double *ptr = (double*)aa_mem_region_local_tmpalloc( 2 * n_x*n_x * sizeof(P[0]) );
+    kf_correct_cov_work( n_x, n_z, C, P, K, ptr );
+}
 
 int rfx_lqg_ekf_predict
 ( void *cx, size_t n_x, double *x, const double *u, double *P, const double *V,
@@ -203,6 +222,81 @@ int rfx_lqg_ekf_correct
     return i;
 }
 
+/*-- EKF Workspace --*/
+
+/* Round up to whole 64-byte lines */
+#define EKF_WS_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+AA_API int rfx_lqg_ekf_ws_init( rfx_lqg_ekf_ws_t *ws, size_t n_x, size_t n_z )
+{
+    memset( ws, 0, sizeof(*ws) );
+    ws->n_x = n_x;
+    ws->n_z = n_z;
+
+    size_t n_work = AA_MAX( n_z*n_x + n_z*n_z, 2*n_x*n_x );
+    size_t n = ( EKF_WS_ALIGN(n_x*n_x) + EKF_WS_ALIGN(n_z) + EKF_WS_ALIGN(n_z*n_x) +
+                 EKF_WS_ALIGN(n_x*n_z) + EKF_WS_ALIGN(n_x) + EKF_WS_ALIGN(n_work) );
+
+    void *ptr;
+    if( posix_memalign( &ptr, 64, sizeof(double) * n ) )
+        return -1;
+    memset( ptr, 0, sizeof(double) * n );
+
+    double *d = (double*)ptr;
+    ws->F = d;    d += EKF_WS_ALIGN(n_x*n_x);
+    ws->y = d;    d += EKF_WS_ALIGN(n_z);
+    ws->H = d;    d += EKF_WS_ALIGN(n_z*n_x);
+    ws->K = d;    d += EKF_WS_ALIGN(n_x*n_z);
+    ws->Ky = d;   d += EKF_WS_ALIGN(n_x);
+    ws->work = d;
+
+    return 0;
+}
+
+AA_API void rfx_lqg_ekf_ws_destroy( rfx_lqg_ekf_ws_t *ws )
+{
+    free( ws->F );
+    memset( ws, 0, sizeof(*ws) );
+}
+
+AA_API int rfx_lqg_ekf_predict_work
+( rfx_lqg_ekf_ws_t *ws, void *cx, double *x, const double *u, double *P, const double *V,
+  rfx_lqg_ekf_process_fun process )
+{
+    int i = process( cx, x, u, ws->F );
+    kf_predict_cov_work( ws->n_x, ws->F, V, P, ws->work );
+    return i;
+}
+
+AA_API int rfx_lqg_ekf_correct_work
+( rfx_lqg_ekf_ws_t *ws, void *cx, double *x, const double *z, double *P, const double *W,
+  rfx_lqg_ekf_measure_fun measure, rfx_lqg_ekf_innovate_fun innovate, rfx_lqg_ekf_update_fun update )
+{
+    size_t n_x = ws->n_x, n_z = ws->n_z;
+    int i;
+
+    i = measure(cx, x, ws->y, ws->H);
+    if(i) return i;
+
+    i = kf_correct_gain_work( n_x, n_z, ws->H, P, W, ws->K, ws->work );
+    if(i) return i;
+
+    i = innovate(cx, x, z, ws->y);
+    if(i) return i;
+
+    cblas_dgemv( CblasColMajor, CblasNoTrans,
+                 (int)n_x, (int)n_z,
+                 1.0, ws->K, (int)n_x,
+                 ws->y, 1,
+                 0.0, ws->Ky, 1 );
+
+    i = update(cx, x, ws->Ky);
+
+    kf_correct_cov_work( n_x, n_z, ws->H, P, ws->K, ws->work );
+
+    return i;
+}
+
 
 
 
@@ -224,6 +318,9 @@ AA_API void rfx_lqg_init( rfx_lqg_t *lqg, size_t n_x, size_t n_u, size_t n_z ) {
     lqg->P = AA_NEW0_AR( double, lqg->n_x * lqg->n_x );
     lqg->V = AA_NEW0_AR( double, lqg->n_x * lqg->n_x );
     lqg->W = AA_NEW0_AR( double, lqg->n_z * lqg->n_z );
+    lqg->S = AA_NEW0_AR( double, lqg->n_x * lqg->n_x );
+    lqg->Sv = AA_NEW0_AR( double, lqg->n_x * lqg->n_x );
+    lqg->Sw = AA_NEW0_AR( double, lqg->n_z * lqg->n_z );
 
     lqg->Q = AA_NEW0_AR( double, lqg->n_x * lqg->n_x );
     lqg->R = AA_NEW0_AR( double, lqg->n_u * lqg->n_u );
@@ -242,6 +339,10 @@ AA_API void rfx_lqg_destroy( rfx_lqg_t *lqg ) {
     free(lqg->B);
     free(lqg->C);
 
+    free(lqg->S);
+    free(lqg->Sv);
+    free(lqg->Sw);
+
     free(lqg->Q);
     free(lqg->R);
 
@@ -322,10 +423,11 @@ AA_API void rfx_lqg_kf_predict( rfx_lqg_t *lqg ) {
     rfx_lqg_kf_predict_cov( lqg->n_x, lqg->A, lqg->V, lqg->P );
 }
 
-AA_API void rfx_lqg_kf_correct( rfx_lqg_t *lqg ) {
+AA_API int rfx_lqg_kf_correct( rfx_lqg_t *lqg ) {
 
-    rfx_lqg_kf_correct_gain( lqg->n_x, lqg->n_z,
-                             lqg->C, lqg->P, lqg->W, lqg->K );
+    int i = rfx_lqg_kf_correct_gain( lqg->n_x, lqg->n_z,
+                                     lqg->C, lqg->P, lqg->W, lqg->K );
+    if( i ) return i;
 
     // x = x + K * (z - C*x)
     kf_innovate( lqg, lqg->x );
@@ -333,6 +435,7 @@ AA_API void rfx_lqg_kf_correct( rfx_lqg_t *lqg ) {
     // P = (I - K*C) * P
     rfx_lqg_kf_correct_cov( lqg->n_x, lqg->n_z,
                             lqg->C, lqg->P, lqg->K );
+    return 0;
 }
 
 // kalman-bucy gain
@@ -0,0 +1,194 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <amino.h>
+#include <cblas.h>
+#include "reflex.h"
+
+AA_API void rfx_lqg_seq_init( rfx_lqg_seq_t *seq, size_t n_x, size_t n_z, const double *W )
+{
+    memset( seq, 0, sizeof(*seq) );
+    seq->n_x = n_x;
+    seq->n_z = n_z;
+
+    seq->W = AA_NEW0_AR( double, 2*n_z*n_z + n_z*n_x + n_z + n_x );
+    seq->U = seq->W + n_z*n_z;
+    seq->Cw = seq->U + n_z*n_z;
+    seq->zw = seq->Cw + n_z*n_x;
+    seq->Pc = seq->zw + n_z;
+
+    seq->idx = AA_NEW0_AR( size_t, n_z );
+    seq->mask = AA_NEW0_AR( uint8_t, n_z );
+
+    rfx_lqg_seq_set_noise( seq, W );
+}
+
+AA_API void rfx_lqg_seq_destroy( rfx_lqg_seq_t *seq )
+{
+    free( seq->W );
+    free( seq->idx );
+    free( seq->mask );
+    memset( seq, 0, sizeof(*seq) );
+}
+
+AA_API void rfx_lqg_seq_set_noise( rfx_lqg_seq_t *seq, const double *W )
+{
+    size_t n_z = seq->n_z;
+    seq->diag = 1;
+    for( size_t j = 0; j < n_z; j ++ ) {
+        for( size_t i = 0; i <= j; i ++ ) {
+            double w = AA_MATREF(W, n_z, i, j);
+            AA_MATREF(seq->W, n_z, i, j) = w;
+            AA_MATREF(seq->W, n_z, j, i) = w;
+            if( i != j && 0 != w ) seq->diag = 0;
+        }
+    }
+    seq->cached = 0;
+}
+
+AA_API int rfx_lqg_kf_correct_scalar
+( size_t n_x, const double *c, size_t inc_c, double w, double z,
+  double *x, double *P, double *Pc )
+{
+    int ni = (int)n_x, inc = (int)inc_c;
+
+    // Pc := P * c**T
+    cblas_dsymv( CblasColMajor, CblasUpper, ni,
+                 1.0, P, ni,
+                 c, inc,
+                 0.0, Pc, 1 );
+
+    // s := c * P * c**T + w
+    double s = cblas_ddot( ni, c, inc, Pc, 1 ) + w;
+    if( ! (s > 0) ) return -1;
+
+    // x := x + P*c**T * (z - c*x) / s
+    double r = z - cblas_ddot( ni, c, inc, x, 1 );
+    cblas_daxpy( ni, r/s, Pc, 1, x, 1 );
+
+    // P := P - P*c**T * c*P / s
+    cblas_dsyr( CblasColMajor, CblasUpper, ni,
+                -1.0/s, Pc, 1,
+                P, ni );
+    return 0;
+}
+
+/* Factor W over the valid measurements, U**T * U = W(idx,idx). */
+static int seq_factor( rfx_lqg_seq_t *seq, const uint8_t *mask )
+{
+    size_t n_z = seq->n_z;
+    size_t m = 0;
+    for( size_t i = 0; i < n_z; i ++ ) {
+        seq->mask[i] = (uint8_t)(mask ? (mask[i] != 0) : 1);
+        if( seq->mask[i] ) seq->idx[m++] = i;
+    }
+    seq->n_valid = m;
+
+    for( size_t j = 0; j < m; j ++ )
+        for( size_t i = 0; i <= j; i ++ )
+            AA_MATREF(seq->U, m, i, j) = AA_MATREF(seq->W, n_z, seq->idx[i], seq->idx[j]);
+
+    int info = 0;
+    if( m > 0 ) {
+        int mi = (int)m;
+        dpotrf_( "U", &mi, seq->U, &mi, &info );
+    }
+    seq->cached = (0 == info);
+    return info ? -1 : 0;
+}
+
+static int seq_mask_changed( const rfx_lqg_seq_t *seq, const uint8_t *mask )
+{
+    if( ! seq->cached ) return 1;
+    for( size_t i = 0; i < seq->n_z; i ++ ) {
+        if( seq->mask[i] != (mask ? (mask[i] != 0) : 1) ) return 1;
+    }
+    return 0;
+}
+
+AA_API int rfx_lqg_seq_correct
+( rfx_lqg_seq_t *seq, const double *C, const double *z, const uint8_t *mask,
+  double *x, double *P )
+{
+    size_t n_x = seq->n_x, n_z = seq->n_z;
+    int n_skip = 0;
+
+    // Uncorrelated: update directly from the rows of C
+    if( seq->diag ) {
+        for( size_t i = 0; i < n_z; i ++ ) {
+            if( mask && !mask[i] ) continue;
+            if( rfx_lqg_kf_correct_scalar( n_x, C+i, n_z, AA_MATREF(seq->W, n_z, i, i), z[i],
+                                           x, P, seq->Pc ) )
+                n_skip++;
+        }
+        return n_skip;
+    }
+
+    // Correlated: whiten the valid measurements, W(idx,idx) -> I
+    if( seq_mask_changed(seq, mask) && seq_factor(seq, mask) )
+        return -1;
+
+    size_t m = seq->n_valid;
+    if( 0 == m ) return 0;
+    for( size_t k = 0; k < m; k ++ ) {
+        size_t i = seq->idx[k];
+        seq->zw[k] = z[i];
+        for( size_t j = 0; j < n_x; j ++ )
+            AA_MATREF(seq->Cw, m, k, j) = AA_MATREF(C, n_z, i, j);
+    }
+
+    // Cw := U**-T * C(idx,:), zw := U**-T * z(idx)
+    cblas_dtrsm( CblasColMajor, CblasLeft, CblasUpper, CblasTrans, CblasNonUnit,
+                 (int)m, (int)n_x,
+                 1.0, seq->U, (int)m,
+                 seq->Cw, (int)m );
+    cblas_dtrsv( CblasColMajor, CblasUpper, CblasTrans, CblasNonUnit,
+                 (int)m, seq->U, (int)m,
+                 seq->zw, 1 );
+
+    for( size_t k = 0; k < m; k ++ ) {
+        if( rfx_lqg_kf_correct_scalar( n_x, seq->Cw+k, m, 1.0, seq->zw[k],
+                                       x, P, seq->Pc ) )
+            n_skip++;
+    }
+    return n_skip;
+}
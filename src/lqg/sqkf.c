@@ -0,0 +1,313 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <float.h>
+#include <amino.h>
+#include <cblas.h>
+#include "reflex.h"
+
+/* Work size for dgeqrf_, generous enough for a blocked factorization
+ * of the small pre-arrays used here. */
+#define QR_LWORK(n) (64*(n))
+
+AA_API int rfx_lqg_sqrt_factor( size_t n, const double *A, double *U )
+{
+    int ni = (int)n;
+    int info;
+
+    // Cholesky in the common positive definite case
+    dlacpy_( "U", &ni, &ni, A, &ni, U, &ni );
+    dpotrf_( "U", &ni, U, &ni, &info );
+    if( 0 == info ) {
+        for( size_t j = 0; j < n; j ++ )
+            for( size_t i = j+1; i < n; i ++ )
+                AA_MATREF(U, n, i, j) = 0;
+        return 0;
+    }
+
+    // Semidefinite: A = Q*diag(w)*Q**T, U = diag(sqrt(w))*Q**T
+    double *ptr = (double*)aa_mem_region_local_alloc( sizeof(double) * (n*n + n + QR_LWORK(n)) );
+    double *Q = ptr;
+    double *w = Q + n*n;
+    double *work = w + n;
+    int lwork = (int)QR_LWORK(n);
+
+    dlacpy_( "U", &ni, &ni, A, &ni, Q, &ni );
+    dsyev_( "V", "U", &ni, Q, &ni, w, work, &lwork, &info );
+    if( info ) {
+        aa_mem_region_local_pop( ptr );
+        return -1;
+    }
+    for( size_t i = 0; i < n; i ++ ) {
+        double s = (w[i] > 0) ? sqrt(w[i]) : 0;
+        for( size_t j = 0; j < n; j ++ )
+            AA_MATREF(U, n, i, j) = s * AA_MATREF(Q, n, j, i);
+    }
+
+    aa_mem_region_local_pop( ptr );
+    return 1;
+}
+
+/* Copy the upper triangle of the n*n leading block of R (leading
+ * dimension ldr) to S, zeroing the lower triangle, with rows negated
+ * as needed for a nonnegative diagonal. */
+static void qr_factor_out( size_t n, const double *R, size_t ldr, double *S )
+{
+    for( size_t j = 0; j < n; j ++ ) {
+        for( size_t i = 0; i <= j; i ++ ) {
+            double r = AA_MATREF(R, ldr, i, j);
+            AA_MATREF(S, n, i, j) = (AA_MATREF(R, ldr, i, i) < 0) ? -r : r;
+        }
+        for( size_t i = j+1; i < n; i ++ )
+            AA_MATREF(S, n, i, j) = 0;
+    }
+}
+
+AA_API int rfx_lqg_sqkf_predict_cov
+( size_t n, const double *A, const double *Sv, double *S )
+{
+    // M = [ S*A**T ]   QR(M) = [ S1 ]
+    //     [   Sv   ]           [ 0  ]
+    size_t m = 2*n;
+    int ni = (int)n, mi = (int)m;
+    int lwork = (int)QR_LWORK(n);
+    int info;
+
+    double *M = (double*)aa_mem_region_local_alloc( sizeof(double) * (m*n + n + QR_LWORK(n)) );
+    double *tau = M + m*n;
+    double *work = tau + n;
+
+    cblas_dgemm( CblasColMajor, CblasNoTrans, CblasTrans,
+                 ni, ni, ni,
+                 1.0, S, ni,
+                 A, ni,
+                 0.0, M, mi );
+    dlacpy_( "A", &ni, &ni, Sv, &ni, M+n, &mi );
+
+    dgeqrf_( &mi, &ni, M, &mi, tau, work, &lwork, &info );
+    if( 0 == info ) qr_factor_out( n, M, m, S );
+
+    aa_mem_region_local_pop( M );
+    return info;
+}
+
+AA_API int rfx_lqg_sqkf_correct_cov
+( size_t n_x, size_t n_z, const double *C, const double *Sw, double *S, double *K )
+{
+    // M = [ Sw     0 ]   QR(M) = [ R11  R12 ]
+    //     [ S*C**T S ]           [ 0    S1  ]
+    //
+    // R11**T * R11 = C*P*C**T + W
+    // R11**T * R12 = C*P
+    // S1**T * S1   = P - R12**T * R12 = (I - K*C)*P
+    // K            = R12**T * R11**-T
+    size_t m = n_x + n_z;
+    int mi = (int)m, nxi = (int)n_x, nzi = (int)n_z;
+    int lwork = (int)QR_LWORK(m);
+    int info;
+    int r = 0;
+
+    double *M = (double*)aa_mem_region_local_alloc( sizeof(double) * (m*m + m + QR_LWORK(m)) );
+    double *tau = M + m*m;
+    double *work = tau + m;
+
+    double *M11 = M;
+    double *M21 = M + n_z;
+    double *M12 = M + m*n_z;
+    double *M22 = M12 + n_z;
+
+    dlacpy_( "A", &nzi, &nzi, Sw, &nzi, M11, &mi );
+    cblas_dgemm( CblasColMajor, CblasNoTrans, CblasTrans,
+                 nxi, nzi, nxi,
+                 1.0, S, nxi,
+                 C, nzi,
+                 0.0, M21, mi );
+    for( size_t j = 0; j < n_x; j ++ )
+        for( size_t i = 0; i < n_z; i ++ )
+            AA_MATREF(M12, m, i, j) = 0;
+    dlacpy_( "A", &nxi, &nxi, S, &nxi, M22, &mi );
+
+    dgeqrf_( &mi, &mi, M, &mi, tau, work, &lwork, &info );
+    if( info ) {
+        r = info;
+        goto END;
+    }
+
+    // innovation covariance must be nonsingular
+    double d_max = 0;
+    for( size_t i = 0; i < n_z; i ++ )
+        d_max = AA_MAX( d_max, fabs(AA_MATREF(M11, m, i, i)) );
+    for( size_t i = 0; i < n_z; i ++ ) {
+        if( ! (fabs(AA_MATREF(M11, m, i, i)) > d_max * DBL_EPSILON * (double)m) ) {
+            r = -1;
+            goto END;
+        }
+    }
+
+    // R12 := R11**-1 * R12 = K**T
+    cblas_dtrsm( CblasColMajor, CblasLeft, CblasUpper, CblasNoTrans, CblasNonUnit,
+                 nzi, nxi,
+                 1.0, M11, mi,
+                 M12, mi );
+    for( size_t j = 0; j < n_z; j ++ )
+        for( size_t i = 0; i < n_x; i ++ )
+            AA_MATREF(K, n_x, i, j) = AA_MATREF(M12, m, j, i);
+
+    qr_factor_out( n_x, M22, m, S );
+
+END:
+    aa_mem_region_local_pop( M );
+    return r;
+}
+
+/*-- EKF Drivers --*/
+
+AA_API int rfx_lqg_sqekf_predict
+( void *cx, size_t n_x, double *x, const double *u, double *S, const double *Sv,
+  rfx_lqg_ekf_process_fun process )
+{
+    double F[n_x*n_x];
+    int i = process( cx, x, u, F );
+    int j = rfx_lqg_sqkf_predict_cov( n_x, F, Sv, S );
+    return i ? i : j;
+}
+
+AA_API int rfx_lqg_sqekf_correct
+( void *cx, size_t n_x, size_t n_z, double *x, const double *z, double *S, const double *Sw,
+  rfx_lqg_ekf_measure_fun measure, rfx_lqg_ekf_innovate_fun innovate, rfx_lqg_ekf_update_fun update )
+{
+    int i;
+
+    double y[n_z];
+    double H[n_z*n_x];
+    i = measure(cx, x, y, H);
+    if(i) return i;
+
+    // gain and factor update are computed together, so innovate
+    // before committing the new factor
+    double K[n_x*n_z];
+    double S1[n_x*n_x];
+    memcpy( S1, S, sizeof(S1) );
+    i = rfx_lqg_sqkf_correct_cov( n_x, n_z, H, Sw, S1, K );
+    if(i) return i;
+
+    i = innovate(cx, x, z, y);
+    if(i) return i;
+
+    double Ky[n_x];
+    cblas_dgemv( CblasColMajor, CblasNoTrans,
+                 (int)n_x, (int)n_z,
+                 1.0, K, (int)n_x,
+                 y, 1,
+                 0.0, Ky, 1 );
+
+    i = update(cx, x, Ky);
+
+    memcpy( S, S1, sizeof(S1) );
+
+    return i;
+}
+
+/*-- LQG Struct --*/
+
+AA_API int rfx_lqg_sqkf_init( rfx_lqg_t *lqg )
+{
+    int i = rfx_lqg_sqrt_factor( lqg->n_x, lqg->P, lqg->S );
+    if( i < 0 ) return i;
+    int j = rfx_lqg_sqrt_factor( lqg->n_x, lqg->V, lqg->Sv );
+    if( j < 0 ) return j;
+    j = rfx_lqg_sqrt_factor( lqg->n_z, lqg->W, lqg->Sw );
+    if( j < 0 ) return j;
+    return i;
+}
+
+AA_API int rfx_lqg_sqkf_predict( rfx_lqg_t *lqg )
+{
+    size_t n_x = lqg->n_x;
+
+    // x = A*x + B*u
+    double x[n_x];
+    aa_lsim_dstep( n_x, lqg->n_u,
+                   lqg->A, lqg->B,
+                   lqg->x, lqg->u,
+                   x );
+    memcpy( lqg->x, x, sizeof(x) );
+
+    // S**T*S = A * S**T*S * A**T + V
+    return rfx_lqg_sqkf_predict_cov( n_x, lqg->A, lqg->Sv, lqg->S );
+}
+
+AA_API int rfx_lqg_sqkf_correct( rfx_lqg_t *lqg )
+{
+    size_t n_x = lqg->n_x, n_z = lqg->n_z;
+
+    int i = rfx_lqg_sqkf_correct_cov( n_x, n_z, lqg->C, lqg->Sw, lqg->S, lqg->K );
+    if( i ) return i;
+
+    // x = x + K * (z - C*x)
+    double r[n_z];
+    memcpy( r, lqg->z, sizeof(r) );
+    cblas_dgemv( CblasColMajor, CblasNoTrans,
+                 (int)n_z, (int)n_x,
+                 -1.0, lqg->C, (int)n_z,
+                 lqg->x, 1,
+                 1.0, r, 1 );
+    cblas_dgemv( CblasColMajor, CblasNoTrans,
+                 (int)n_x, (int)n_z,
+                 1.0, lqg->K, (int)n_x,
+                 r, 1,
+                 1.0, lqg->x, 1 );
+    return 0;
+}
+
+AA_API void rfx_lqg_sqkf_cov( rfx_lqg_t *lqg )
+{
+    int ni = (int)lqg->n_x;
+    cblas_dsyrk( CblasColMajor, CblasUpper, CblasTrans,
+                 ni, ni,
+                 1.0, lqg->S, ni,
+                 0.0, lqg->P, ni );
+    // fill lower triangle for callers reading the full matrix
+    for( size_t j = 0; j < lqg->n_x; j ++ )
+        for( size_t i = j+1; i < lqg->n_x; i ++ )
+            AA_MATREF(lqg->P, lqg->n_x, i, j) = AA_MATREF(lqg->P, lqg->n_x, j, i);
+}
@@ -0,0 +1,123 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <time.h>
+#include <amino.h>
+#include "reflex.h"
+
+/* Compare the rotation median engines on synthetic calibration data.
+ *
+ * Usage: bench-qmedian [n_samples] [n_threads] [n_repeat]
+ */
+
+static double now( void )
+{
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return (double)t.tv_sec + 1e-9 * (double)t.tv_nsec;
+}
+
+int main( int argc, char **argv )
+{
+    size_t n = (argc > 1) ? (size_t)atol(argv[1]) : 2000;
+    size_t n_thread = (argc > 2) ? (size_t)atol(argv[2]) : 0;
+    size_t n_rep = (argc > 3) ? (size_t)atol(argv[3]) : 5;
+
+    // samples about q0: small noise, every tenth sample an outlier,
+    // and mixed quaternion signs
+    double q0[4];
+    {
+        double e0[7];
+        rfx_tf_rand( M_PI, 1, e0 );
+        AA_MEM_CPY( q0, e0, 4 );
+    }
+    double *Q = AA_NEW_AR( double, 4*n );
+    for( size_t i = 0; i < n; i ++ ) {
+        double e[7];
+        rfx_tf_rand( (i % 10) ? 0.02 : M_PI, 0, e );
+        double *q = AA_MATCOL(Q, 4, i);
+        aa_tf_qmul( q0, e, q );
+        if( i % 3 ) for( size_t k = 0; k < 4; k ++ ) q[k] = -q[k];
+    }
+
+    rfx_tpool_t pool;
+    if( rfx_tpool_init( &pool, n_thread ) ) {
+        fprintf( stderr, "Couldn't create thread pool\n" );
+        return -1;
+    }
+
+    double p[4][4];
+    double t[4] = {0};
+    size_t n_iter = 0;
+    for( size_t r = 0; r < n_rep; r ++ ) {
+        double t0 = now();
+        rfx_tf_qangmedian( n, Q, 4, p[0] );
+        double t1 = now();
+        rfx_tf_qangmedian_blocked( n, Q, 4, NULL, p[1] );
+        double t2 = now();
+        rfx_tf_qangmedian_blocked( n, Q, 4, &pool, p[2] );
+        double t3 = now();
+        n_iter = rfx_tf_qwmedian( n, Q, 4, 1e-9, 100, p[3] );
+        double t4 = now();
+        t[0] += t1 - t0;
+        t[1] += t2 - t1;
+        t[2] += t3 - t2;
+        t[3] += t4 - t3;
+    }
+
+    const char *name[4] = {"reference", "blocked", "blocked-pool", "weiszfeld"};
+    printf( "samples: %lu, threads: %lu, repeat: %lu\n",
+            n, pool.n_thread, n_rep );
+    printf( "%-14s %12s %12s %12s\n", "engine", "time (ms)", "d_ref", "d_true" );
+    for( size_t k = 0; k < 4; k ++ ) {
+        printf( "%-14s %12.3f %12.3e %12.3e\n", name[k],
+                1e3 * t[k] / (double)n_rep,
+                aa_tf_qangle_rel( p[0], p[k] ),
+                aa_tf_qangle_rel( q0, p[k] ) );
+    }
+    printf( "weiszfeld iterations: %lu\n", n_iter );
+
+    rfx_tpool_destroy( &pool );
+    free( Q );
+    return 0;
+}
@@ -0,0 +1,155 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <amino.h>
+#include <math.h>
+#include "reflex.h"
+
+/*
+ * Check rfx_tf_cor_ransac() on correspondences with gross outliers.
+ *
+ * For RANSAC and LMedS scoring, the inlier mask must match the
+ * outliers that were injected, the fit must be close to the true
+ * transform, and the result must be the same with and without a
+ * thread pool.  rfx_tf_cor() with RFX_TF_COR_O_RANSAC must match
+ * LMedS scoring.
+ */
+
+#define N_SAMPLE 2000
+#define OUTLIER_FRAC 0.3
+#define N_THREAD 4
+#define THRESHOLD 2e-2
+#define CONFIDENCE 0.999
+#define MAX_ITER 4096
+#define OPTS (RFX_TF_COR_O_ROT_DAVENPORT | RFX_TF_COR_O_TRANS_MEAN)
+#define TOL 1e-3
+
+static double rnd( void ) {
+    return 2*drand48() - 1;
+}
+
+/* Random transform, rotation up to theta, translation up to x */
+static void rand_tf( double theta, double x, double E[7] ) {
+    double r[3] = {theta*rnd(), theta*rnd(), theta*rnd()};
+    aa_tf_rotvec2quat( r, E );
+    for( size_t k = 0; k < 3; k ++ ) E[4+k] = x*rnd();
+}
+
+/* Larger of the rotation and translation errors */
+static double tf_err( const double Z[7], const double Z_ref[7] ) {
+    return fmax( aa_tf_qangle_rel( Z, Z_ref ), sqrt(aa_la_ssd( 3, Z+4, Z_ref+4 )) );
+}
+
+static int check( const char *name, rfx_tpool_t *pool, double threshold,
+                  const double *X, const double *Y, const uint8_t *outlier,
+                  const double Z_true[7], double Z[7] )
+{
+    uint8_t inlier[N_SAMPLE];
+    size_t n_in = rfx_tf_cor_ransac( OPTS, pool, N_SAMPLE, X, 7, X+4, 7, Y, 7, Y+4, 7,
+                                     threshold, CONFIDENCE, MAX_ITER, inlier, Z );
+    size_t n_wrong = 0;
+    for( size_t i = 0; i < N_SAMPLE; i ++ )
+        n_wrong += ( !inlier[i] != !!outlier[i] );
+    double e = tf_err( Z, Z_true );
+
+    printf( "%-16s inliers: %zu, misclassified: %zu, error: %g\n", name, n_in, n_wrong, e );
+    if( n_wrong || e > TOL ) {
+        fprintf( stderr, "FAIL: %s\n", name );
+        return 1;
+    }
+    return 0;
+}
+
+int main( void ) {
+    srand48( 24 );
+
+    // X = Z * Y * noise, with gross outliers
+    double Z_true[7];
+    rand_tf( 1, 1, Z_true );
+    double X[7*N_SAMPLE], Y[7*N_SAMPLE];
+    uint8_t outlier[N_SAMPLE];
+    for( size_t i = 0; i < N_SAMPLE; i ++ ) {
+        double *x = AA_MATCOL(X,7,i), *y = AA_MATCOL(Y,7,i);
+        double ZY[7], e[7];
+        rand_tf( 1, 1, y );
+        aa_tf_qutr_mul( Z_true, y, ZY );
+        rand_tf( 1e-3, 1e-3, e );
+        outlier[i] = drand48() < OUTLIER_FRAC;
+        if( outlier[i] ) {
+            rand_tf( 0.5, 0, e );
+            for( size_t k = 0; k < 3; k ++ ) e[4+k] = (rnd() < 0 ? -1 : 1) * (0.2 + 0.8*drand48());
+        }
+        aa_tf_qutr_mul( ZY, e, x );
+    }
+
+    double Z_plain[7];
+    rfx_tf_cor( OPTS, N_SAMPLE, X, 7, X+4, 7, Y, 7, Y+4, 7, Z_plain );
+    printf( "%-16s error: %g\n", "plain fit", tf_err( Z_plain, Z_true ) );
+
+    rfx_tpool_t pool;
+    if( rfx_tpool_init( &pool, N_THREAD ) ) {
+        fprintf( stderr, "FAIL: pool init\n" );
+        return 1;
+    }
+
+    int r = 0;
+    double Z_lm[7], Z_lm_pool[7], Z_rs[7], Z_rs_pool[7], Z_opt[7];
+    r |= check( "lmeds", NULL, 0, X, Y, outlier, Z_true, Z_lm );
+    r |= check( "lmeds, pool", &pool, 0, X, Y, outlier, Z_true, Z_lm_pool );
+    r |= check( "ransac", NULL, THRESHOLD, X, Y, outlier, Z_true, Z_rs );
+    r |= check( "ransac, pool", &pool, THRESHOLD, X, Y, outlier, Z_true, Z_rs_pool );
+    rfx_tpool_destroy( &pool );
+
+    if( memcmp( Z_lm, Z_lm_pool, sizeof(Z_lm) ) ||
+        memcmp( Z_rs, Z_rs_pool, sizeof(Z_rs) ) )
+    {
+        fprintf( stderr, "FAIL: result depends on the thread pool\n" );
+        r = 1;
+    }
+
+    rfx_tf_cor( OPTS | RFX_TF_COR_O_RANSAC, N_SAMPLE, X, 7, X+4, 7, Y, 7, Y+4, 7, Z_opt );
+    if( memcmp( Z_lm, Z_opt, sizeof(Z_lm) ) ) {
+        fprintf( stderr, "FAIL: RFX_TF_COR_O_RANSAC differs from LMedS\n" );
+        r = 1;
+    }
+
+    return r;
+}
@@ -0,0 +1,154 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <amino.h>
+#include <math.h>
+#include "reflex.h"
+
+/*
+ * Compare rfx_tf_cor_stream_fit() against rfx_tf_cor() on the same
+ * samples.  All samples are added to the stream, then the first half
+ * is removed, and the batch fit is computed over the second half.
+ *
+ * Samples are far from the origin, one in four has a negated
+ * quaternion, and one in ten has a translation outlier.  The
+ * rotation fits and the translation mean are exact up to rounding.
+ * The translation median is exact while the samples are buffered,
+ * and within the histogram resolution once they are binned.
+ */
+
+#define N_SAMPLE 5000
+#define N_BIN 1000
+#define BIN_WIDTH 1e-4
+#define N_WARM 256
+#define TOL 1e-9
+#define TOL_HIST (2*BIN_WIDTH)
+
+static double rnd( void ) {
+    return 2*drand48() - 1;
+}
+
+/* Random transform, rotation up to theta, translation up to x about x0 */
+static void rand_tf( double theta, double x0, double x, double E[7] ) {
+    double r[3] = {theta*rnd(), theta*rnd(), theta*rnd()};
+    aa_tf_rotvec2quat( r, E );
+    for( size_t k = 0; k < 3; k ++ ) E[4+k] = x0 + x*rnd();
+}
+
+/* Fit the stream over samples [n/2,n) and compare to the batch fit */
+static int check( const char *name, int opts, size_t n_warm, double tol_x,
+                  size_t n, const double *S, size_t lds )
+{
+    rfx_tf_cor_stream_t st;
+    if( rfx_tf_cor_stream_init( &st, opts, N_BIN, BIN_WIDTH, n_warm ) ) {
+        fprintf( stderr, "FAIL: %s, stream init\n", name );
+        return 1;
+    }
+    for( size_t i = 0; i < n; i ++ ) {
+        const double *s = AA_MATCOL(S,lds,i);
+        rfx_tf_cor_stream_add( &st, s, s+4, s+7, s+11 );
+    }
+    for( size_t i = 0; i < n/2; i ++ ) {
+        const double *s = AA_MATCOL(S,lds,i);
+        rfx_tf_cor_stream_remove( &st, s, s+4, s+7, s+11 );
+    }
+
+    double Z_s[7], Z_b[7];
+    int r = rfx_tf_cor_stream_fit( &st, Z_s );
+    rfx_tf_cor_stream_destroy( &st );
+    if( r ) {
+        fprintf( stderr, "FAIL: %s, stream fit\n", name );
+        return 1;
+    }
+
+    const double *W = AA_MATCOL(S,lds,n/2);
+    rfx_tf_cor( opts, n - n/2, W, lds, W+4, lds, W+7, lds, W+11, lds, Z_b );
+
+    double e_q = aa_tf_qangle_rel( Z_s, Z_b );
+    double e_x = 0;
+    for( size_t k = 0; k < 3; k ++ ) e_x = fmax( e_x, fabs(Z_s[4+k] - Z_b[4+k]) );
+
+    printf( "%-28s rotation error: %g, translation error: %g\n", name, e_q, e_x );
+    if( e_q > TOL || e_x > tol_x ) {
+        fprintf( stderr, "FAIL: %s differs from rfx_tf_cor()\n", name );
+        return 1;
+    }
+    return 0;
+}
+
+int main( void ) {
+    srand48( 22 );
+
+    // samples: qx, vx, qy, vy with X = Z * Y * noise
+    double Z[7];
+    rand_tf( 1, 0, 2, Z );
+    size_t lds = 14;
+    double *S = AA_NEW_AR( double, lds*N_SAMPLE );
+    for( size_t i = 0; i < N_SAMPLE; i ++ ) {
+        double *s = AA_MATCOL(S,lds,i);
+        double X[7], Y[7], ZY[7], e[7];
+        rand_tf( 2, 10, 3, Y );
+        rand_tf( 1e-2, 0, 5e-3, e );
+        aa_tf_qutr_mul( Z, Y, ZY );
+        aa_tf_qutr_mul( ZY, e, X );
+        if( 0 == i % 4 ) for( size_t k = 0; k < 4; k ++ ) X[k] = -X[k];
+        if( 0 == i % 10 ) X[4] += 0.5;
+        AA_MEM_CPY( s, X, 7 );
+        AA_MEM_CPY( s+7, Y, 7 );
+    }
+
+    int r = 0;
+    r |= check( "davenport, mean", RFX_TF_COR_O_ROT_DAVENPORT | RFX_TF_COR_O_TRANS_MEAN,
+                N_WARM, TOL, N_SAMPLE, S, lds );
+    r |= check( "umeyama, mean", RFX_TF_COR_O_ROT_UMEYAMA | RFX_TF_COR_O_TRANS_MEAN,
+                N_WARM, TOL, N_SAMPLE, S, lds );
+    r |= check( "umeyama+davenport, mean",
+                RFX_TF_COR_O_ROT_UMEYAMA | RFX_TF_COR_O_ROT_DAVENPORT | RFX_TF_COR_O_TRANS_MEAN,
+                N_WARM, TOL, N_SAMPLE, S, lds );
+    r |= check( "davenport, median", RFX_TF_COR_O_ROT_DAVENPORT | RFX_TF_COR_O_TRANS_MEDIAN,
+                N_WARM, TOL_HIST, N_SAMPLE, S, lds );
+    r |= check( "davenport, median, buffered",
+                RFX_TF_COR_O_ROT_DAVENPORT | RFX_TF_COR_O_TRANS_MEDIAN,
+                N_SAMPLE+1, TOL, N_SAMPLE, S, lds );
+
+    free( S );
+    return r;
+}
@@ -0,0 +1,170 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <amino.h>
+#include <math.h>
+#include "reflex.h"
+
+/*
+ * Compare the RFX_CTRL_PINV_CHOL6 deadzone solve, single and
+ * batched, against the RFX_CTRL_PINV_SVD solve for jacobians with
+ * zero to three singular values near or below the deadzone,
+ * including exact singularities.
+ */
+
+#define N_Q 7
+#define N_ARM 4
+#define N_TRIAL 4000
+#define S2MIN 1e-2
+#define TOL 1e-9
+
+static double rnd( void ) {
+    return 2*drand48() - 1;
+}
+
+/* Random jacobian with the n_sing smallest singular values replaced */
+static void jacobian( size_t n_sing, int exact, double *J ) {
+    double A[6*N_Q], s[6], U[36], Vt[6*N_Q], work[512];
+    int m = 6, n = N_Q, r = 6, lwork = 512, info;
+    for( size_t i = 0; i < 6*N_Q; i ++ ) J[i] = A[i] = rnd();
+    dgesvd_( "S", "S", &m, &n, A, &m, s, U, &m, Vt, &r, work, &lwork, &info );
+    if( info ) abort();
+    for( size_t k = 0; k < n_sing; k ++ ) s[5-k] = pow( 10, -0.5 - 4*drand48() );
+    if( exact && n_sing ) s[5] = 0;
+    for( size_t j = 0; j < N_Q; j ++ ) {
+        for( size_t i = 0; i < 6; i ++ ) {
+            double a = 0;
+            for( size_t k = 0; k < 6; k ++ ) a += AA_MATREF(U,6,i,k) * s[k] * AA_MATREF(Vt,6,k,j);
+            AA_MATREF(J,6,i,j) = a;
+        }
+    }
+}
+
+static double rel_err( const double *u, const double *u_ref ) {
+    double e = 0, n = 0;
+    for( size_t j = 0; j < N_Q; j ++ ) {
+        e += (u[j] - u_ref[j]) * (u[j] - u_ref[j]);
+        n += u_ref[j] * u_ref[j];
+    }
+    return sqrt( e / n );
+}
+
+int main( void ) {
+    srand48( 42 );
+
+    rfx_ctrl_ws_t ws[N_ARM];
+    rfx_ctrl_ws_lin_k_t k[N_ARM];
+    const rfx_ctrl_ws_t *pws[N_ARM];
+    const rfx_ctrl_ws_lin_k_t *pk[N_ARM];
+    double u_buf[N_ARM][N_Q];
+    double *pu[N_ARM];
+    rfx_status_t r[N_ARM];
+    rfx_ctrl_ws_batch_t batch;
+    rfx_ctrl_ws_batch_init( &batch, N_ARM, N_Q );
+
+    for( size_t a = 0; a < N_ARM; a ++ ) {
+        rfx_ctrl_ws_init( &ws[a], N_Q );
+        rfx_ctrl_ws_lin_k_init( &k[a], N_Q );
+        for( size_t i = 0; i < N_Q; i ++ ) {
+            ws[a].q_min[i] = -10;
+            ws[a].q_max[i] = 10;
+        }
+        for( size_t i = 0; i < 3; i ++ ) {
+            ws[a].x_min[i] = -10;
+            ws[a].x_max[i] = 10;
+        }
+        k[a].s2min = S2MIN;
+        pws[a] = &ws[a];
+        pk[a] = &k[a];
+        pu[a] = u_buf[a];
+    }
+
+    double worst = 0, worst_batch = 0;
+    for( size_t t = 0; t < N_TRIAL; t ++ ) {
+        for( size_t a = 0; a < N_ARM; a ++ ) {
+            jacobian( (t + a) % 4, 0 == (t+a) % 7, ws[a].J );
+            for( size_t i = 0; i < 6; i ++ ) ws[a].ref.dx[i] = rnd();
+            for( size_t i = 0; i < N_Q; i ++ ) {
+                ws[a].act.q[i] = rnd();
+                ws[a].ref.q[i] = rnd();
+                k[a].q[i] = drand48();
+            }
+
+            double u_svd[N_Q], u_chol[N_Q];
+            k[a].pinv = RFX_CTRL_PINV_SVD;
+            rfx_status_t r_svd = rfx_ctrl_ws_lin_vfwd_work( &ws[a], &k[a], ws[a].work, u_svd );
+            k[a].pinv = RFX_CTRL_PINV_CHOL6;
+            rfx_status_t r_chol = rfx_ctrl_ws_lin_vfwd( &ws[a], &k[a], u_chol );
+            if( RFX_OK != r_svd || RFX_OK != r_chol ) {
+                fprintf( stderr, "FAIL: trial %zu, arm %zu did not solve\n", t, a );
+                return 1;
+            }
+            double e = rel_err( u_chol, u_svd );
+            if( e > worst ) worst = e;
+            AA_MEM_CPY( u_buf[a], u_svd, N_Q );
+        }
+
+        double u_svd[N_ARM][N_Q];
+        AA_MEM_CPY( &u_svd[0][0], &u_buf[0][0], N_ARM*N_Q );
+        if( RFX_OK != rfx_ctrl_ws_lin_vfwd_batch( &batch, N_ARM, pws, pk, pu, r ) ) {
+            fprintf( stderr, "FAIL: trial %zu, batch did not solve\n", t );
+            return 1;
+        }
+        for( size_t a = 0; a < N_ARM; a ++ ) {
+            double e = rel_err( u_buf[a], u_svd[a] );
+            if( e > worst_batch ) worst_batch = e;
+        }
+    }
+
+    printf( "worst relative error: chol6 %g, batch %g\n", worst, worst_batch );
+    if( worst > TOL || worst_batch > TOL ) {
+        fprintf( stderr, "FAIL: CHOL6 deadzone differs from SVD\n" );
+        return 1;
+    }
+
+    for( size_t a = 0; a < N_ARM; a ++ ) {
+        rfx_ctrl_ws_lin_k_destroy( &k[a] );
+        rfx_ctrl_ws_destroy( &ws[a] );
+    }
+    rfx_ctrl_ws_batch_destroy( &batch );
+    return 0;
+}
@@ -0,0 +1,208 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <amino.h>
+#include <math.h>
+#include "reflex.h"
+
+/*
+ * Check rfx_ctrl_qp_box() on random box-constrained QPs.
+ *
+ * Each problem has a random positive definite hessian and a mix of
+ * finite, one-sided, unbounded, and pinned (lo == hi) bounds.  Cold
+ * solves must converge within 2*N_Q iterations and satisfy the KKT
+ * conditions: x is feasible, the gradient vanishes
+ * at free variables, and the bound multipliers have the right sign.
+ *
+ * Each problem is then perturbed and re-solved from the previous
+ * active set, which must also satisfy KKT and take fewer iterations
+ * in total than the cold solves.  Finally, solves capped at one
+ * iteration must return a feasible point no worse than the start,
+ * and 1 when they did not converge.
+ */
+
+#define N_Q 7
+#define N_TRIAL 2000
+#define TOL 1e-9
+
+static double rnd( void ) {
+    return 2*drand48() - 1;
+}
+
+static void random_qp( double *H, double *g, double *lo, double *hi ) {
+    double A[N_Q*N_Q];
+    for( size_t i = 0; i < N_Q*N_Q; i ++ ) A[i] = rnd();
+    for( size_t j = 0; j < N_Q; j ++ ) {
+        for( size_t i = 0; i < N_Q; i ++ ) {
+            double s = (i == j) ? 0.1 : 0;
+            for( size_t k = 0; k < N_Q; k ++ ) s += AA_MATREF(A,N_Q,i,k) * AA_MATREF(A,N_Q,j,k);
+            AA_MATREF(H,N_Q,i,j) = s;
+        }
+    }
+    for( size_t i = 0; i < N_Q; i ++ ) {
+        g[i] = 5*rnd();
+        double a = rnd(), b = rnd();
+        lo[i] = AA_MIN(a, b);
+        hi[i] = AA_MAX(a, b);
+        switch( lrand48() % 8 ) {
+        case 0: lo[i] = -HUGE_VAL; break;
+        case 1: hi[i] = HUGE_VAL; break;
+        case 2: lo[i] = -HUGE_VAL; hi[i] = HUGE_VAL; break;
+        case 3: hi[i] = lo[i]; break;
+        }
+    }
+}
+
+static double objective( const double *H, const double *g, const double *x ) {
+    double f = 0;
+    for( size_t i = 0; i < N_Q; i ++ ) {
+        double hx = 0;
+        for( size_t j = 0; j < N_Q; j ++ ) hx += AA_MATREF(H,N_Q,i,j) * x[j];
+        f += x[i] * (0.5*hx + g[i]);
+    }
+    return f;
+}
+
+/* Largest violation of feasibility */
+static double infeasibility( const double *lo, const double *hi, const double *x ) {
+    double e = 0;
+    for( size_t i = 0; i < N_Q; i ++ )
+        e = fmax( e, fmax( lo[i] - x[i], x[i] - hi[i] ) );
+    return e;
+}
+
+/* Largest violation of the KKT conditions */
+static double kkt_error( const double *H, const double *g,
+                         const double *lo, const double *hi, const double *x ) {
+    double e = infeasibility( lo, hi, x );
+    for( size_t i = 0; i < N_Q; i ++ ) {
+        if( lo[i] >= hi[i] ) continue;
+        double d = g[i];
+        for( size_t j = 0; j < N_Q; j ++ ) d += AA_MATREF(H,N_Q,i,j) * x[j];
+        // multiplier d >= 0 at lo, <= 0 at hi, d == 0 between
+        if( x[i] <= lo[i] )      e = fmax( e, -d );
+        else if( x[i] >= hi[i] ) e = fmax( e, d );
+        else                     e = fmax( e, fabs(d) );
+    }
+    return e;
+}
+
+int main( void ) {
+    srand48( 6 );
+    rfx_ctrl_qp_t qp;
+    rfx_ctrl_qp_init( &qp, N_Q, 1e-3 );
+
+    double worst_cold = 0, worst_warm = 0, worst_cap = 0;
+    size_t iter_cold = 0, iter_warm = 0, max_cold = 0, max_warm = 0, n_capped = 0;
+    int fail = 0;
+
+    for( size_t t = 0; t < N_TRIAL && !fail; t ++ ) {
+        double H[N_Q*N_Q], g[N_Q], lo[N_Q], hi[N_Q], x[N_Q];
+        random_qp( H, g, lo, hi );
+
+        // cold start
+        qp.max_iter = 3*N_Q;
+        rfx_ctrl_qp_reset( &qp );
+        AA_MEM_ZERO( x, N_Q );
+        int r = rfx_ctrl_qp_box( &qp, H, g, lo, hi, x );
+        if( r ) {
+            fprintf( stderr, "FAIL: trial %zu, cold solve returned %d\n", t, r );
+            fail = 1;
+        }
+        worst_cold = fmax( worst_cold, kkt_error( H, g, lo, hi, x ) );
+        iter_cold += qp.iter;
+        max_cold = AA_MAX( max_cold, qp.iter );
+
+        // warm start on a perturbed problem
+        for( size_t i = 0; i < N_Q; i ++ ) g[i] += 0.05*rnd();
+        r = rfx_ctrl_qp_box( &qp, H, g, lo, hi, x );
+        if( r ) {
+            fprintf( stderr, "FAIL: trial %zu, warm solve returned %d\n", t, r );
+            fail = 1;
+        }
+        worst_warm = fmax( worst_warm, kkt_error( H, g, lo, hi, x ) );
+        iter_warm += qp.iter;
+        max_warm = AA_MAX( max_warm, qp.iter );
+
+        // capped cold start, from the clamped origin
+        double x0[N_Q];
+        for( size_t i = 0; i < N_Q; i ++ )
+            x0[i] = (lo[i] >= hi[i]) ? lo[i] : AA_MAX( lo[i], AA_MIN( hi[i], 0 ) );
+        qp.max_iter = 1;
+        rfx_ctrl_qp_reset( &qp );
+        AA_MEM_ZERO( x, N_Q );
+        r = rfx_ctrl_qp_box( &qp, H, g, lo, hi, x );
+        if( r < 0 ) {
+            fprintf( stderr, "FAIL: trial %zu, capped solve returned %d\n", t, r );
+            fail = 1;
+        }
+        if( 1 == r ) n_capped ++;
+        worst_cap = fmax( worst_cap, infeasibility( lo, hi, x ) );
+        if( objective( H, g, x ) > objective( H, g, x0 ) + TOL ) {
+            fprintf( stderr, "FAIL: trial %zu, capped solve increased the objective\n", t );
+            fail = 1;
+        }
+    }
+    rfx_ctrl_qp_destroy( &qp );
+
+    printf( "KKT error: cold %g, warm %g; capped infeasibility %g over %zu capped\n",
+            worst_cold, worst_warm, worst_cap, n_capped );
+    printf( "iterations: cold %.2f mean, %zu max; warm %.2f mean, %zu max\n",
+            (double)iter_cold / N_TRIAL, max_cold, (double)iter_warm / N_TRIAL, max_warm );
+    if( fail ) return 1;
+    if( worst_cold > TOL || worst_warm > TOL ) {
+        fprintf( stderr, "FAIL: KKT conditions not met\n" );
+        return 1;
+    }
+    if( max_cold > 2*N_Q ) {
+        fprintf( stderr, "FAIL: cold solve took %zu iterations\n", max_cold );
+        return 1;
+    }
+    if( worst_cap > 0 || 0 == n_capped ) {
+        fprintf( stderr, "FAIL: capped solve is infeasible\n" );
+        return 1;
+    }
+    if( iter_warm >= iter_cold ) {
+        fprintf( stderr, "FAIL: warm start does not reduce iterations\n" );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,199 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <amino.h>
+#include <math.h>
+#include "reflex.h"
+
+/*
+ * Check the covariance reset of rfx_lqg_qutr_eskf_correct().
+ *
+ * The expected covariance is the Kalman update of P with H = [I 0],
+ * followed by the reset with a jacobian of the rotation error taken
+ * by central differences: for true rotation q = exp(d/2) * q_est,
+ * the new error is d1 = 2*ln(q * q_new**-1).
+ *
+ * The filter's reset jacobian is first order in the injected error,
+ * so residuals are kept small.  The remaining difference is then
+ * O(R_SCALE^2), while a wrong sign in the reset gives O(R_SCALE).
+ */
+
+#define N 12
+#define M 6
+#define N_TRIAL 100
+#define H_DIFF 1e-6
+#define R_SCALE 1e-2
+#define TOL 2e-4
+
+static double rnd( void ) {
+    return 2*drand48() - 1;
+}
+
+/* d1 = 2*ln( exp(d/2) * q_est * q_new**-1 ) */
+static void reset_error( const double d[3], const double q_est[4], const double q_new[4], double d1[3] ) {
+    double h[4] = {d[0]/2, d[1]/2, d[2]/2, 0};
+    double e[4], q[4], q_rel[4], w[4];
+    aa_tf_qexp( h, e );
+    aa_tf_qmul( e, q_est, q );
+    aa_tf_qmulc( q, q_new, q_rel );
+    aa_tf_qminimize( q_rel );
+    aa_tf_qln( q_rel, w );
+    for( size_t k = 0; k < 3; k ++ ) d1[k] = 2*w[k];
+}
+
+int main( void ) {
+    srand48( 19 );
+    double worst = 0;
+
+    for( size_t t = 0; t < N_TRIAL; t ++ ) {
+        // random covariance, P = A*A**T + I/10
+        double A[N*N], P[N*N], W[M*M] = {0};
+        for( size_t i = 0; i < N*N; i ++ ) A[i] = 0.3*rnd();
+        for( size_t j = 0; j < N; j ++ ) {
+            for( size_t i = 0; i < N; i ++ ) {
+                double s = (i == j) ? 0.1 : 0;
+                for( size_t k = 0; k < N; k ++ ) s += AA_MATREF(A,N,i,k) * AA_MATREF(A,N,j,k);
+                AA_MATREF(P,N,i,j) = s;
+            }
+        }
+        for( size_t i = 0; i < M; i ++ ) AA_MATREF(W,M,i,i) = 0.05 + 0.05*drand48();
+
+        // estimate and a nearby observation
+        double E_est[7], dE_est[6], E_obs[7];
+        for( size_t i = 0; i < 4; i ++ ) E_est[i] = rnd();
+        aa_tf_qnormalize( E_est );
+        for( size_t i = 0; i < 3; i ++ ) E_est[4+i] = rnd();
+        for( size_t i = 0; i < 6; i ++ ) dE_est[i] = rnd();
+        {
+            double h[4] = {R_SCALE*rnd(), R_SCALE*rnd(), R_SCALE*rnd(), 0}, e[4];
+            aa_tf_qexp( h, e );
+            aa_tf_qmul( e, E_est, E_obs );
+            for( size_t i = 0; i < 3; i ++ ) E_obs[4+i] = E_est[4+i] + R_SCALE*rnd();
+        }
+
+        // expected error and updated covariance, before the reset
+        double r[M], q_rel[4], w[4];
+        aa_tf_qmulc( E_obs, E_est, q_rel );
+        aa_tf_qminimize( q_rel );
+        aa_tf_qln( q_rel, w );
+        for( size_t k = 0; k < 3; k ++ ) {
+            r[k] = 2*w[k];
+            r[3+k] = E_obs[4+k] - E_est[4+k];
+        }
+        // Kt := (P(0:5,0:5) + W)**-1 * P(0:5,:), so that K = Kt**T
+        double S[M*M], Kt[M*N];
+        for( size_t j = 0; j < M; j ++ )
+            for( size_t i = 0; i < M; i ++ )
+                AA_MATREF(S,M,i,j) = AA_MATREF(P,N,i,j) + AA_MATREF(W,M,i,j);
+        for( size_t j = 0; j < N; j ++ )
+            for( size_t i = 0; i < M; i ++ )
+                AA_MATREF(Kt,M,i,j) = AA_MATREF(P,N,i,j);
+        {
+            int m = M, n = N, info;
+            dposv_( "U", &m, &n, S, &m, Kt, &m, &info );
+            if( info ) abort();
+        }
+        double e[N], P1[N*N];
+        for( size_t c = 0; c < N; c ++ ) {
+            e[c] = 0;
+            for( size_t i = 0; i < M; i ++ ) e[c] += AA_MATREF(Kt,M,i,c) * r[i];
+        }
+        for( size_t j = 0; j < N; j ++ ) {
+            for( size_t i = 0; i < N; i ++ ) {
+                double s = AA_MATREF(P,N,i,j);
+                for( size_t k = 0; k < M; k ++ ) s -= AA_MATREF(Kt,M,k,i) * AA_MATREF(P,N,k,j);
+                AA_MATREF(P1,N,i,j) = s;
+            }
+        }
+
+        // filter under test
+        double E_new[7], dE_new[6], P_new[N*N];
+        AA_MEM_CPY( E_new, E_est, 7 );
+        AA_MEM_CPY( dE_new, dE_est, 6 );
+        AA_MEM_CPY( P_new, P, N*N );
+        if( rfx_lqg_qutr_eskf_correct( 0, E_new, dE_new, E_obs, P_new, W ) ) {
+            fprintf( stderr, "FAIL: trial %zu, correction failed\n", t );
+            return 1;
+        }
+
+        // G := I, with the rotation block differentiated about d = e(0:2)
+        double G[N*N] = {0};
+        for( size_t i = 0; i < N; i ++ ) AA_MATREF(G,N,i,i) = 1;
+        for( size_t j = 0; j < 3; j ++ ) {
+            double dp[3], dm[3], fp[3], fm[3];
+            AA_MEM_CPY( dp, e, 3 );
+            AA_MEM_CPY( dm, e, 3 );
+            dp[j] += H_DIFF;
+            dm[j] -= H_DIFF;
+            reset_error( dp, E_est, E_new, fp );
+            reset_error( dm, E_est, E_new, fm );
+            for( size_t i = 0; i < 3; i ++ ) AA_MATREF(G,N,i,j) = (fp[i] - fm[i]) / (2*H_DIFF);
+        }
+
+        // compare P_new with G*P1*G**T
+        double GP[N*N];
+        for( size_t j = 0; j < N; j ++ ) {
+            for( size_t i = 0; i < N; i ++ ) {
+                double s = 0;
+                for( size_t k = 0; k < N; k ++ ) s += AA_MATREF(G,N,i,k) * AA_MATREF(P1,N,k,j);
+                AA_MATREF(GP,N,i,j) = s;
+            }
+        }
+        double err = 0, norm = 0;
+        for( size_t j = 0; j < N; j ++ ) {
+            for( size_t i = 0; i < N; i ++ ) {
+                double s = 0;
+                for( size_t k = 0; k < N; k ++ ) s += AA_MATREF(GP,N,i,k) * AA_MATREF(G,N,j,k);
+                err = fmax( err, fabs(s - AA_MATREF(P_new,N,i,j)) );
+                norm = fmax( norm, fabs(s) );
+            }
+        }
+        worst = fmax( worst, err / norm );
+    }
+
+    printf( "worst relative covariance error: %g\n", worst );
+    if( worst > TOL ) {
+        fprintf( stderr, "FAIL: covariance reset differs from the numerical jacobian\n" );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <amino.h>
+#include <math.h>
+#include "reflex.h"
+
+/*
+ * Compare rfx_tf_median_window_get() against a full recompute over
+ * the same poses after each rfx_tf_median_window_add(), through
+ * several wraps of the ring.
+ *
+ * Translations must match exactly.  The incremental rotation totals
+ * round differently from a fresh sum, so near-ties may pick another
+ * pose; the chosen pose's total angle must be within TOL of the
+ * minimum.  Observations mix quaternion signs and repeat values.
+ */
+
+#define N_WIN 37
+#define N_OBS 2000
+#define TOL 1e-9
+
+static double rnd( void ) {
+    return 2*drand48() - 1;
+}
+
+static int cmp_double( const void *a, const void *b ) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x < y) ? -1 : (x > y);
+}
+
+/* Total angle from q to the n poses of E */
+static double total_angle( size_t n, const double *E, const double q[4] ) {
+    double s = 0;
+    for( size_t j = 0; j < n; j ++ ) s += aa_tf_qangle_rel( q, AA_MATCOL(E,7,j) );
+    return s;
+}
+
+int main( void ) {
+    srand48( 25 );
+    rfx_tf_median_window_t win;
+    if( rfx_tf_median_window_init( &win, N_WIN ) ) {
+        fprintf( stderr, "FAIL: window init\n" );
+        return 1;
+    }
+
+    double ring[7*N_WIN], sorted[N_WIN];
+    size_t n = 0, i = 0;
+    double worst_x = 0, worst_q = 0;
+
+    for( size_t t = 0; t < N_OBS; t ++ ) {
+        double E[7], r[3] = {0.6*rnd(), 0.6*rnd(), 0.6*rnd()};
+        aa_tf_rotvec2quat( r, E );
+        if( 0 == t % 3 ) for( size_t k = 0; k < 4; k ++ ) E[k] = -E[k];
+        for( size_t k = 0; k < 3; k ++ ) E[4+k] = rnd();
+        if( 0 == t % 7 && n ) AA_MEM_CPY( E, AA_MATCOL(ring,7,(i+n-1)%N_WIN), 7 );
+        if( 0 == t % 11 ) E[5] = E[4];
+
+        rfx_tf_median_window_add( &win, E );
+        AA_MEM_CPY( AA_MATCOL(ring,7,i), E, 7 );
+        i = (i + 1) % N_WIN;
+        if( n < N_WIN ) n ++;
+
+        double z[7];
+        rfx_tf_median_window_get( &win, z );
+
+        // translation: per-axis median of the window
+        for( size_t k = 0; k < 3; k ++ ) {
+            for( size_t j = 0; j < n; j ++ ) sorted[j] = AA_MATREF(ring,7,4+k,j);
+            qsort( sorted, n, sizeof(double), cmp_double );
+            double x = (n % 2) ? sorted[n/2] : (sorted[n/2-1] + sorted[n/2]) / 2;
+            worst_x = fmax( worst_x, fabs(x - z[4+k]) );
+        }
+
+        // rotation: medoid of the window
+        double s_min = INFINITY;
+        for( size_t j = 0; j < n; j ++ )
+            s_min = fmin( s_min, total_angle( n, ring, AA_MATCOL(ring,7,j) ) );
+        worst_q = fmax( worst_q, total_angle( n, ring, z ) - s_min );
+    }
+    rfx_tf_median_window_destroy( &win );
+
+    printf( "translation error: %g, rotation excess: %g\n", worst_x, worst_q );
+    if( worst_x > 0 ) {
+        fprintf( stderr, "FAIL: translation median differs\n" );
+        return 1;
+    }
+    if( worst_q > TOL ) {
+        fprintf( stderr, "FAIL: rotation is not the medoid\n" );
+        return 1;
+    }
+    return 0;
+}
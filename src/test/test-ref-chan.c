@@ -0,0 +1,122 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <amino.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "reflex.h"
+
+/*
+ * Hammer a reference channel from a writer and a reader thread.
+ *
+ * The writer fills every element of publication k with k.  The
+ * reader checks that each snapshot is uniform (not torn) and that
+ * publication numbers never go backwards.
+ */
+
+#define N_Q 30
+#define N_PUB 2000000
+
+static rfx_ctrl_ref_chan_t chan;
+
+static void fill( struct rfx_ctrlx_state *x, double v ) {
+    for( size_t i = 0; i < N_Q; i ++ ) x->q[i] = x->dq[i] = v;
+    for( size_t i = 0; i < 8; i ++ ) x->S[i] = v;
+    for( size_t i = 0; i < 6; i ++ ) x->dx[i] = x->F[i] = v;
+}
+
+static int uniform( const struct rfx_ctrlx_state *x, double v ) {
+    int ok = 1;
+    for( size_t i = 0; i < N_Q; i ++ ) ok &= (x->q[i] == v) & (x->dq[i] == v);
+    for( size_t i = 0; i < 8; i ++ ) ok &= (x->S[i] == v);
+    for( size_t i = 0; i < 6; i ++ ) ok &= (x->dx[i] == v) & (x->F[i] == v);
+    return ok;
+}
+
+static void *writer( void *arg ) {
+    (void)arg;
+    struct rfx_ctrlx_state x;
+    rfx_ctrlx_state_init( &x, N_Q );
+    for( uint64_t k = 1; k <= N_PUB; k ++ ) {
+        fill( &x, (double)k );
+        rfx_ctrl_ref_publish( &chan, &x );
+    }
+    rfx_ctrlx_state_destroy( &x );
+    return NULL;
+}
+
+int main( void ) {
+    rfx_ctrl_ref_chan_init( &chan, N_Q );
+
+    pthread_t thread;
+    if( pthread_create( &thread, NULL, writer, NULL ) ) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    struct rfx_ctrlx_state x;
+    rfx_ctrlx_state_init( &x, N_Q );
+    uint64_t last = 0, n_read = 0, n_fresh = 0;
+    while( last < N_PUB ) {
+        uint64_t seq;
+        n_fresh += (uint64_t)rfx_ctrl_ref_read( &chan, &x, &seq );
+        n_read ++;
+        if( seq < last ) {
+            fprintf( stderr, "FAIL: sequence went backwards, %" PRIu64 " after %" PRIu64 "\n",
+                     seq, last );
+            return 1;
+        }
+        if( seq && !uniform( &x, (double)seq ) ) {
+            fprintf( stderr, "FAIL: torn read at %" PRIu64 "\n", seq );
+            return 1;
+        }
+        last = seq;
+    }
+
+    pthread_join( thread, NULL );
+    printf( "%" PRIu64 " reads, %" PRIu64 " fresh\n", n_read, n_fresh );
+
+    rfx_ctrlx_state_destroy( &x );
+    rfx_ctrl_ref_chan_destroy( &chan );
+    return 0;
+}
@@ -0,0 +1,161 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <amino.h>
+#include "reflex.h"
+
+/* Alternating fit of camera registration and marker offsets.
+ *
+ * Samples are copied once into marker order, so each marker's
+ * samples are contiguous and every buffer is reused across rounds:
+ *
+ *   Xs     X in marker order
+ *   Xc     conj(X), the offset fit inputs
+ *   Ys     Y in marker order
+ *   Xp     X*off, the registration fit inputs
+ *   Yp     conj(Z*Y), the offset fit outputs
+ */
+
+struct cor_em_cx {
+    int opts;
+    const size_t *beg;      // first sample of each marker, n_marker+1
+    const double *Xs, *Xc, *Ys;
+    double *Xp, *Yp;
+    double *off;
+    const double *Z;
+};
+
+/* Fit the offset of marker i given Z, then apply it */
+static void cor_em_task( void *vcx, size_t i )
+{
+    struct cor_em_cx *cx = (struct cor_em_cx*)vcx;
+    size_t b = cx->beg[i], e = cx->beg[i+1];
+    if( b == e ) return;
+    double *off = AA_MATCOL(cx->off, 7, i);
+
+    // T_fk*T_off = Z*T_cam  =>  T_off * (Z*T_cam)^* = T_fk^*
+    for( size_t j = b; j < e; j ++ ) {
+        double tmp[7];
+        aa_tf_qutr_mul( cx->Z, AA_MATCOL(cx->Ys, 7, j), tmp );
+        aa_tf_qutr_conj( tmp, AA_MATCOL(cx->Yp, 7, j) );
+    }
+
+    // the medoid stays serial within a task
+    rfx_tf_cor_pool( cx->opts, NULL, e - b,
+                     AA_MATCOL(cx->Xc, 7, b), 7,
+                     AA_MATCOL(cx->Xc, 7, b)+4, 7,
+                     AA_MATCOL(cx->Yp, 7, b), 7,
+                     AA_MATCOL(cx->Yp, 7, b)+4, 7,
+                     off );
+
+    for( size_t j = b; j < e; j ++ )
+        aa_tf_qutr_mul( AA_MATCOL(cx->Xs, 7, j), off, AA_MATCOL(cx->Xp, 7, j) );
+}
+
+AA_API ssize_t rfx_tf_cor_em( int opts, rfx_tpool_t *pool, size_t n,
+                              const double *X, size_t ldx,
+                              const double *Y, size_t ldy,
+                              size_t n_marker, const size_t *marker,
+                              size_t max_iter, double tol,
+                              double Z[7], double *off )
+{
+    if( 0 == n || 0 == n_marker ) return -1;
+
+    double *buf = (double*)malloc( sizeof(double) * (5*7*n + (off ? 0 : 7*n_marker)) );
+    size_t *beg = (size_t*)calloc( n_marker+2, sizeof(size_t) );
+    if( NULL == buf || NULL == beg ) {
+        free( buf );
+        free( beg );
+        return -1;
+    }
+    double *Xs = buf;
+    double *Xc = Xs + 7*n;
+    double *Ys = Xc + 7*n;
+    double *Xp = Ys + 7*n;
+    double *Yp = Xp + 7*n;
+    if( NULL == off ) off = Yp + 7*n;
+
+    // counting sort into marker order
+    for( size_t j = 0; j < n; j ++ ) beg[marker[j]+2]++;
+    for( size_t i = 2; i < n_marker+2; i ++ ) beg[i] += beg[i-1];
+    for( size_t j = 0; j < n; j ++ ) {
+        size_t k = beg[marker[j]+1]++;
+        AA_MEM_CPY( AA_MATCOL(Xs, 7, k), AA_MATCOL(X, ldx, j), 7 );
+        AA_MEM_CPY( AA_MATCOL(Ys, 7, k), AA_MATCOL(Y, ldy, j), 7 );
+        aa_tf_qutr_conj( AA_MATCOL(X, ldx, j), AA_MATCOL(Xc, 7, k) );
+    }
+
+    // initial offsets are identity
+    for( size_t i = 0; i < n_marker; i ++ )
+        AA_MEM_CPY( AA_MATCOL(off, 7, i), aa_tf_qutr_ident, 7 );
+    AA_MEM_CPY( Xp, Xs, 7*n );
+
+    struct cor_em_cx cx = { .opts = opts, .beg = beg,
+                            .Xs = Xs, .Xc = Xc, .Ys = Ys,
+                            .Xp = Xp, .Yp = Yp,
+                            .off = off, .Z = Z };
+
+    size_t iter = 0;
+    double Z_prev[7];
+    while( iter < max_iter ) {
+        rfx_tf_cor_pool( opts, pool, n,
+                         Xp, 7, Xp+4, 7,
+                         Ys, 7, Ys+4, 7,
+                         Z );
+        iter++;
+
+        int done = 0;
+        if( iter > 1 ) {
+            done = aa_tf_qangle_rel( Z, Z_prev ) < tol &&
+                sqrt( aa_la_ssd(3, Z+4, Z_prev+4) ) < tol;
+        }
+        AA_MEM_CPY( Z_prev, Z, 7 );
+
+        rfx_tpool_run( pool, n_marker, cor_em_task, &cx );
+        if( done ) break;
+    }
+
+    free( buf );
+    free( beg );
+    return (ssize_t)iter;
+}
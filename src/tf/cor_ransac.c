@@ -0,0 +1,295 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <float.h>
+#include <amino.h>
+#include "reflex.h"
+
+/* Random sample consensus for correspondence fits.
+ *
+ * Hypotheses come from minimal 3-point subsets of the translations,
+ * solved with rfx_tf_numeyama().  A hypothesis is scored on all
+ * samples by the squared translation residual, either by counting
+ * residuals under a threshold (RANSAC) or by the median residual
+ * (LMedS).  Hypotheses are generated and scored in batches, one
+ * batch per pool task, and subsets are drawn from a counter-based
+ * generator so the result does not depend on the number of threads.
+ * The best hypothesis selects the inliers, which are refit with
+ * rfx_tf_cor().
+ */
+
+/* Hypotheses per task */
+#define RANSAC_BATCH 4
+/* Tasks per round between termination checks */
+#define RANSAC_ROUND 8
+
+/* LMedS robust scale: sigma = LMEDS_K * (1 + 5/(n-3)) * sqrt(median) */
+#define LMEDS_K 1.4826
+/* LMedS inlier bound, in units of sigma */
+#define LMEDS_Z 2.5
+
+struct ransac_hyp {
+    double R[9];        // y = R*x + t
+    double t[3];
+    double cost;        // outliers (RANSAC) or median squared residual (LMedS)
+};
+
+struct ransac_cx {
+    size_t n;
+    const double *X[3];     // vx, structure-of-arrays
+    const double *Y[3];     // vy, structure-of-arrays
+    double thresh2;         // squared inlier distance, 0 for LMedS
+    uint64_t seed;
+    size_t k0;              // first hypothesis index of the round
+    struct ransac_hyp *best;  // best hypothesis of each task
+};
+
+static uint64_t splitmix64( uint64_t x )
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* Minimal solution from subset k, returns nonzero if degenerate */
+static int ransac_solve( const struct ransac_cx *cx, uint64_t k,
+                         struct ransac_hyp *h )
+{
+    // three distinct indices
+    size_t n = cx->n;
+    uint64_t r = splitmix64( cx->seed ^ (k * 0xd1b54a32d192ed03ULL) );
+    size_t i0 = (size_t)(r % n);
+    size_t i1 = (size_t)((r >> 21) % (n-1));
+    size_t i2 = (size_t)((r >> 42) % (n-2));
+    if( i1 >= i0 ) i1++;
+    if( i2 >= AA_MIN(i0,i1) ) i2++;
+    if( i2 >= AA_MAX(i0,i1) ) i2++;
+    size_t idx[3] = {i0, i1, i2};
+
+    double Xs[9], Ys[9];
+    for( size_t j = 0; j < 3; j ++ ) {
+        for( size_t c = 0; c < 3; c ++ ) {
+            Xs[3*j+c] = cx->X[c][idx[j]];
+            Ys[3*j+c] = cx->Y[c][idx[j]];
+        }
+    }
+
+    // reject near-collinear subsets
+    double a[3], b[3], ab[3];
+    for( size_t c = 0; c < 3; c ++ ) {
+        a[c] = Xs[3+c] - Xs[c];
+        b[c] = Xs[6+c] - Xs[c];
+    }
+    aa_tf_cross( a, b, ab );
+    double s = aa_la_dot(3, a, a) * aa_la_dot(3, b, b);
+    if( !(aa_la_dot(3, ab, ab) > 1e-12 * s) ) return -1;
+
+    double tf[12];
+    if( rfx_tf_numeyama( 3, Xs, 3, Ys, 3, tf ) ) return -1;
+
+    // rfx_tf_numeyama() does not correct reflections
+    const double *R = tf;
+    double det = R[0]*(R[4]*R[8] - R[7]*R[5])
+        - R[3]*(R[1]*R[8] - R[7]*R[2])
+        + R[6]*(R[1]*R[5] - R[4]*R[2]);
+    if( !(det > 0) ) return -1;
+
+    AA_MEM_CPY( h->R, tf, 9 );
+    AA_MEM_CPY( h->t, tf+9, 3 );
+    return 0;
+}
+
+/* Squared residuals of hypothesis h on all samples */
+static void ransac_residual( const struct ransac_cx *cx,
+                             const struct ransac_hyp *h, double *AA_RESTRICT d2 )
+{
+    const double *AA_RESTRICT x0 = cx->X[0];
+    const double *AA_RESTRICT x1 = cx->X[1];
+    const double *AA_RESTRICT x2 = cx->X[2];
+    const double *AA_RESTRICT y0 = cx->Y[0];
+    const double *AA_RESTRICT y1 = cx->Y[1];
+    const double *AA_RESTRICT y2 = cx->Y[2];
+    const double *R = h->R, *t = h->t;
+    for( size_t i = 0; i < cx->n; i ++ ) {
+        double e0 = R[0]*x0[i] + R[3]*x1[i] + R[6]*x2[i] + t[0] - y0[i];
+        double e1 = R[1]*x0[i] + R[4]*x1[i] + R[7]*x2[i] + t[1] - y1[i];
+        double e2 = R[2]*x0[i] + R[5]*x1[i] + R[8]*x2[i] + t[2] - y2[i];
+        d2[i] = e0*e0 + e1*e1 + e2*e2;
+    }
+}
+
+static double ransac_cost( const struct ransac_cx *cx, double *d2 )
+{
+    if( cx->thresh2 > 0 ) {
+        size_t out = 0;
+        for( size_t i = 0; i < cx->n; i ++ )
+            out += d2[i] > cx->thresh2;
+        return (double)out;
+    } else {
+        return aa_la_d_median( cx->n, d2, 1 );
+    }
+}
+
+static void ransac_task( void *vcx, size_t b )
+{
+    struct ransac_cx *cx = (struct ransac_cx*)vcx;
+    struct ransac_hyp *best = &cx->best[b];
+    best->cost = INFINITY;
+
+    double *d2 = AA_MEM_REGION_LOCAL_NEW_N( double, cx->n );
+    for( size_t j = 0; j < RANSAC_BATCH; j ++ ) {
+        struct ransac_hyp h;
+        if( ransac_solve( cx, cx->k0 + b*RANSAC_BATCH + j, &h ) ) continue;
+        ransac_residual( cx, &h, d2 );
+        h.cost = ransac_cost( cx, d2 );
+        if( h.cost < best->cost ) *best = h;
+    }
+    aa_mem_region_local_pop( d2 );
+}
+
+/* Squared inlier bound for the LMedS hypothesis with cost med */
+static double lmeds_thresh2( size_t n, double med )
+{
+    double sigma = LMEDS_K * (1 + 5.0 / (double)(n-3)) * sqrt(med);
+    double z = LMEDS_Z * sigma;
+    return AA_MAX( z*z, med );
+}
+
+AA_API size_t rfx_tf_cor_ransac( int opts, rfx_tpool_t *pool, size_t n,
+                                 const double *qx, size_t ldqx,
+                                 const double *vx, size_t ldvx,
+                                 const double *qy, size_t ldqy,
+                                 const double *vy, size_t ldvy,
+                                 double threshold, double confidence, size_t max_iter,
+                                 uint8_t *inlier, double *Z )
+{
+    opts &= ~RFX_TF_COR_O_RANSAC;
+
+    if( n < 4 ) {
+        rfx_tf_cor_pool( opts, pool, n, qx, ldqx, vx, ldvx, qy, ldqy, vy, ldvy, Z );
+        if( inlier ) memset( inlier, 1, n );
+        return n;
+    }
+
+    double *top = AA_MEM_REGION_LOCAL_NEW_N( double, 1 );
+
+    double *XY = AA_MEM_REGION_LOCAL_NEW_N( double, 7*n );
+    struct ransac_cx cx;
+    cx.n = n;
+    for( size_t c = 0; c < 3; c ++ ) {
+        double *xc = XY + c*n, *yc = XY + (3+c)*n;
+        for( size_t i = 0; i < n; i ++ ) {
+            xc[i] = AA_MATREF(vx, ldvx, c, i);
+            yc[i] = AA_MATREF(vy, ldvy, c, i);
+        }
+        cx.X[c] = xc;
+        cx.Y[c] = yc;
+    }
+    double *d2 = XY + 6*n;
+    cx.thresh2 = (threshold > 0) ? threshold*threshold : 0;
+    cx.seed = 0x5eed;
+    cx.best = AA_MEM_REGION_LOCAL_NEW_N( struct ransac_hyp, RANSAC_ROUND );
+
+    struct ransac_hyp best;
+    best.cost = INFINITY;
+    size_t n_in = 0;
+    size_t k_need = max_iter;
+    double log_fail = log( 1 - AA_MIN(confidence, 1 - DBL_EPSILON) );
+
+    for( cx.k0 = 0; cx.k0 < k_need; cx.k0 += RANSAC_ROUND*RANSAC_BATCH ) {
+        rfx_tpool_run( pool, RANSAC_ROUND, ransac_task, &cx );
+
+        int better = 0;
+        for( size_t b = 0; b < RANSAC_ROUND; b ++ ) {
+            if( cx.best[b].cost < best.cost ) {
+                best = cx.best[b];
+                better = 1;
+            }
+        }
+        if( !better ) continue;
+
+        // adaptive termination from the inlier fraction
+        ransac_residual( &cx, &best, d2 );
+        double t2 = (cx.thresh2 > 0) ? cx.thresh2 : lmeds_thresh2( n, best.cost );
+        n_in = 0;
+        for( size_t i = 0; i < n; i ++ ) n_in += d2[i] <= t2;
+        double w = (double)n_in / (double)n;
+        double p_good = w*w*w;
+        if( p_good >= 1 ) {
+            k_need = 0;
+        } else if( p_good > 0 ) {
+            double k = log_fail / log1p( -p_good );
+            k_need = (k < (double)max_iter) ? (size_t)ceil(k) : max_iter;
+        }
+    }
+
+    if( isinf(best.cost) || n_in < 3 ) {
+        // no usable subset, fit everything
+        rfx_tf_cor_pool( opts, pool, n, qx, ldqx, vx, ldvx, qy, ldqy, vy, ldvy, Z );
+        if( inlier ) memset( inlier, 1, n );
+        aa_mem_region_local_pop( top );
+        return n;
+    }
+
+    // refit on the inliers
+    ransac_residual( &cx, &best, d2 );
+    double t2 = (cx.thresh2 > 0) ? cx.thresh2 : lmeds_thresh2( n, best.cost );
+    double *E = AA_MEM_REGION_LOCAL_NEW_N( double, 14*n_in );
+    size_t j = 0;
+    for( size_t i = 0; i < n; i ++ ) {
+        int in = d2[i] <= t2;
+        if( inlier ) inlier[i] = (uint8_t)in;
+        if( in ) {
+            double *e = E + 14*j++;
+            AA_MEM_CPY( e, AA_MATCOL(qx, ldqx, i), 4 );
+            AA_MEM_CPY( e+4, AA_MATCOL(vx, ldvx, i), 3 );
+            AA_MEM_CPY( e+7, AA_MATCOL(qy, ldqy, i), 4 );
+            AA_MEM_CPY( e+11, AA_MATCOL(vy, ldvy, i), 3 );
+        }
+    }
+    rfx_tf_cor_pool( opts, pool, j, E, 14, E+4, 14, E+7, 14, E+11, 14, Z );
+
+    aa_mem_region_local_pop( top );
+    return j;
+}
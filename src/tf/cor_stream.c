@@ -0,0 +1,385 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <amino.h>
+#include "reflex.h"
+
+/* Streaming correspondence fit.
+ *
+ * Sufficient statistics for the rotation fits are kept as running
+ * sums, so samples can be added and removed in constant time:
+ *
+ *   Umeyama:   n, sum(dx), sum(dy), sum(dy*dx**T)
+ *   Davenport: K = sum(q*q**T) of the relative rotations
+ *
+ * with dx, dy the translations relative to the first sample, which
+ * keeps the covariance well conditioned far from the origin.
+ *
+ * The translation median uses a fixed histogram per axis of the
+ * residual x - R_ref*y.  The first n_warm samples are buffered; once
+ * the buffer fills, R_ref is set to the Davenport fit of those
+ * samples, the histograms are centered on their median residual, and
+ * the buffer is binned.  At fit time the median is shifted by
+ * (R_ref - R)*mean(y) for the difference between R_ref and the
+ * fitted rotation R.  That shift is exact for the mean and
+ * first-order for the median.
+ */
+
+#define HIST(s, axis) ((s)->hist + (axis)*((s)->n_bin+2))
+
+/* Buffered sample: qx, vx, qy, vy */
+#define WARM_LD 14
+
+AA_API int rfx_tf_cor_stream_init
+( rfx_tf_cor_stream_t *s, int opts,
+  size_t n_bin, double bin_width, size_t n_warm )
+{
+    memset( s, 0, sizeof(*s) );
+    if( 0 == n_bin || !(bin_width > 0) || 0 == n_warm ) return -1;
+
+    s->opts = opts;
+    s->n_bin = n_bin;
+    s->bin_width = bin_width;
+    s->n_warm = n_warm;
+
+    // bins, plus an underflow and overflow bin, for each axis
+    s->hist = (size_t*)calloc( 3*(n_bin+2), sizeof(size_t) );
+    s->warm = (double*)malloc( sizeof(double) * WARM_LD * n_warm );
+    if( NULL == s->hist || NULL == s->warm ) {
+        rfx_tf_cor_stream_destroy( s );
+        return -1;
+    }
+
+    return 0;
+}
+
+AA_API void rfx_tf_cor_stream_destroy( rfx_tf_cor_stream_t *s )
+{
+    free( s->hist );
+    free( s->warm );
+    memset( s, 0, sizeof(*s) );
+}
+
+/* Histogram bin of residual component e on axis k */
+static size_t stream_bin( const rfx_tf_cor_stream_t *s, size_t k, double e )
+{
+    double b = (e - s->lo[k]) / s->bin_width;
+    if( b < 0 ) return 0;
+    if( b >= (double)s->n_bin ) return s->n_bin+1;
+    return (size_t)b + 1;
+}
+
+static void stream_bin_update( rfx_tf_cor_stream_t *s, int add,
+                               const double vx[3], const double vy[3] )
+{
+    double r[3];
+    aa_tf_9rot( s->R_ref, vy, r );
+    for( size_t k = 0; k < 3; k ++ ) {
+        size_t *c = &HIST(s,k)[ stream_bin(s, k, vx[k] - r[k]) ];
+        if( add ) (*c)++;
+        else if( *c ) (*c)--;
+    }
+}
+
+static int stream_davenport( const rfx_tf_cor_stream_t *s, double q[4] );
+
+/* Fix R_ref from the buffered samples and bin them */
+static void stream_anchor( rfx_tf_cor_stream_t *s )
+{
+    double q[4];
+    if( stream_davenport(s, q) ) AA_MEM_CPY( q, aa_tf_quat_ident, 4 );
+    aa_tf_quat2rotmat( q, s->R_ref );
+
+    double *e = AA_MEM_REGION_LOCAL_NEW_N( double, 3*s->n_warm_used );
+    for( size_t i = 0; i < s->n_warm_used; i ++ ) {
+        const double *w = s->warm + WARM_LD*i;
+        double r[3];
+        aa_tf_9rot( s->R_ref, w+11, r );
+        for( size_t k = 0; k < 3; k ++ )
+            e[3*i+k] = w[4+k] - r[k];
+    }
+    double half = s->bin_width * (double)s->n_bin / 2;
+    for( size_t k = 0; k < 3; k ++ )
+        s->lo[k] = aa_la_d_median( s->n_warm_used, e+k, 3 ) - half;
+
+    memset( s->hist, 0, sizeof(size_t) * 3 * (s->n_bin+2) );
+    for( size_t i = 0; i < s->n_warm_used; i ++ ) {
+        const double *w = s->warm + WARM_LD*i;
+        stream_bin_update( s, 1, w+4, w+11 );
+    }
+    s->anchored = 1;
+    aa_mem_region_local_pop( e );
+}
+
+static void stream_update( rfx_tf_cor_stream_t *s, double sign,
+                           const double qx[4], const double vx[3],
+                           const double qy[4], const double vy[3] )
+{
+    double dx[3], dy[3];
+    for( size_t k = 0; k < 3; k ++ ) {
+        dx[k] = vx[k] - s->x0[k];
+        dy[k] = vy[k] - s->y0[k];
+        s->sum_x[k] += sign*dx[k];
+        s->sum_y[k] += sign*dy[k];
+    }
+    for( size_t j = 0; j < 3; j ++ )
+        for( size_t i = 0; i < 3; i ++ )
+            AA_MATREF(s->sum_yx, 3, i, j) += sign * dy[i]*dx[j];
+
+    // K is invariant to the sign of q
+    double q[4];
+    aa_tf_qmulc( qx, qy, q );
+    for( size_t j = 0; j < 4; j ++ )
+        for( size_t i = 0; i < 4; i ++ )
+            AA_MATREF(s->K, 4, i, j) += sign * q[i]*q[j];
+}
+
+static void stream_reset( rfx_tf_cor_stream_t *s )
+{
+    s->n = 0;
+    s->n_warm_used = 0;
+    s->anchored = 0;
+    AA_MEM_ZERO( s->sum_x, 3 );
+    AA_MEM_ZERO( s->sum_y, 3 );
+    AA_MEM_ZERO( s->sum_yx, 9 );
+    AA_MEM_ZERO( s->K, 16 );
+}
+
+AA_API void rfx_tf_cor_stream_add
+( rfx_tf_cor_stream_t *s,
+  const double qx[4], const double vx[3],
+  const double qy[4], const double vy[3] )
+{
+    if( 0 == s->n ) {
+        stream_reset( s );
+        AA_MEM_CPY( s->x0, vx, 3 );
+        AA_MEM_CPY( s->y0, vy, 3 );
+    }
+    stream_update( s, 1, qx, vx, qy, vy );
+    s->n++;
+
+    if( s->anchored ) {
+        stream_bin_update( s, 1, vx, vy );
+    } else {
+        double *w = s->warm + WARM_LD*s->n_warm_used++;
+        AA_MEM_CPY( w, qx, 4 );
+        AA_MEM_CPY( w+4, vx, 3 );
+        AA_MEM_CPY( w+7, qy, 4 );
+        AA_MEM_CPY( w+11, vy, 3 );
+        if( s->n_warm_used == s->n_warm ) stream_anchor( s );
+    }
+}
+
+AA_API void rfx_tf_cor_stream_remove
+( rfx_tf_cor_stream_t *s,
+  const double qx[4], const double vx[3],
+  const double qy[4], const double vy[3] )
+{
+    if( 0 == s->n ) return;
+
+    if( s->anchored ) {
+        stream_bin_update( s, 0, vx, vy );
+    } else {
+        // drop the matching buffered sample
+        size_t i;
+        for( i = 0; i < s->n_warm_used; i ++ ) {
+            const double *w = s->warm + WARM_LD*i;
+            if( 0 == memcmp(w, qx, 4*sizeof(double)) &&
+                0 == memcmp(w+4, vx, 3*sizeof(double)) &&
+                0 == memcmp(w+7, qy, 4*sizeof(double)) &&
+                0 == memcmp(w+11, vy, 3*sizeof(double)) )
+                break;
+        }
+        if( i == s->n_warm_used ) return;
+        s->n_warm_used--;
+        AA_MEM_CPY( s->warm + WARM_LD*i, s->warm + WARM_LD*s->n_warm_used, WARM_LD );
+    }
+
+    stream_update( s, -1, qx, vx, qy, vy );
+    s->n--;
+}
+
+/* Rotation R of the Umeyama fit, y = R*x, from the running sums */
+static int stream_umeyama( const rfx_tf_cor_stream_t *s, double R[9] )
+{
+    double n = (double)s->n;
+    double sigma[9];
+    for( size_t j = 0; j < 3; j ++ )
+        for( size_t i = 0; i < 3; i ++ )
+            AA_MATREF(sigma, 3, i, j) = AA_MATREF(s->sum_yx, 3, i, j) / n
+                - (s->sum_y[i] / n) * (s->sum_x[j] / n);
+
+    double U[9], S[3], Vt[9], work[64];
+    int m = 3, lwork = 64, info;
+    dgesvd_( "A", "A", &m, &m, sigma, &m, S, U, &m, Vt, &m, work, &lwork, &info );
+    if( info || !(S[1] > 0) ) return -1;
+
+    // R = U * diag(1,1,det(U*Vt)) * Vt
+    for( int pass = 0; pass < 2; pass ++ ) {
+        for( size_t j = 0; j < 3; j ++ ) {
+            for( size_t i = 0; i < 3; i ++ ) {
+                double r = 0;
+                for( size_t k = 0; k < 3; k ++ )
+                    r += AA_MATREF(U, 3, i, k) * AA_MATREF(Vt, 3, k, j);
+                AA_MATREF(R, 3, i, j) = r;
+            }
+        }
+        double det =
+            R[0]*(R[4]*R[8] - R[7]*R[5])
+            - R[3]*(R[1]*R[8] - R[7]*R[2])
+            + R[6]*(R[1]*R[5] - R[4]*R[2]);
+        if( det > 0 ) break;
+        for( size_t k = 0; k < 3; k ++ ) AA_MATREF(U, 3, k, 2) *= -1;
+    }
+    return 0;
+}
+
+/* Dominant eigenvector of the Davenport matrix */
+static int stream_davenport( const rfx_tf_cor_stream_t *s, double q[4] )
+{
+    double A[16], w[4], work[64];
+    int m = 4, lwork = 64, info;
+    AA_MEM_CPY( A, s->K, 16 );
+    dsyev_( "V", "U", &m, A, &m, w, work, &lwork, &info );
+    if( info ) return -1;
+    AA_MEM_CPY( q, AA_MATCOL(A, 4, 3), 4 );
+    aa_tf_qnormalize( q );
+    aa_tf_qminimize( q );
+    return 0;
+}
+
+/* Median of the residual histogram on axis k */
+static double stream_median( const rfx_tf_cor_stream_t *s, size_t k )
+{
+    const size_t *c = HIST(s,k);
+    double half = (double)s->n / 2;
+    double cum = (double)c[0];
+    if( cum >= half ) return s->lo[k];
+    for( size_t b = 1; b <= s->n_bin; b ++ ) {
+        double cb = (double)c[b];
+        if( cum + cb >= half ) {
+            // linear within the bin
+            return s->lo[k] + s->bin_width * ((double)(b-1) + (half - cum) / cb);
+        }
+        cum += cb;
+    }
+    return s->lo[k] + s->bin_width * (double)s->n_bin;
+}
+
+/* Exact median translation of the buffered samples */
+static void stream_warm_median( const rfx_tf_cor_stream_t *s,
+                                const double R[9], double t[3] )
+{
+    double *e = AA_MEM_REGION_LOCAL_NEW_N( double, 3*s->n_warm_used );
+    for( size_t i = 0; i < s->n_warm_used; i ++ ) {
+        const double *w = s->warm + WARM_LD*i;
+        double r[3];
+        aa_tf_9rot( R, w+11, r );
+        for( size_t k = 0; k < 3; k ++ )
+            e[3*i+k] = w[4+k] - r[k];
+    }
+    for( size_t k = 0; k < 3; k ++ )
+        t[k] = aa_la_d_median( s->n_warm_used, e+k, 3 );
+    aa_mem_region_local_pop( e );
+}
+
+AA_API int rfx_tf_cor_stream_fit( const rfx_tf_cor_stream_t *s, double Z[7] )
+{
+    if( 0 == s->n ) return -1;
+
+    /*-- Orientation --*/
+    double q_fit[2][4];
+    size_t n_fit = 0;
+
+    if( (s->opts & RFX_TF_COR_O_ROT_UMEYAMA) && s->n >= 3 ) {
+        double R[9];
+        if( 0 == stream_umeyama(s, R) ) {
+            aa_la_transpose( 3, R );
+            aa_tf_rotmat2quat( R, q_fit[n_fit++] );
+        }
+    }
+
+    // Davenport also stands in for the median rotation fits, which
+    // have no running form
+    if( (s->opts & (RFX_TF_COR_O_ROT_DAVENPORT | RFX_TF_COR_O_ROT_MEDIAN |
+                    RFX_TF_COR_O_ROT_MEDIAN_BLOCKED |
+                    RFX_TF_COR_O_ROT_MEDIAN_WEISZFELD))
+        || 0 == n_fit )
+    {
+        if( 0 == stream_davenport(s, q_fit[n_fit]) ) n_fit++;
+    }
+    if( 0 == n_fit ) return -1;
+
+    aa_tf_quat_davenport( n_fit, NULL, q_fit[0], 4, Z );
+    aa_tf_qminimize( Z );
+
+    /*-- Translation --*/
+    double R[9];
+    aa_tf_quat2rotmat( Z, R );
+
+    double n = (double)s->n;
+    double mx[3], my[3], Rmy[3];
+    for( size_t k = 0; k < 3; k ++ ) {
+        mx[k] = s->x0[k] + s->sum_x[k] / n;
+        my[k] = s->y0[k] + s->sum_y[k] / n;
+    }
+    aa_tf_9rot( R, my, Rmy );
+
+    if( s->opts & RFX_TF_COR_O_TRANS_MEDIAN &&
+        !(s->opts & RFX_TF_COR_O_TRANS_MEAN) )
+    {
+        if( s->anchored ) {
+            double Rrmy[3];
+            aa_tf_9rot( s->R_ref, my, Rrmy );
+            for( size_t k = 0; k < 3; k ++ )
+                Z[4+k] = stream_median(s, k) + Rrmy[k] - Rmy[k];
+        } else {
+            stream_warm_median( s, R, Z+4 );
+        }
+    } else {
+        for( size_t k = 0; k < 3; k ++ )
+            Z[4+k] = mx[k] - Rmy[k];
+    }
+
+    return 0;
+}
@@ -60,7 +60,7 @@ void rfx_tf_qangmedian
     } // else do stuff
 
 
-    // TODO: parallelize, because this is slow
+    // Reference implementation, see rfx_tf_qangmedian_blocked()
 
     double *sum_dist = AA_MEM_REGION_LOCAL_NEW_N(double,n);
     AA_MEM_ZERO(sum_dist, n);
@@ -172,9 +172,7 @@ int rfx_tf_dud_median
     //rfx_tf_qlnmedian(n, q_mean, Q, 4, z );
 
     rfx_tf_dud_qrel(n, Ex, ldx, Ey, ldy, Q, 4 );
-    aa_tick("med: ");
     rfx_tf_qangmedian( n, Q, 4, z );
-    aa_tock();
 
     //median translation
     double R[9];
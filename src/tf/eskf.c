@@ -0,0 +1,282 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <amino.h>
+#include "reflex.h"
+
+/* Error-state Kalman filter for quaternion-translation pose and
+ * velocity.
+ *
+ * The nominal state is the pose E = [q, p] and velocity dx = [v, omega].
+ * The filter covariance is over the 12-element error state
+ *
+ *   e = [ dtheta (3), dp (3), dv (3), domega (3) ]
+ *
+ * with q = exp(dtheta/2) * q_nominal, and the remaining elements
+ * additive.  Measurement residuals are formed on the pose manifold,
+ * and after each correction the error is injected into the nominal
+ * state and reset to zero.
+ */
+
+#define N 12
+#define M 6
+
+/* Block offsets of the error state */
+#define E_TH 0
+#define E_P  3
+#define E_V  6
+#define E_W  9
+
+/* Rotation matrix of unit quaternion q, column-major */
+static void qrotmat( const double q[4], double R[9] )
+{
+    double x = q[0], y = q[1], z = q[2], w = q[3];
+    R[0] = 1 - 2*(y*y + z*z); R[3] = 2*(x*y - w*z);     R[6] = 2*(x*z + w*y);
+    R[1] = 2*(x*y + w*z);     R[4] = 1 - 2*(x*x + z*z); R[7] = 2*(y*z - w*x);
+    R[2] = 2*(x*z - w*y);     R[5] = 2*(y*z + w*x);     R[8] = 1 - 2*(x*x + y*y);
+}
+
+/* q := exp(theta/2) * q */
+static void qinject( const double theta[3], double q[4] )
+{
+    double h[4] = {theta[0]/2, theta[1]/2, theta[2]/2, 0};
+    double e[4], q1[4];
+    aa_tf_qexp( h, e );
+    aa_tf_qmul( e, q, q1 );
+    aa_tf_qnormalize( q1 );
+    AA_MEM_CPY( q, q1, 4 );
+}
+
+/* P := P + P**T, halved, filling both triangles */
+static void sym12( double *P )
+{
+    for( size_t j = 0; j < N; j ++ ) {
+        for( size_t i = j+1; i < N; i ++ ) {
+            double p = (AA_MATREF(P, N, i, j) + AA_MATREF(P, N, j, i)) / 2;
+            AA_MATREF(P, N, i, j) = p;
+            AA_MATREF(P, N, j, i) = p;
+        }
+    }
+}
+
+void rfx_lqg_qutr_eskf_process_noise
+( double dt, double dx, double dtheta, double *V )
+{
+    // white acceleration on each (position, velocity) pair
+    double a = dt*dt*dt / 3, b = dt*dt / 2, c = dt;
+    AA_MEM_ZERO( V, N*N );
+    for( size_t k = 0; k < 3; k ++ ) {
+        AA_MATREF(V, N, E_P+k, E_P+k) = a * dx;
+        AA_MATREF(V, N, E_P+k, E_V+k) = b * dx;
+        AA_MATREF(V, N, E_V+k, E_P+k) = b * dx;
+        AA_MATREF(V, N, E_V+k, E_V+k) = c * dx;
+
+        AA_MATREF(V, N, E_TH+k, E_TH+k) = a * dtheta;
+        AA_MATREF(V, N, E_TH+k, E_W+k) = b * dtheta;
+        AA_MATREF(V, N, E_W+k, E_TH+k) = b * dtheta;
+        AA_MATREF(V, N, E_W+k, E_W+k) = c * dtheta;
+    }
+}
+
+int rfx_lqg_qutr_eskf_predict
+( double dt, double *E, double *dE, double *P, const double *V )
+{
+    // nominal state, aa_tf_qutr_svel() model
+    double E1[7];
+    aa_tf_qutr_svel( E, dE, dt, E1 );
+    AA_MEM_CPY( E, E1, 7 );
+
+    // Error transition, rotation of the increment exp(omega*dt/2):
+    //
+    //     [ R  0  0  dt ]
+    // F = [ 0  I  dt 0  ]
+    //     [ 0  0  I  0  ]
+    //     [ 0  0  0  I  ]
+    double h[4] = {dE[3]*dt/2, dE[4]*dt/2, dE[5]*dt/2, 0};
+    double dq[4], R[9];
+    aa_tf_qexp( h, dq );
+    qrotmat( dq, R );
+
+    // T := F*P, by block rows
+    double T[N*N];
+    for( size_t j = 0; j < N; j ++ ) {
+        for( size_t i = 0; i < 3; i ++ ) {
+            double s = dt * AA_MATREF(P, N, E_W+i, j);
+            for( size_t k = 0; k < 3; k ++ )
+                s += R[k*3+i] * AA_MATREF(P, N, E_TH+k, j);
+            AA_MATREF(T, N, E_TH+i, j) = s;
+            AA_MATREF(T, N, E_P+i, j) = AA_MATREF(P, N, E_P+i, j) + dt * AA_MATREF(P, N, E_V+i, j);
+            AA_MATREF(T, N, E_V+i, j) = AA_MATREF(P, N, E_V+i, j);
+            AA_MATREF(T, N, E_W+i, j) = AA_MATREF(P, N, E_W+i, j);
+        }
+    }
+
+    // P := T*F**T + V, by block columns
+    for( size_t i = 0; i < N; i ++ ) {
+        for( size_t j = 0; j < 3; j ++ ) {
+            double s = dt * AA_MATREF(T, N, i, E_W+j);
+            for( size_t k = 0; k < 3; k ++ )
+                s += AA_MATREF(T, N, i, E_TH+k) * R[k*3+j];
+            AA_MATREF(P, N, i, E_TH+j) = s;
+            AA_MATREF(P, N, i, E_P+j) = AA_MATREF(T, N, i, E_P+j) + dt * AA_MATREF(T, N, i, E_V+j);
+            AA_MATREF(P, N, i, E_V+j) = AA_MATREF(T, N, i, E_V+j);
+            AA_MATREF(P, N, i, E_W+j) = AA_MATREF(T, N, i, E_W+j);
+        }
+    }
+    for( size_t k = 0; k < N*N; k ++ ) P[k] += V[k];
+    sym12( P );
+
+    return 0;
+}
+
+int rfx_lqg_qutr_eskf_correct
+( double dt, double *E_est, double *dE_est,
+  const double *E_obs,
+  double *P, const double *W )
+{
+    (void)dt;
+
+    // residual r = [ rotation vector of q_obs*q_est**-1, p_obs - p_est ]
+    double r[M], q_rel[4], w[4];
+    aa_tf_qmulc( E_obs, E_est, q_rel );
+    aa_tf_qminimize( q_rel );
+    aa_tf_qln( q_rel, w );
+    for( size_t k = 0; k < 3; k ++ ) {
+        r[k] = 2*w[k];
+        r[3+k] = E_obs[4+k] - E_est[4+k];
+    }
+
+    // H = [ I 0 ], so S = P(0:5,0:5) + W and P*H**T = P(:,0:5)
+    // U := chol(S), U**T*U = S
+    double U[M*M];
+    for( size_t j = 0; j < M; j ++ )
+        for( size_t i = 0; i <= j; i ++ )
+            AA_MATREF(U, M, i, j) = AA_MATREF(P, N, i, j) + AA_MATREF(W, M, i, j);
+    for( size_t j = 0; j < M; j ++ ) {
+        double d = AA_MATREF(U, M, j, j);
+        for( size_t k = 0; k < j; k ++ )
+            d -= AA_MATREF(U, M, k, j) * AA_MATREF(U, M, k, j);
+        if( ! (d > 0) ) return -1;
+        d = sqrt(d);
+        AA_MATREF(U, M, j, j) = d;
+        for( size_t i = j+1; i < M; i ++ ) {
+            double s = AA_MATREF(U, M, j, i);
+            for( size_t k = 0; k < j; k ++ )
+                s -= AA_MATREF(U, M, k, j) * AA_MATREF(U, M, k, i);
+            AA_MATREF(U, M, j, i) = s / d;
+        }
+    }
+
+    // Kt := S**-1 * P(0:5,:), so that K = Kt**T
+    double Kt[M*N];
+    for( size_t c = 0; c < N; c ++ ) {
+        double *b = &Kt[c*M];
+        for( size_t i = 0; i < M; i ++ ) {
+            double s = AA_MATREF(P, N, i, c);
+            for( size_t k = 0; k < i; k ++ )
+                s -= AA_MATREF(U, M, k, i) * b[k];
+            b[i] = s / AA_MATREF(U, M, i, i);
+        }
+        for( size_t ii = M; ii > 0; ii -- ) {
+            size_t i = ii - 1;
+            double s = b[i];
+            for( size_t k = i+1; k < M; k ++ )
+                s -= AA_MATREF(U, M, i, k) * b[k];
+            b[i] = s / AA_MATREF(U, M, i, i);
+        }
+    }
+
+    // e := K*r
+    double e[N];
+    for( size_t c = 0; c < N; c ++ ) {
+        double s = 0;
+        for( size_t i = 0; i < M; i ++ ) s += Kt[c*M+i] * r[i];
+        e[c] = s;
+    }
+
+    // P := (I - K*H)*P = P - K*P(0:5,:)
+    double P1[N*N];
+    for( size_t j = 0; j < N; j ++ ) {
+        for( size_t i = 0; i < N; i ++ ) {
+            double s = AA_MATREF(P, N, i, j);
+            for( size_t k = 0; k < M; k ++ )
+                s -= Kt[i*M+k] * AA_MATREF(P, N, k, j);
+            AA_MATREF(P1, N, i, j) = s;
+        }
+    }
+
+    // inject the error into the nominal state
+    qinject( e+E_TH, E_est );
+    for( size_t k = 0; k < 3; k ++ ) {
+        E_est[4+k] += e[E_P+k];
+        dE_est[k] += e[E_V+k];
+        dE_est[3+k] += e[E_W+k];
+    }
+
+    // reset: P := G*P*G**T, G = I + [dtheta/2]_x on the rotation block,
+    // the jacobian of the global error about the injected nominal
+    double G[9] = { 1,              e[E_TH+2]/2,  -e[E_TH+1]/2,
+                   -e[E_TH+2]/2,    1,             e[E_TH+0]/2,
+                    e[E_TH+1]/2,   -e[E_TH+0]/2,   1 };
+    for( size_t j = 0; j < N; j ++ ) {
+        double t[3];
+        for( size_t i = 0; i < 3; i ++ ) {
+            double s = 0;
+            for( size_t k = 0; k < 3; k ++ ) s += G[k*3+i] * AA_MATREF(P1, N, k, j);
+            t[i] = s;
+        }
+        for( size_t i = 0; i < 3; i ++ ) AA_MATREF(P1, N, i, j) = t[i];
+    }
+    for( size_t i = 0; i < N; i ++ ) {
+        double t[3];
+        for( size_t j = 0; j < 3; j ++ ) {
+            double s = 0;
+            for( size_t k = 0; k < 3; k ++ ) s += AA_MATREF(P1, N, i, k) * G[k*3+j];
+            t[j] = s;
+        }
+        for( size_t j = 0; j < 3; j ++ ) AA_MATREF(P1, N, i, j) = t[j];
+    }
+
+    AA_MEM_CPY( P, P1, N*N );
+    sym12( P );
+    return 0;
+}
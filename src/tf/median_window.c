@@ -0,0 +1,192 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <amino.h>
+#include "reflex.h"
+
+/* Sliding-window median of poses.
+ *
+ * The rotation median is the medoid under aa_tf_qangle_rel(), as in
+ * rfx_tf_qangmedian().  Each slot keeps its total angle to the other
+ * slots; replacing a slot updates every total by the angles to the
+ * outgoing and incoming samples, so an observation costs 2n angle
+ * evaluations instead of n^2/2.  The totals are recomputed from
+ * scratch each time the ring wraps, which bounds rounding drift at
+ * amortized O(n) cost.
+ *
+ * Translations are kept sorted per axis.  An observation removes the
+ * outgoing value and inserts the new one by binary search and a
+ * block move.
+ */
+
+AA_API int rfx_tf_median_window_init( rfx_tf_median_window_t *w, size_t max )
+{
+    memset( w, 0, sizeof(*w) );
+    if( 0 == max ) return -1;
+    w->max = max;
+    w->E = (double*)malloc( sizeof(double) * (7 + 1 + 3) * max );
+    if( NULL == w->E ) return -1;
+    w->sum = w->E + 7*max;
+    w->x_sorted = w->sum + max;
+    return 0;
+}
+
+AA_API void rfx_tf_median_window_destroy( rfx_tf_median_window_t *w )
+{
+    free( w->E );
+    memset( w, 0, sizeof(*w) );
+}
+
+/* Index of the first element of sorted x[0:n) not less than v */
+static size_t lower_bound( size_t n, const double *x, double v )
+{
+    size_t lo = 0, hi = n;
+    while( lo < hi ) {
+        size_t mid = lo + (hi - lo) / 2;
+        if( x[mid] < v ) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void sorted_remove( size_t n, double *x, double v )
+{
+    size_t k = lower_bound( n, x, v );
+    if( k < n ) memmove( x+k, x+k+1, sizeof(double) * (n-k-1) );
+}
+
+static void sorted_insert( size_t n, double *x, double v )
+{
+    size_t k = lower_bound( n, x, v );
+    memmove( x+k+1, x+k, sizeof(double) * (n-k) );
+    x[k] = v;
+}
+
+static void window_resum( rfx_tf_median_window_t *w )
+{
+    AA_MEM_ZERO( w->sum, w->n );
+    for( size_t i = 0; i < w->n; i ++ ) {
+        const double *qi = AA_MATCOL(w->E, 7, i);
+        for( size_t j = 0; j < i; j ++ ) {
+            double d = aa_tf_qangle_rel( qi, AA_MATCOL(w->E, 7, j) );
+            w->sum[i] += d;
+            w->sum[j] += d;
+        }
+    }
+}
+
+AA_API void rfx_tf_median_window_add( rfx_tf_median_window_t *w, const double E[7] )
+{
+    size_t s = w->i;
+    double *e = AA_MATCOL(w->E, 7, s);
+    int full = (w->n == w->max);
+
+    // slots other than s that stay in the window
+    size_t n_other = full ? w->n - 1 : w->n;
+
+    // translation
+    for( size_t k = 0; k < 3; k ++ ) {
+        double *x = w->x_sorted + k*w->max;
+        if( full ) sorted_remove( w->n, x, e[4+k] );
+        sorted_insert( n_other, x, E[4+k] );
+    }
+
+    // rotation totals
+    double sum_s = 0;
+    for( size_t j = 0; j < w->n; j ++ ) {
+        if( j == s ) continue;
+        const double *qj = AA_MATCOL(w->E, 7, j);
+        double d_new = aa_tf_qangle_rel( qj, E );
+        if( full ) w->sum[j] -= aa_tf_qangle_rel( qj, e );
+        w->sum[j] += d_new;
+        sum_s += d_new;
+    }
+    w->sum[s] = sum_s;
+
+    AA_MEM_CPY( e, E, 7 );
+    if( !full ) w->n++;
+    w->i = (s + 1) % w->max;
+
+    if( 0 == w->i ) window_resum( w );
+}
+
+AA_API void rfx_tf_median_window_get( const rfx_tf_median_window_t *w, double z[7] )
+{
+    if( 0 == w->n ) {
+        AA_MEM_CPY( z, aa_tf_qutr_ident, 7 );
+        return;
+    }
+
+    size_t i_min = aa_fminloc( w->n, w->sum );
+    AA_MEM_CPY( z, AA_MATCOL(w->E, 7, i_min), 4 );
+
+    size_t h = w->n / 2;
+    for( size_t k = 0; k < 3; k ++ ) {
+        const double *x = w->x_sorted + k*w->max;
+        z[4+k] = (w->n % 2) ? x[h] : (x[h-1] + x[h]) / 2;
+    }
+}
+
+AA_API int rfx_tf_madqg_correct_median_window2
+( double dt, rfx_tf_median_window_t *win,
+  double *E_est, double *dx_est,
+  size_t n_obs, const double *E_obs,
+  double *P, const double *W )
+{
+    double Z[7];
+
+    // get the EKF measurement
+    for( size_t i = 0; i < n_obs; i ++ )
+        rfx_tf_median_window_add( win, AA_MATCOL(E_obs,7,i) );
+
+    rfx_tf_median_window_get( win, Z );
+
+    if( win->n < win->max ) {
+        // not enough samples, just use the median
+        AA_MEM_CPY( E_est, Z, 7 );
+        return 0;
+    }
+
+    int r = rfx_lqg_qutr_correct( dt, E_est, dx_est, Z, P, W );
+    return r;
+}
@@ -0,0 +1,312 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <amino.h>
+#include "reflex.h"
+
+/* Multi-hypothesis pose tracking.
+ *
+ * Each hypothesis is an error-state pose filter with a log weight.
+ * A frame expands every hypothesis into one child per gated
+ * observation plus one child for "no valid observation", scores the
+ * children by innovation likelihood, then merges children that
+ * converged to the same pose and keeps the max_hyp best.  Storage is
+ * allocated once in rfx_tf_mht_init(), and the work per frame is
+ * bounded by max_hyp*(max_obs+1) filter corrections.
+ */
+
+#define N 12
+#define M 6
+
+static const double LOG_2PI = 1.8378770664093453;
+
+/* log(exp(a) + exp(b)) */
+static double logadd( double a, double b )
+{
+    if( a < b ) { double t = a; a = b; b = t; }
+    if( isinf(b) ) return a;
+    return a + log1p( exp(b - a) );
+}
+
+/* L := chol(S), S = P(0:5,0:5) + W, matching H = [I 0] of
+ * rfx_lqg_qutr_eskf_correct().  Returns log(det(S)) in log_det.
+ */
+static int innov_factor( const rfx_tf_mht_hyp_t *h, const double *W,
+                         double *L, double *log_det )
+{
+    for( size_t j = 0; j < M; j ++ )
+        for( size_t i = j; i < M; i ++ )
+            AA_MATREF(L, M, i, j) = AA_MATREF(h->P, N, i, j) + AA_MATREF(W, M, i, j);
+    *log_det = 0;
+    for( size_t j = 0; j < M; j ++ ) {
+        double d = AA_MATREF(L, M, j, j);
+        for( size_t k = 0; k < j; k ++ )
+            d -= AA_MATREF(L, M, j, k) * AA_MATREF(L, M, j, k);
+        if( ! (d > 0) ) return -1;
+        d = sqrt(d);
+        AA_MATREF(L, M, j, j) = d;
+        *log_det += 2*log(d);
+        for( size_t i = j+1; i < M; i ++ ) {
+            double s = AA_MATREF(L, M, i, j);
+            for( size_t k = 0; k < j; k ++ )
+                s -= AA_MATREF(L, M, i, k) * AA_MATREF(L, M, j, k);
+            AA_MATREF(L, M, i, j) = s / d;
+        }
+    }
+    return 0;
+}
+
+/* Normalized innovation squared of E_obs against hypothesis h, with
+ * the residual of rfx_lqg_qutr_eskf_correct().
+ */
+static double innov_nis( const rfx_tf_mht_hyp_t *h, const double *L,
+                         const double *E_obs )
+{
+    double r[M], q_rel[4], w[4];
+    aa_tf_qmulc( E_obs, h->E, q_rel );
+    aa_tf_qminimize( q_rel );
+    aa_tf_qln( q_rel, w );
+    for( size_t k = 0; k < 3; k ++ ) {
+        r[k] = 2*w[k];
+        r[3+k] = E_obs[4+k] - h->E[4+k];
+    }
+
+    // y := L**-1 * r
+    double y[M], d2 = 0;
+    for( size_t i = 0; i < M; i ++ ) {
+        double s = r[i];
+        for( size_t k = 0; k < i; k ++ )
+            s -= AA_MATREF(L, M, i, k) * y[k];
+        y[i] = s / AA_MATREF(L, M, i, i);
+        d2 += y[i]*y[i];
+    }
+    return d2;
+}
+
+AA_API int rfx_tf_mht_init
+( rfx_tf_mht_t *mht, size_t max_hyp, size_t max_obs,
+  const double E0[7], const double *P0,
+  const double *V, const double *W )
+{
+    memset( mht, 0, sizeof(*mht) );
+    if( 0 == max_hyp ) return -1;
+
+    size_t max_child = max_hyp * (max_obs+1);
+    mht->max_hyp = max_hyp;
+    mht->max_obs = max_obs;
+
+    void *ptr;
+    if( posix_memalign( &ptr, 64, sizeof(rfx_tf_mht_hyp_t) * (max_hyp + max_child) ) )
+        return -1;
+    mht->hyp = (rfx_tf_mht_hyp_t*)ptr;
+    mht->child = mht->hyp + max_hyp;
+    mht->order = (size_t*)malloc( sizeof(size_t) * max_child );
+    if( NULL == mht->order ) {
+        free( ptr );
+        return -1;
+    }
+
+    AA_MEM_CPY( mht->V, V, N*N );
+    AA_MEM_CPY( mht->W, W, M*M );
+
+    // chi-square 6 dof, p = 0.999
+    mht->gate = 22.458;
+    mht->log_miss = 0;
+    mht->log_prune = log(1e-4);
+    mht->merge_theta = 1e-2;
+    mht->merge_x = 1e-3;
+
+    rfx_tf_mht_hyp_t *h = &mht->hyp[0];
+    AA_MEM_CPY( h->E, E0, 7 );
+    AA_MEM_ZERO( h->dE, 6 );
+    AA_MEM_CPY( h->P, P0, N*N );
+    h->log_w = 0;
+    h->i_obs = -1;
+    mht->n_hyp = 1;
+
+    return 0;
+}
+
+AA_API void rfx_tf_mht_destroy( rfx_tf_mht_t *mht )
+{
+    free( mht->hyp );
+    free( mht->order );
+    memset( mht, 0, sizeof(*mht) );
+}
+
+/*-- Expansion --*/
+
+struct mht_cx {
+    rfx_tf_mht_t *mht;
+    double dt;
+    size_t n_obs;
+    const double *E_obs;
+};
+
+/* Predict parent i and write its n_obs+1 children */
+static void expand_task( void *vcx, size_t i )
+{
+    struct mht_cx *cx = (struct mht_cx*)vcx;
+    rfx_tf_mht_t *mht = cx->mht;
+    rfx_tf_mht_hyp_t *p = &mht->hyp[i];
+    rfx_tf_mht_hyp_t *c = &mht->child[i*(cx->n_obs+1)];
+
+    rfx_lqg_qutr_eskf_predict( cx->dt, p->E, p->dE, p->P, mht->V );
+
+    double L[M*M], log_det;
+    if( innov_factor(p, mht->W, L, &log_det) ) {
+        for( size_t j = 0; j <= cx->n_obs; j ++ )
+            c[j].log_w = -INFINITY;
+        return;
+    }
+    double log_norm = -0.5 * (log_det + M*LOG_2PI);
+
+    // no observation
+    memcpy( c, p, sizeof(*c) );
+    c->log_w = p->log_w + log_norm - 0.5*mht->gate + mht->log_miss;
+    c->i_obs = -1;
+
+    for( size_t j = 0; j < cx->n_obs; j ++ ) {
+        const double *z = AA_MATCOL(cx->E_obs, 7, j);
+        c = &mht->child[i*(cx->n_obs+1) + j+1];
+        double nis = innov_nis( p, L, z );
+        if( ! (nis <= mht->gate) ) {
+            c->log_w = -INFINITY;
+            continue;
+        }
+        memcpy( c, p, sizeof(*c) );
+        c->log_w = p->log_w + log_norm - 0.5*nis;
+        c->i_obs = (ssize_t)j;
+        if( rfx_lqg_qutr_eskf_correct( cx->dt, c->E, c->dE, z, c->P, mht->W ) )
+            c->log_w = -INFINITY;
+    }
+}
+
+/*-- Merge and prune --*/
+
+static int same_pose( const rfx_tf_mht_t *mht,
+                      const rfx_tf_mht_hyp_t *a, const rfx_tf_mht_hyp_t *b )
+{
+    return aa_tf_qangle_rel( a->E, b->E ) < mht->merge_theta
+        && sqrt( aa_la_ssd(3, a->E+4, b->E+4) ) < mht->merge_x;
+}
+
+static int select_children( rfx_tf_mht_t *mht, size_t n_child )
+{
+    rfx_tf_mht_hyp_t *C = mht->child;
+    size_t *order = mht->order;
+
+    // sort live children by decreasing weight
+    size_t n = 0;
+    for( size_t k = 0; k < n_child; k ++ ) {
+        if( isinf(C[k].log_w) ) continue;
+        size_t i = n++;
+        while( i > 0 && C[order[i-1]].log_w < C[k].log_w ) {
+            order[i] = order[i-1];
+            i--;
+        }
+        order[i] = k;
+    }
+    if( 0 == n ) return -1;
+
+    // Greedy: each child is absorbed by a heavier kept child with the
+    // same pose, otherwise kept if there is room and it is not
+    // negligible against the best.
+    double log_best = C[order[0]].log_w;
+    size_t n_keep = 0;
+    for( size_t k = 0; k < n; k ++ ) {
+        rfx_tf_mht_hyp_t *c = &C[order[k]];
+        size_t j;
+        for( j = 0; j < n_keep; j ++ ) {
+            if( same_pose(mht, &C[order[j]], c) ) {
+                C[order[j]].log_w = logadd( C[order[j]].log_w, c->log_w );
+                break;
+            }
+        }
+        if( j < n_keep ) continue;
+        if( n_keep < mht->max_hyp && c->log_w - log_best > mht->log_prune )
+            order[n_keep++] = order[k];
+    }
+
+    // copy back, renormalized
+    double log_sum = -INFINITY;
+    for( size_t j = 0; j < n_keep; j ++ )
+        log_sum = logadd( log_sum, C[order[j]].log_w );
+    for( size_t j = 0; j < n_keep; j ++ ) {
+        memcpy( &mht->hyp[j], &C[order[j]], sizeof(mht->hyp[j]) );
+        mht->hyp[j].log_w -= log_sum;
+    }
+    mht->n_hyp = n_keep;
+
+    // merging may reorder weights; keep the best first
+    for( size_t j = 1; j < n_keep; j ++ ) {
+        if( mht->hyp[j].log_w > mht->hyp[0].log_w ) {
+            rfx_tf_mht_hyp_t t;
+            memcpy( &t, &mht->hyp[0], sizeof(t) );
+            memcpy( &mht->hyp[0], &mht->hyp[j], sizeof(t) );
+            memcpy( &mht->hyp[j], &t, sizeof(t) );
+        }
+    }
+    return 0;
+}
+
+AA_API int rfx_tf_mht_step
+( rfx_tf_mht_t *mht, rfx_tpool_t *pool, double dt,
+  size_t n_obs, const double *E_obs,
+  double *E_est, double *dE_est )
+{
+    if( 0 == mht->n_hyp ) return -1;
+
+    struct mht_cx cx = { .mht = mht, .dt = dt,
+                         .n_obs = AA_MIN(n_obs, mht->max_obs),
+                         .E_obs = E_obs };
+
+    rfx_tpool_run( pool, mht->n_hyp, expand_task, &cx );
+    if( select_children( mht, mht->n_hyp * (cx.n_obs+1) ) )
+        return -1;
+
+    if( E_est ) AA_MEM_CPY( E_est, mht->hyp[0].E, 7 );
+    if( dE_est ) AA_MEM_CPY( dE_est, mht->hyp[0].dE, 6 );
+
+    return 0;
+}
@@ -0,0 +1,221 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <float.h>
+#include <amino.h>
+#include "reflex.h"
+
+/*-- Blocked all-pairs medoid --*/
+
+/* The rotation angle between unit quaternions a and b is
+ * 2*acos(|a.b|).  Quaternions are copied to structure-of-arrays form
+ * so the inner loop is a dot product and an arccosine over
+ * contiguous lanes.  The arccosine is the fdlibm rational
+ * approximation, written branch-free so the loop vectorizes.
+ */
+
+#define QMED_ALIGN 64
+/* Columns per block: four components of a block stay in L1 */
+#define QMED_NJ 256
+/* Rows per task */
+#define QMED_NI 64
+
+static inline double acos_unit( double x )
+{
+    // asin(s) = s + s*R(t) on [0, 0.5], fdlibm e_asin.c coefficients
+    static const double
+        pS0 =  1.66666666666666657415e-01,
+        pS1 = -3.25565818622400915405e-01,
+        pS2 =  2.01212532134862925881e-01,
+        pS3 = -4.00555345006794114027e-02,
+        pS4 =  7.91534994289814532176e-04,
+        pS5 =  3.47933107596021167570e-05,
+        qS1 = -2.40339491173441421878e+00,
+        qS2 =  2.02094576023350569471e+00,
+        qS3 = -6.88283971605453293030e-01,
+        qS4 =  7.70381505559019352791e-02;
+
+    // x in [0,1]:
+    //   x <= 1/2: acos(x) = pi/2 - asin(x)
+    //   x >  1/2: acos(x) = 2*asin(sqrt((1-x)/2))
+    int hi = x > 0.5;
+    double t = hi ? (1-x)/2 : x*x;
+    double s = hi ? sqrt(t) : x;
+    double p = t*(pS0+t*(pS1+t*(pS2+t*(pS3+t*(pS4+t*pS5)))));
+    double q = 1+t*(qS1+t*(qS2+t*(qS3+t*qS4)));
+    double a = s + s*(p/q);
+    return hi ? 2*a : M_PI_2 - a;
+}
+
+struct qmed_cx {
+    size_t n;
+    size_t ld;
+    const double *X, *Y, *Z, *W;
+    double *sum;
+};
+
+static void qmed_task( void *vcx, size_t t )
+{
+    struct qmed_cx *cx = (struct qmed_cx*)vcx;
+    size_t n = cx->n;
+    size_t i0 = t*QMED_NI;
+    size_t i1 = AA_MIN( i0+QMED_NI, n );
+    const double *AA_RESTRICT X = cx->X;
+    const double *AA_RESTRICT Y = cx->Y;
+    const double *AA_RESTRICT Z = cx->Z;
+    const double *AA_RESTRICT W = cx->W;
+
+    double acc[QMED_NI];
+    AA_MEM_ZERO( acc, QMED_NI );
+
+    // Full rows rather than the upper triangle, so tasks write
+    // disjoint outputs.
+    for( size_t j0 = 0; j0 < n; j0 += QMED_NJ ) {
+        size_t j1 = AA_MIN( j0+QMED_NJ, n );
+        for( size_t i = i0; i < i1; i ++ ) {
+            double xi = X[i], yi = Y[i], zi = Z[i], wi = W[i];
+            double s = 0;
+            for( size_t j = j0; j < j1; j ++ ) {
+                double d = fabs( xi*X[j] + yi*Y[j] + zi*Z[j] + wi*W[j] );
+                d = d < 1 ? d : 1;
+                s += acos_unit(d);
+            }
+            acc[i-i0] += s;
+        }
+    }
+
+    for( size_t i = i0; i < i1; i ++ )
+        cx->sum[i] = 2*acc[i-i0];
+}
+
+AA_API void rfx_tf_qangmedian_blocked
+( size_t n, const double *Q, size_t ldq, rfx_tpool_t *pool, double p[4] )
+{
+    if( 0 == n ) {
+        AA_MEM_CPY( p, aa_tf_quat_ident, 4 );
+        return;
+    } else if( n <= 2 ) {
+        AA_MEM_CPY( p, Q, 4 );
+        return;
+    }
+
+    size_t ld = (n + 7) / 8 * 8;
+    void *ptr;
+    if( posix_memalign( &ptr, QMED_ALIGN, sizeof(double) * 5 * ld ) ) {
+        // no memory for the copy, fall back to the reference
+        rfx_tf_qangmedian( n, Q, ldq, p );
+        return;
+    }
+    double *d = (double*)ptr;
+    struct qmed_cx cx = { .n = n, .ld = ld,
+                          .X = d, .Y = d + ld, .Z = d + 2*ld, .W = d + 3*ld,
+                          .sum = d + 4*ld };
+
+    for( size_t j = 0; j < n; j ++ ) {
+        const double *q = AA_MATCOL(Q, ldq, j);
+        d[j]      = q[0];
+        d[ld+j]   = q[1];
+        d[2*ld+j] = q[2];
+        d[3*ld+j] = q[3];
+    }
+
+    rfx_tpool_run( pool, (n + QMED_NI - 1) / QMED_NI, qmed_task, &cx );
+
+    size_t i_min = aa_fminloc( n, cx.sum );
+    AA_MEM_CPY( p, AA_MATCOL(Q, ldq, i_min), 4 );
+
+    free( ptr );
+}
+
+/*-- Weiszfeld geodesic median --*/
+
+AA_API size_t rfx_tf_qwmedian
+( size_t n, const double *Q, size_t ldq,
+  double tol, size_t max_iter, double p[4] )
+{
+    if( 0 == n ) {
+        AA_MEM_CPY( p, aa_tf_quat_ident, 4 );
+        return 0;
+    } else if( n <= 2 ) {
+        AA_MEM_CPY( p, Q, 4 );
+        return 0;
+    }
+
+    // start from the chordal mean
+    aa_tf_quat_davenport( n, NULL, Q, ldq, p );
+    aa_tf_qminimize( p );
+
+    size_t iter;
+    for( iter = 0; iter < max_iter; iter ++ ) {
+        // step = sum( log(p^-1 q_i) / d_i ) / sum( 1/d_i )
+        double v[3] = {0}, w_sum = 0;
+        for( size_t i = 0; i < n; i ++ ) {
+            double qr[4], r[3];
+            aa_tf_qcmul( p, AA_MATCOL(Q, ldq, i), qr );
+            aa_tf_qminimize( qr );
+            aa_tf_quat2rotvec( qr, r );
+            double d = sqrt( r[0]*r[0] + r[1]*r[1] + r[2]*r[2] );
+            // samples at the current estimate do not pull
+            if( d < DBL_EPSILON ) continue;
+            double w = 1 / d;
+            for( size_t k = 0; k < 3; k ++ ) v[k] += w*r[k];
+            w_sum += w;
+        }
+        if( ! (w_sum > 0) ) break;
+        for( size_t k = 0; k < 3; k ++ ) v[k] /= w_sum;
+
+        double e[4], p1[4];
+        aa_tf_rotvec2quat( v, e );
+        aa_tf_qmul( p, e, p1 );
+        aa_tf_qnormalize( p1 );
+        aa_tf_qminimize( p1 );
+        AA_MEM_CPY( p, p1, 4 );
+
+        if( sqrt( v[0]*v[0] + v[1]*v[1] + v[2]*v[2] ) < tol ) {
+            iter++;
+            break;
+        }
+    }
+
+    return iter;
+}
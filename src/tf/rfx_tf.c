@@ -307,7 +307,14 @@ int rfx_tf_umeyama
     return info;
 }
 
-// Find TF from correspondences
+/* Weiszfeld median parameters for rfx_tf_cor() */
+#define RFX_TF_COR_WEISZFELD_TOL 1e-9
+#define RFX_TF_COR_WEISZFELD_ITER 100
+
+/* RANSAC parameters for rfx_tf_cor() */
+#define RFX_TF_COR_RANSAC_CONFIDENCE 0.999
+#define RFX_TF_COR_RANSAC_ITER 4096
+
 void rfx_tf_cor( int opts, size_t n,
                  const double *qx, size_t ldqx,
                  const double *vx, size_t ldvx,
@@ -315,6 +322,25 @@ void rfx_tf_cor( int opts, size_t n,
                  const double *vy, size_t ldvy,
                  double *Z )
 {
+    rfx_tf_cor_pool( opts, NULL, n, qx, ldqx, vx, ldvx, qy, ldqy, vy, ldvy, Z );
+}
+
+// Find TF from correspondences
+void rfx_tf_cor_pool( int opts, rfx_tpool_t *pool, size_t n,
+                      const double *qx, size_t ldqx,
+                      const double *vx, size_t ldvx,
+                      const double *qy, size_t ldqy,
+                      const double *vy, size_t ldvy,
+                      double *Z )
+{
+    if( opts & RFX_TF_COR_O_RANSAC ) {
+        // LMedS scoring, no inlier threshold to choose
+        rfx_tf_cor_ransac( opts, pool, n,
+                           qx, ldqx, vx, ldvx, qy, ldqy, vy, ldvy,
+                           0, RFX_TF_COR_RANSAC_CONFIDENCE, RFX_TF_COR_RANSAC_ITER,
+                           NULL, Z );
+        return;
+    }
 
     double *top = AA_MEM_REGION_LOCAL_NEW_N( double, 1 );
 
@@ -342,8 +368,15 @@ void rfx_tf_cor( int opts, size_t n,
     if( opts & RFX_TF_COR_O_ROT_DAVENPORT )
         aa_tf_quat_davenport( n, NULL, Qrel, 4, q_fit[n_fit++] );
 
-    if( opts & RFX_TF_COR_O_ROT_MEDIAN )
+    if( opts & RFX_TF_COR_O_ROT_MEDIAN_WEISZFELD ) {
+        rfx_tf_qwmedian( n, Qrel, 4,
+                         RFX_TF_COR_WEISZFELD_TOL, RFX_TF_COR_WEISZFELD_ITER,
+                         q_fit[n_fit++] );
+    } else if( opts & RFX_TF_COR_O_ROT_MEDIAN_BLOCKED ) {
+        rfx_tf_qangmedian_blocked( n, Qrel, 4, pool, q_fit[n_fit++] );
+    } else if( opts & RFX_TF_COR_O_ROT_MEDIAN ) {
         rfx_tf_qangmedian ( n, Qrel, 4, q_fit[n_fit++] );
+    }
 
     aa_tf_quat_davenport(n_fit, NULL, q_fit[0], 4, Z);
 
@@ -0,0 +1,319 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <float.h>
+#include <amino.h>
+#include "reflex.h"
+
+/* Unscented Kalman filter for quaternion-translation pose and
+ * velocity, using the 13-element state and covariance layout of the
+ * EKF in lqg_tf_f.f90:
+ *
+ *   x = [ q (4), v (3), dv (3), omega (3) ]
+ *
+ * Quaternion perturbations are quaternion derivatives d = w*q, with
+ * w a pure quaternion, the same coordinates as rfx_lqg_qutr_innovate().
+ * A perturbation is applied as q' = exp(d*conj(q)) * q.
+ */
+
+#define NX 13
+#define NZ 7
+#define NS (2*NX+1)
+
+/* Scaled unscented transform, alpha = 1, beta = 2, kappa = 1:
+ * positive weights for a 13-dimensional state. */
+#define UKF_LAMBDA 1.0
+#define UKF_BETA   2.0
+
+struct ukf_weights {
+    double m0, c0, i;
+    double scale;
+};
+
+static const struct ukf_weights ukf_w = {
+    .m0 = UKF_LAMBDA / (NX + UKF_LAMBDA),
+    .c0 = UKF_LAMBDA / (NX + UKF_LAMBDA) + UKF_BETA,
+    .i = 1 / (2*(NX + UKF_LAMBDA)),
+    .scale = NX + UKF_LAMBDA
+};
+
+static double wm( size_t i ) { return i ? ukf_w.i : ukf_w.m0; }
+static double wc( size_t i ) { return i ? ukf_w.i : ukf_w.c0; }
+
+/* Sigma points in structure-of-arrays layout: X[k*NS + i] is state
+ * element k of point i, so the batch kernels run across points. */
+
+/* q := exp(d*conj(r)) * r, for a quaternion derivative d at r */
+static void qretract( const double r[4], const double d[4], double q[4] )
+{
+    double w[4], e[4];
+    aa_tf_qmulc( d, r, w );
+    w[3] = 0;
+    aa_tf_qexp( w, e );
+    aa_tf_qmul( e, r, q );
+    aa_tf_qnormalize( q );
+}
+
+/* d := ln(q*conj(r)) * r, the quaternion derivative at r toward q */
+static void qlift( const double r[4], const double q[4], double d[4] )
+{
+    double rel[4], w[4];
+    aa_tf_qmulc( q, r, rel );
+    aa_tf_qminimize( rel );
+    aa_tf_qln( rel, w );
+    aa_tf_qmul( w, r, d );
+}
+
+/* x := x (+) dx */
+static void state_retract( const double *x, const double *dx, double *y )
+{
+    qretract( x, dx, y );
+    for( size_t k = 4; k < NX; k ++ ) y[k] = x[k] + dx[k];
+}
+
+/* Factor P = L*L**T into L, regularizing once if needed */
+static int ukf_chol( const double *P, double *L )
+{
+    int n = NX, info;
+    double tr = 0;
+    for( size_t k = 0; k < NX; k ++ ) tr += AA_MATREF(P, NX, k, k);
+
+    for( int attempt = 0; attempt < 2; attempt ++ ) {
+        // symmetrize from the upper triangle, as the EKF maintains it
+        for( size_t j = 0; j < NX; j ++ )
+            for( size_t i = 0; i <= j; i ++ )
+                AA_MATREF(L, NX, j, i) = AA_MATREF(L, NX, i, j) = AA_MATREF(P, NX, i, j);
+        if( attempt )
+            for( size_t k = 0; k < NX; k ++ )
+                AA_MATREF(L, NX, k, k) += 1e-12 * tr + DBL_MIN;
+        dpotrf_( "L", &n, L, &n, &info );
+        if( 0 == info ) {
+            for( size_t j = 0; j < NX; j ++ )
+                for( size_t i = 0; i < j; i ++ )
+                    AA_MATREF(L, NX, i, j) = 0;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Generate sigma points about x with covariance P = L*L**T */
+static void ukf_sigma( const double *x, const double *L, double *X )
+{
+    double s = sqrt( ukf_w.scale );
+    double y[NX], d[NX];
+
+    for( size_t k = 0; k < NX; k ++ ) X[k*NS] = x[k];
+    for( size_t j = 0; j < NX; j ++ ) {
+        for( int sgn = -1; sgn <= 1; sgn += 2 ) {
+            size_t i = 1 + 2*j + (sgn > 0);
+            for( size_t k = 0; k < NX; k ++ ) d[k] = sgn * s * AA_MATREF(L, NX, k, j);
+            state_retract( x, d, y );
+            for( size_t k = 0; k < NX; k ++ ) X[k*NS + i] = y[k];
+        }
+    }
+}
+
+/* Batch process model, aa_tf_qutr_svel() at every sigma point:
+ *   q := exp(omega*dt/2) * q,  v := v + dv*dt */
+static void ukf_process( double dt, double *X )
+{
+    double *qx = X, *qy = X + NS, *qz = X + 2*NS, *qw = X + 3*NS;
+    for( size_t i = 0; i < NS; i ++ ) {
+        double wx = X[10*NS+i] * dt / 2;
+        double wy = X[11*NS+i] * dt / 2;
+        double wz = X[12*NS+i] * dt / 2;
+        double th = sqrt( wx*wx + wy*wy + wz*wz );
+        double c = cos(th);
+        double s = (th > 1e-8) ? sin(th)/th : 1 - th*th/6;
+        double ex = s*wx, ey = s*wy, ez = s*wz, ew = c;
+
+        double ax = qx[i], ay = qy[i], az = qz[i], aw = qw[i];
+        double bx = ew*ax + ex*aw + ey*az - ez*ay;
+        double by = ew*ay + ey*aw + ez*ax - ex*az;
+        double bz = ew*az + ez*aw + ex*ay - ey*ax;
+        double bw = ew*aw - ex*ax - ey*ay - ez*az;
+        double n = 1 / sqrt( bx*bx + by*by + bz*bz + bw*bw );
+        qx[i] = bx*n; qy[i] = by*n; qz[i] = bz*n; qw[i] = bw*n;
+
+        for( size_t k = 0; k < 3; k ++ )
+            X[(4+k)*NS+i] += dt * X[(7+k)*NS+i];
+    }
+}
+
+/* Weighted mean of sigma points, m_k elements of each, with the
+ * leading quaternion averaged in the tangent space of point 0. */
+static void ukf_mean( size_t m, const double *X, double *x )
+{
+    double r[4], q[4], d[4], dsum[4];
+    for( size_t k = 0; k < 4; k ++ ) r[k] = X[k*NS];
+
+    // two Gauss-Newton steps of the quaternion mean
+    for( size_t iter = 0; iter < 2; iter ++ ) {
+        AA_MEM_ZERO( dsum, 4 );
+        for( size_t i = 0; i < NS; i ++ ) {
+            for( size_t k = 0; k < 4; k ++ ) q[k] = X[k*NS+i];
+            qlift( r, q, d );
+            for( size_t k = 0; k < 4; k ++ ) dsum[k] += wm(i) * d[k];
+        }
+        qretract( r, dsum, q );
+        AA_MEM_CPY( r, q, 4 );
+    }
+    AA_MEM_CPY( x, r, 4 );
+
+    for( size_t k = 4; k < m; k ++ ) {
+        double s = 0;
+        for( size_t i = 0; i < NS; i ++ ) s += wm(i) * X[k*NS+i];
+        x[k] = s;
+    }
+}
+
+/* Deviations of the first m elements of each point from mean x */
+static void ukf_dev( size_t m, const double *X, const double *x, double *D )
+{
+    double q[4], d[4];
+    for( size_t i = 0; i < NS; i ++ ) {
+        for( size_t k = 0; k < 4; k ++ ) q[k] = X[k*NS+i];
+        qlift( x, q, d );
+        for( size_t k = 0; k < 4; k ++ ) D[k*NS+i] = d[k];
+    }
+    for( size_t k = 4; k < m; k ++ )
+        for( size_t i = 0; i < NS; i ++ )
+            D[k*NS+i] = X[k*NS+i] - x[k];
+}
+
+/* C := sum_i wc(i) * A(:,i) * B(:,i)**T + C */
+static void ukf_cov( size_t ma, const double *A, size_t mb, const double *B, double *C )
+{
+    for( size_t b = 0; b < mb; b ++ ) {
+        for( size_t a = 0; a < ma; a ++ ) {
+            double s = 0;
+            for( size_t i = 0; i < NS; i ++ )
+                s += wc(i) * A[a*NS+i] * B[b*NS+i];
+            AA_MATREF(C, ma, a, b) += s;
+        }
+    }
+}
+
+int rfx_lqg_qutr_ukf_predict
+( double dt, double *E, double *dx, double *P, const double *V )
+{
+    double x[NX], L[NX*NX], X[NX*NS], D[NX*NS];
+    AA_MEM_CPY( x, E, 7 );
+    AA_MEM_CPY( x+7, dx, 6 );
+
+    if( ukf_chol(P, L) ) return -1;
+    ukf_sigma( x, L, X );
+    ukf_process( dt, X );
+    ukf_mean( NX, X, x );
+    ukf_dev( NX, X, x, D );
+
+    AA_MEM_CPY( P, V, NX*NX );
+    ukf_cov( NX, D, NX, D, P );
+
+    AA_MEM_CPY( E, x, 7 );
+    AA_MEM_CPY( dx, x+7, 6 );
+    return 0;
+}
+
+int rfx_lqg_qutr_ukf_correct
+( double dt, double *E_est, double *dx_est,
+  const double *E_obs,
+  double *P, const double *W )
+{
+    (void)dt;
+    double x[NX], L[NX*NX], X[NX*NS], D[NX*NS];
+    double zh[NZ], DZ[NZ*NS];
+    double S[NZ*NZ], Pxz[NX*NZ], y[NZ], dxk[NX], x1[NX];
+    int nz = NZ, nx = NX, info;
+
+    AA_MEM_CPY( x, E_est, 7 );
+    AA_MEM_CPY( x+7, dx_est, 6 );
+
+    if( ukf_chol(P, L) ) return -1;
+    ukf_sigma( x, L, X );
+
+    // measurement is the pose, the leading NZ state elements
+    ukf_mean( NZ, X, zh );
+    ukf_dev( NZ, X, zh, DZ );
+    ukf_dev( NX, X, x, D );
+
+    AA_MEM_CPY( S, W, NZ*NZ );
+    ukf_cov( NZ, DZ, NZ, DZ, S );
+    AA_MEM_ZERO( Pxz, NX*NZ );
+    ukf_cov( NX, D, NZ, DZ, Pxz );
+
+    // innovation, in the coordinates of rfx_lqg_qutr_innovate()
+    qlift( zh, E_obs, y );
+    for( size_t k = 4; k < NZ; k ++ ) y[k] = E_obs[k] - zh[k];
+
+    // K**T := S**-1 * Pxz**T
+    double Kt[NZ*NX], LS[NZ*NZ];
+    for( size_t j = 0; j < NX; j ++ )
+        for( size_t i = 0; i < NZ; i ++ )
+            AA_MATREF(Kt, NZ, i, j) = AA_MATREF(Pxz, NX, j, i);
+    AA_MEM_CPY( LS, S, NZ*NZ );
+    dposv_( "U", &nz, &nx, LS, &nz, Kt, &nz, &info );
+    if( info ) return -1;
+
+    // x := x (+) K*y
+    for( size_t j = 0; j < NX; j ++ ) {
+        double s = 0;
+        for( size_t i = 0; i < NZ; i ++ ) s += AA_MATREF(Kt, NZ, i, j) * y[i];
+        dxk[j] = s;
+    }
+    state_retract( x, dxk, x1 );
+
+    // P := P - K*S*K**T = P - Pxz*K**T
+    for( size_t j = 0; j < NX; j ++ ) {
+        for( size_t i = 0; i < NX; i ++ ) {
+            double s = 0;
+            for( size_t k = 0; k < NZ; k ++ )
+                s += AA_MATREF(Pxz, NX, i, k) * AA_MATREF(Kt, NZ, k, j);
+            AA_MATREF(P, NX, i, j) -= s;
+        }
+    }
+
+    AA_MEM_CPY( E_est, x1, 7 );
+    AA_MEM_CPY( dx_est, x1+7, 6 );
+    return 0;
+}
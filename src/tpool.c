@@ -0,0 +1,145 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <unistd.h>
+#include <amino.h>
+#include "reflex.h"
+
+static void drain( rfx_tpool_t *pool, rfx_tpool_fun *fun, void *cx, size_t n )
+{
+    size_t i;
+    while( (i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < n )
+        fun( cx, i );
+}
+
+static void *worker( void *arg )
+{
+    rfx_tpool_t *pool = (rfx_tpool_t*)arg;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock( &pool->mutex );
+    for(;;) {
+        while( seen == pool->gen && !pool->shutdown )
+            pthread_cond_wait( &pool->cond_work, &pool->mutex );
+        if( pool->shutdown ) break;
+
+        seen = pool->gen;
+        rfx_tpool_fun *fun = pool->fun;
+        void *cx = pool->cx;
+        size_t n = pool->n;
+        pthread_mutex_unlock( &pool->mutex );
+
+        drain( pool, fun, cx, n );
+
+        pthread_mutex_lock( &pool->mutex );
+        if( 0 == --pool->n_pending )
+            pthread_cond_signal( &pool->cond_done );
+    }
+    pthread_mutex_unlock( &pool->mutex );
+    return NULL;
+}
+
+AA_API int rfx_tpool_init( rfx_tpool_t *pool, size_t n_thread )
+{
+    memset( pool, 0, sizeof(*pool) );
+    if( 0 == n_thread ) {
+        long c = sysconf( _SC_NPROCESSORS_ONLN );
+        n_thread = (c > 0) ? (size_t)c : 1;
+    }
+    pthread_mutex_init( &pool->mutex, NULL );
+    pthread_cond_init( &pool->cond_work, NULL );
+    pthread_cond_init( &pool->cond_done, NULL );
+
+    pool->thread = AA_NEW0_AR( pthread_t, n_thread );
+    pool->n_thread = 1;
+    for( size_t i = 0; i + 1 < n_thread; i ++ ) {
+        if( pthread_create( &pool->thread[i], NULL, worker, pool ) ) {
+            rfx_tpool_destroy( pool );
+            return -1;
+        }
+        pool->n_thread++;
+    }
+    return 0;
+}
+
+AA_API void rfx_tpool_destroy( rfx_tpool_t *pool )
+{
+    pthread_mutex_lock( &pool->mutex );
+    pool->shutdown = 1;
+    pthread_cond_broadcast( &pool->cond_work );
+    pthread_mutex_unlock( &pool->mutex );
+
+    for( size_t i = 0; i + 1 < pool->n_thread; i ++ )
+        pthread_join( pool->thread[i], NULL );
+
+    pthread_cond_destroy( &pool->cond_done );
+    pthread_cond_destroy( &pool->cond_work );
+    pthread_mutex_destroy( &pool->mutex );
+    free( pool->thread );
+    memset( pool, 0, sizeof(*pool) );
+}
+
+AA_API void rfx_tpool_run( rfx_tpool_t *pool, size_t n,
+                           rfx_tpool_fun *fun, void *cx )
+{
+    if( NULL == pool || pool->n_thread < 2 || n < 2 ) {
+        for( size_t i = 0; i < n; i ++ ) fun( cx, i );
+        return;
+    }
+
+    pthread_mutex_lock( &pool->mutex );
+    pool->fun = fun;
+    pool->cx = cx;
+    pool->n = n;
+    __atomic_store_n( &pool->next, 0, __ATOMIC_RELAXED );
+    pool->n_pending = pool->n_thread - 1;
+    pool->gen++;
+    pthread_cond_broadcast( &pool->cond_work );
+    pthread_mutex_unlock( &pool->mutex );
+
+    drain( pool, fun, cx, n );
+
+    pthread_mutex_lock( &pool->mutex );
+    while( pool->n_pending )
+        pthread_cond_wait( &pool->cond_done, &pool->mutex );
+    pthread_mutex_unlock( &pool->mutex );
+}